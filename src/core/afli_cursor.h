@@ -0,0 +1,65 @@
+#ifndef AFLI_CURSOR_PARA_H
+#define AFLI_CURSOR_PARA_H
+
+#include "core/append_tail_impl.h"
+#include "core/common.h"
+
+namespace aflipara {
+
+// An ordered cursor over the root and the append tail. Slots of a node are in
+// key order since the models are monotone, so the cursor keeps the path of
+// slots from a top node (the root or a sealed segment of the tail) to the
+// current slot, and buffers the sorted pairs of the current slot. Each slot
+// is copied under its entry lock, so the cursor is safe under concurrent
+// inserts, while it does not provide a consistent snapshot, see the scans of
+// AFLIPara with snapshots.
+template<typename KT, typename VT>
+class AFLICursor {
+typedef KVPair<KT, VT> KVT;
+struct Frame {
+  TNodePara<KT, VT>*          node;
+  int64_t                     idx;
+};
+public:
+  static const uint32_t kBufferBatch = 64;
+
+  TNodePara<KT, VT>*          root;
+  AppendTail<KT, VT>*         tail;
+  std::vector<Frame>          path;      // The slots from the top node to the current slot
+  std::vector<KVT>            batch;     // The sorted pairs of the current slot
+  int64_t                     pos;       // The position in the batch
+  int64_t                     top;       // '-1' means the root, otherwise the index of sealed segments
+  bool                        in_buffer; // Whether the batch is copied from the unsealed data of the tail
+  bool                        is_valid;
+
+public:
+  AFLICursor() = delete;
+  explicit AFLICursor(TNodePara<KT, VT>* root, AppendTail<KT, VT>* tail);
+
+  inline bool valid() const { return is_valid; }
+  inline const KT& key() const { return batch[pos].first; }
+  inline const VT& value() const { return batch[pos].second; }
+
+  void seek(KT key);              // Move to the first key not less than 'key'
+  void seek_for_prev(KT key);     // Move to the last key not larger than 'key'
+  void seek_to_first();
+  void seek_to_last();
+  void next();
+  void prev();
+
+private:
+  bool load_slot(TNodePara<KT, VT>* node, int64_t idx,
+                 TNodePara<KT, VT>*& child);
+  bool step_forward();
+  bool step_backward();
+  bool enter_node(TNodePara<KT, VT>* node, bool forward);
+  bool seek_node(TNodePara<KT, VT>* node, KT key, bool forward,
+                 bool inclusive);
+  bool tail_forward(const KT* key, bool inclusive, uint32_t from);
+  bool tail_backward(const KT* key, bool inclusive, int64_t from,
+                     bool with_buffer);
+};
+
+}
+
+#endif
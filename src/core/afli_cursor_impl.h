@@ -0,0 +1,295 @@
+#ifndef AFLI_CURSOR_PARA_IMPL_H
+#define AFLI_CURSOR_PARA_IMPL_H
+
+#include "core/afli_cursor.h"
+
+namespace aflipara {
+
+template<typename KT, typename VT>
+AFLICursor<KT, VT>::AFLICursor(TNodePara<KT, VT>* r, AppendTail<KT, VT>* t) {
+  root = r;
+  tail = t;
+  pos = 0;
+  top = -1;
+  in_buffer = false;
+  is_valid = false;
+}
+
+template<typename KT, typename VT>
+void AFLICursor<KT, VT>::seek(KT key) {
+  in_buffer = false;
+  if (root == nullptr) {
+    is_valid = false;
+  } else if (tail != nullptr && tail->cover(key)) {
+    is_valid = tail_forward(&key, true, 0);
+  } else {
+    top = -1;
+    is_valid = seek_node(root, key, true, true)
+               || (tail != nullptr && tail_forward(&key, true, 0));
+  }
+}
+
+template<typename KT, typename VT>
+void AFLICursor<KT, VT>::seek_for_prev(KT key) {
+  in_buffer = false;
+  if (root == nullptr) {
+    is_valid = false;
+  } else if (tail != nullptr && tail->cover(key)) {
+    is_valid = tail_backward(&key, true, INT64_MAX, true);
+  } else {
+    top = -1;
+    is_valid = seek_node(root, key, false, true);
+  }
+}
+
+template<typename KT, typename VT>
+void AFLICursor<KT, VT>::seek_to_first() {
+  in_buffer = false;
+  top = -1;
+  is_valid = root != nullptr && (enter_node(root, true)
+             || (tail != nullptr && tail_forward(nullptr, true, 0)));
+}
+
+template<typename KT, typename VT>
+void AFLICursor<KT, VT>::seek_to_last() {
+  in_buffer = false;
+  if (root == nullptr) {
+    is_valid = false;
+  } else if (tail != nullptr) {
+    is_valid = tail_backward(nullptr, true, INT64_MAX, true);
+  } else {
+    top = -1;
+    is_valid = enter_node(root, false);
+  }
+}
+
+template<typename KT, typename VT>
+void AFLICursor<KT, VT>::next() {
+  if (!is_valid) {
+    return;
+  }
+  if (++ pos < static_cast<int64_t>(batch.size())) {
+    return;
+  }
+  KT last = batch.back().first;
+  if (!in_buffer && step_forward()) {
+    return;
+  }
+  // Leave the current top node, the keys of the tail are ordered after it
+  is_valid = tail != nullptr
+             && tail_forward(&last, false, in_buffer ? 0 : top + 1);
+}
+
+template<typename KT, typename VT>
+void AFLICursor<KT, VT>::prev() {
+  if (!is_valid) {
+    return;
+  }
+  if (-- pos >= 0) {
+    return;
+  }
+  KT first = batch.front().first;
+  if (in_buffer) {
+    is_valid = tail_backward(&first, false, INT64_MAX, true);
+  } else if (step_backward()) {
+    return;
+  } else {
+    is_valid = top >= 0 && tail_backward(&first, false, top - 1, false);
+  }
+}
+
+template<typename KT, typename VT>
+bool AFLICursor<KT, VT>::load_slot(TNodePara<KT, VT>* node, int64_t idx,
+                                   TNodePara<KT, VT>*& child) {
+  batch.clear();
+  child = nullptr;
+  node->lock_entry(idx);
+  uint8_t type = node->entry_type(idx);
+  if (type == kData) {
+    batch.push_back(node->entries[idx].kv);
+  } else if (type == kBucket) {
+    Bucket<KT, VT>* bucket = node->entries[idx].get_bucket(node->arenas);
+    batch.assign(bucket->data, bucket->data + bucket->size);
+  } else if (type == kNode) {
+    child = node->entries[idx].get_child(node->arenas);
+  }
+  node->unlock_entry(idx);
+  if (batch.size() > 1) {
+    std::sort(batch.begin(), batch.end(),
+      [](auto const& a, auto const& b) {
+        return a.first < b.first;
+    });
+  }
+  return !batch.empty();
+}
+
+template<typename KT, typename VT>
+bool AFLICursor<KT, VT>::step_forward() {
+  // Move to the next non-empty slot after the path
+  while (!path.empty()) {
+    TNodePara<KT, VT>* node = path.back().node;
+    int64_t idx = node->next_occupied(path.back().idx + 1);
+    if (idx >= node->capacity) {
+      path.pop_back();
+      if (!path.empty()) {
+        // Skip the duplicated pointers of the finished child node. Slots
+        // never change once they point to a child node, so the pointers can
+        // be compared without locks.
+        Frame& parent = path.back();
+        while (parent.idx + 1 < parent.node->capacity
+               && parent.node->entry_type(parent.idx + 1) == kNode
+               && parent.node->entries[parent.idx + 1]
+                    .get_child(parent.node->arenas) == node) {
+          parent.idx ++;
+        }
+      }
+      continue;
+    }
+    path.back().idx = idx;
+    TNodePara<KT, VT>* child = nullptr;
+    if (load_slot(node, idx, child)) {
+      pos = 0;
+      return true;
+    } else if (child != nullptr) {
+      path.push_back({child, -1});
+    }
+  }
+  return false;
+}
+
+template<typename KT, typename VT>
+bool AFLICursor<KT, VT>::step_backward() {
+  // Move to the previous non-empty slot before the path
+  while (!path.empty()) {
+    TNodePara<KT, VT>* node = path.back().node;
+    int64_t idx = node->prev_occupied(path.back().idx - 1);
+    if (idx < 0) {
+      path.pop_back();
+      if (!path.empty()) {
+        Frame& parent = path.back();
+        while (parent.idx > 0
+               && parent.node->entry_type(parent.idx - 1) == kNode
+               && parent.node->entries[parent.idx - 1]
+                    .get_child(parent.node->arenas) == node) {
+          parent.idx --;
+        }
+      }
+      continue;
+    }
+    path.back().idx = idx;
+    TNodePara<KT, VT>* child = nullptr;
+    if (load_slot(node, idx, child)) {
+      pos = batch.size() - 1;
+      return true;
+    } else if (child != nullptr) {
+      path.push_back({child, child->capacity});
+    }
+  }
+  return false;
+}
+
+template<typename KT, typename VT>
+bool AFLICursor<KT, VT>::enter_node(TNodePara<KT, VT>* node, bool forward) {
+  path.clear();
+  if (forward) {
+    path.push_back({node, -1});
+    return step_forward();
+  } else {
+    path.push_back({node, node->capacity});
+    return step_backward();
+  }
+}
+
+template<typename KT, typename VT>
+bool AFLICursor<KT, VT>::seek_node(TNodePara<KT, VT>* node, KT key,
+                                   bool forward, bool inclusive) {
+  // Descend with the models, then walk to the neighboring slots if the
+  // predicted slot has no qualified key
+  path.clear();
+  auto less = [](auto const& a, auto const& b) { return a.first < b.first; };
+  KVT target = {key, VT()};
+  while (true) {
+    int64_t idx = node->locate(key);
+    path.push_back({node, idx});
+    TNodePara<KT, VT>* child = nullptr;
+    if (load_slot(node, idx, child)) {
+      bool strict = forward != inclusive;
+      auto it = strict
+                ? std::upper_bound(batch.begin(), batch.end(), target, less)
+                : std::lower_bound(batch.begin(), batch.end(), target, less);
+      pos = (it - batch.begin()) - (forward ? 0 : 1);
+      if (pos >= 0 && pos < static_cast<int64_t>(batch.size())) {
+        return true;
+      }
+      break;
+    } else if (child == nullptr) {
+      break;
+    }
+    node = child;
+  }
+  return forward ? step_forward() : step_backward();
+}
+
+template<typename KT, typename VT>
+bool AFLICursor<KT, VT>::tail_forward(const KT* key, bool inclusive,
+                                      uint32_t from) {
+  // Visit the sealed segments from 'from', then the unsealed data
+  uint32_t s = key == nullptr ? from : std::max(from,
+                                                tail->first_segment(*key));
+  while (true) {
+    uint32_t n = tail->num_segments;
+    in_buffer = false;
+    for (; s < n; ++ s) {
+      top = s;
+      TNodePara<KT, VT>* segment = tail->segments[s];
+      if (key == nullptr ? enter_node(segment, true)
+                         : seek_node(segment, *key, true, inclusive)) {
+        return true;
+      }
+    }
+    path.clear();
+    if (tail->copy_buffer(key, true, inclusive, kBufferBatch, batch) == n) {
+      in_buffer = true;
+      pos = 0;
+      return !batch.empty();
+    }
+    // Some unsealed data are sealed meanwhile, so visit the new segments
+  }
+}
+
+template<typename KT, typename VT>
+bool AFLICursor<KT, VT>::tail_backward(const KT* key, bool inclusive,
+                                       int64_t from, bool with_buffer) {
+  // Visit the unsealed data, then the sealed segments from 'from' and the
+  // root in reverse order
+  int64_t n = tail->num_segments;
+  if (with_buffer) {
+    path.clear();
+    n = tail->copy_buffer(key, false, inclusive, kBufferBatch, batch);
+    if (!batch.empty()) {
+      in_buffer = true;
+      pos = batch.size() - 1;
+      return true;
+    }
+  }
+  in_buffer = false;
+  int64_t s = std::min(from, n - 1);
+  if (key != nullptr) {
+    s = std::min(s, static_cast<int64_t>(tail->first_segment(*key)));
+  }
+  for (; s >= 0; -- s) {
+    top = s;
+    TNodePara<KT, VT>* segment = tail->segments[s];
+    if (key == nullptr ? enter_node(segment, false)
+                       : seek_node(segment, *key, false, inclusive)) {
+      return true;
+    }
+  }
+  top = -1;
+  return key == nullptr ? enter_node(root, false)
+                        : seek_node(root, *key, false, inclusive);
+}
+
+}
+
+#endif
@@ -1,9 +1,13 @@
 #ifndef AFLI_NODE_PARA_H
 #define AFLI_NODE_PARA_H
 
+#include "core/bloom_filter.h"
 #include "core/bucket_impl.h"
 #include "core/conflicts.h"
+#include "core/key_codec.h"
 #include "core/linear_model.h"
+#include "core/node_region.h"
+#include "core/ref_arena.h"
 #include "core/common.h"
 
 namespace aflipara {
@@ -14,17 +18,40 @@ class AFLIPara;
 template<typename KT, typename VT>
 class TNodePara;
 
+template<typename KT, typename VT>
+class AppendTail;
+
+template<typename KT, typename VT>
+class AFLICursor;
+
+template<typename KT, typename VT>
+class FrozenAFLIPara;
+
+// The order of nodes placed by bulk loads and sealed segments
+enum NodeLayout {
+  kHeapLayout    = 0,   // Allocated from the heap one by one
+  kBreadthFirst  = 1,   // Placed in a region level by level
+  kBlocked       = 2    // Placed in a region in blocks of 'block_levels' levels, blocks in depth-first order
+};
+
 struct HyperParameter {
   // Parameters
   uint32_t max_bucket_size = 6;
   uint32_t aggregate_size = 0;
   uint32_t max_num_bg = 2;
   uint32_t num_nodes = 0;
+  bool append_mode = false;           // Whether out-of-bound keys go to a right-edge tail
+  uint32_t filter_bits_per_key = 0;   // '0' means no subtree filters
+  uint32_t filter_min_keys = 4096;    // The minimum size of filtered subtrees
+  uint32_t rank_stride = 0;           // '0' means no rank counters
+  uint32_t node_layout = kHeapLayout;
+  uint32_t block_levels = 3;          // Levels of a block of the blocked layout
   // Constant parameters
   const uint32_t kMaxBucketSize = 6;
   const uint32_t kMinBucketSize = 1;
   const double kSizeAmplification = 1;
   const double kTailPercent = 0.99;
+  const uint32_t kMinAppendSize = 1024;
 };
 
 enum EntryType {
@@ -34,15 +61,67 @@ enum EntryType {
   kNode   = 3
 };
 
+// Pairs of two machine words are modified by 16-byte CAS without entry locks
+template<typename KT, typename VT>
+struct AtomicPair {
+  static const bool value = sizeof(KT) == 8 && sizeof(VT) == 8 
+                            && std::is_trivially_copyable<KT>::value 
+                            && std::is_trivially_copyable<VT>::value;
+};
+
+// Slots of pairs narrower than pointers refer to buckets and child nodes by 
+// 32-bit arena references, so they are not widened by pointers
 template<typename KT, typename VT>
-union Entry {
+struct NarrowSlot {
+  static const bool value = sizeof(KVPair<KT, VT>) <= sizeof(uint32_t);
+};
+
+// The arenas of the buckets and the nodes of an index of narrow slots
+template<typename KT, typename VT>
+struct NodeArenas {
+  RefArena<Bucket<KT, VT>>    buckets;
+  RefArena<TNodePara<KT, VT>> nodes;
+};
+
+template<typename KT, typename VT, bool kNarrow=NarrowSlot<KT, VT>::value>
+union alignas(AtomicPair<KT, VT>::value ? 16 : alignof(KVPair<KT, VT>)) 
+Entry {
   Bucket<KT, VT>*     bucket;      // The bucket pointer
   TNodePara<KT, VT>*  child;       // The child node pointer
-  std::pair<KT, VT>   kv;          // The key-value pair
+  KVPair<KT, VT>      kv;          // The key-value pair
 
   Entry() {
     memset(this, 0, sizeof(Entry));
   }
+
+  inline Bucket<KT, VT>* get_bucket(NodeArenas<KT, VT>*) const { 
+    return bucket; 
+  }
+  inline TNodePara<KT, VT>* get_child(NodeArenas<KT, VT>*) const { 
+    return child; 
+  }
+  inline void set_bucket(Bucket<KT, VT>* b) { bucket = b; }
+  inline void set_child(TNodePara<KT, VT>* c) { child = c; }
+};
+
+template<typename KT, typename VT>
+union Entry<KT, VT, true> {
+  uint32_t            bucket_ref;  // The arena reference of the bucket
+  uint32_t            child_ref;   // The arena reference of the child node
+  KVPair<KT, VT>      kv;          // The key-value pair
+
+  Entry() {
+    memset(this, 0, sizeof(Entry));
+  }
+
+  inline Bucket<KT, VT>* get_bucket(NodeArenas<KT, VT>* arenas) const { 
+    return arenas->buckets.get(bucket_ref); 
+  }
+  inline TNodePara<KT, VT>* get_child(NodeArenas<KT, VT>* arenas) const { 
+    return arenas->nodes.get(child_ref); 
+  }
+  inline void set_bucket(Bucket<KT, VT>* b) { bucket_ref = b->ref; }
+  inline void set_child(TNodePara<KT, VT>* c) { child_ref = c->ref; }
 };
 
 template<typename KT, typename VT>
@@ -56,25 +135,48 @@ struct AFLIBGParam {
               : node_ptr(a), depth(b), idx(c), hyper_para(d) { }
 };
 
+// A node to build with its keys
+template<typename KT, typename VT>
+struct BuildTask {
+  TNodePara<KT, VT>*          node;
+  const KVPair<KT, VT>*       kvs;
+  uint32_t                    size;
+  uint32_t                    depth;
+};
+
 template<typename KT, typename VT>
 class TNodePara {
-typedef std::pair<KT, VT> KVT;
+typedef KVPair<KT, VT> KVT;
 public:
   uint32_t                    id;        // DELETE
+  uint32_t                    ref;       // The arena reference of narrow slots
+  NodeArenas<KT, VT>*         arenas;    // The arenas of the index, 'nullptr' for wide slots
 
   LinearModel*            model;     // 'nullptr' means this is a btree node
+  typename KeyCodec<KT>::Prefix prefix;  // The common prefix of byte keys skipped by the model
   uint32_t                    capacity;  // The pre-allocated size of array
   uint8_t*                    bitmap0;   // The i-th bit indicates whether the i-th position has a bucket or a child node
   uint8_t*                    bitmap1;   // The i-th bit indicates whether the i-th position is a bucket
   Entry<KT, VT>*              entries;   // The pointer array that stores the pointer of buckets or child nodes
+  SubtreeFilter<KT>*          filter;    // The fences and Bloom filter of the subtree, 'nullptr' means no filter
+  uint32_t                    first_slot; // The first slot of the parent pointing to this node
+  bool                        in_region; // The model and the arrays are placed in a region
+  // The number of keys of every 'rank_stride' slots, organized as a Fenwick 
+  // tree. Keys of a child node are counted at its first slot.
+  uint32_t                    rank_stride;
+  uint32_t                    num_chunks;
+  int64_t*                    counters;
   
   volatile uint8_t*           entry_lock;
   volatile uint8_t            node_lock;
 
   friend class AFLIPara<KT, VT>;
+  friend class AppendTail<KT, VT>;
+  friend class AFLICursor<KT, VT>;
+  friend class FrozenAFLIPara<KT, VT>;
 public:
   // Constructor and deconstructor
-  explicit TNodePara(uint32_t id);
+  explicit TNodePara(uint32_t id, NodeArenas<KT, VT>* arenas=nullptr);
   ~TNodePara();
 
   inline uint32_t get_capacity();
@@ -85,6 +187,22 @@ public:
   bool update(KVT kv);
   AFLIBGParam<KT, VT>* insert(KVT kv, uint32_t depth, 
                               HyperParameter& hyper_para);
+  // Overwrite the value if the key exists, otherwise insert the pair
+  AFLIBGParam<KT, VT>* upsert(KVT kv, uint32_t depth, 
+                              HyperParameter& hyper_para, bool& found, 
+                              VT& old);
+  // Read-modify-write in one traversal, 'fn' takes a copy of the value and 
+  // returns whether to write it back. Data slots of atomic pairs are modified 
+  // by CAS, so 'fn' may be called more than once.
+  template<typename Fn>
+  bool modify(KT key, Fn& fn);
+  // The nearest pair following (or preceding) the key
+  bool neighbor(KT key, bool forward, bool inclusive, KVT& res);
+  // The first (or the last) pair of the subtree
+  bool edge(bool forward, KVT& res);
+  // The estimated number of keys less than (or not larger than) the key
+  double approx_rank(KT key, bool inclusive, double max_error, double& error);
+  int64_t count();
 
 private:
   bool node_locked();
@@ -95,12 +213,56 @@ private:
   void lock_entry(uint32_t idx);
   void unlock_entry(uint32_t idx);
 
+  // The slot predicted by the model
+  inline uint32_t locate(const KT& key);
+
   uint8_t entry_type(uint32_t idx);
   void set_entry_type(uint32_t idx, uint8_t type);
 
+  // Skip empty slots by scanning the bitmaps word-at-a-time
+  inline uint64_t occupied_word(uint32_t byte_idx);
+  int64_t next_occupied(int64_t idx);
+  int64_t prev_occupied(int64_t idx);
+
+  bool nearest_in_slot(uint32_t idx, const KT* key, bool forward, 
+                       bool inclusive, KVT& res, TNodePara<KT, VT>*& child);
+  bool walk(int64_t idx, TNodePara<KT, VT>* child, bool forward, KVT& res);
+
+  AFLIBGParam<KT, VT>* put(KVT kv, uint32_t depth, HyperParameter& hyper_para, 
+                           bool overwrite, bool& found, VT& old);
+  void publish_bucket(uint32_t idx, KVT stored_kv, Bucket<KT, VT>* bucket);
+  // Whether the slot still holds the bucket of the pairs, or nothing
+  bool same_slot(uint32_t idx, Bucket<KT, VT>* bucket, 
+                 const std::vector<KVT>& stored);
+  // Put the pairs sorted by distinct keys, taking the lock of each slot once. 
+  // A slot overflowing its bucket becomes a child node built with all its 
+  // pairs at once. Returns the number of inserted keys.
+  uint32_t put_batch(const KVT* kvs, uint32_t size, uint32_t depth, 
+                     HyperParameter& hyper_para, bool overwrite);
+
+  void build_counters(uint32_t stride);
+  void add_count(uint32_t idx, int64_t delta);
+  int64_t prefix_count(uint32_t chunk);
+  int64_t slot_count(uint32_t idx);
+
+  // Buckets and nodes of narrow slots are placed in the arenas of the index
+  template<typename... Args>
+  Bucket<KT, VT>* create_bucket(Args&&... args);
+  void release_bucket(Bucket<KT, VT>* bucket);
+  // Nodes of wide slots are placed in the region as well, while narrow slots 
+  // refer to nodes by arena references
+  TNodePara<KT, VT>* create_node(uint32_t id, NodeRegion* region);
+  static void release_node(TNodePara<KT, VT>* node);
+
   void destroy_self();
+  // Children are built recursively, or appended to 'children' to be built 
+  // later in the order of the layout
   void build(const KVT* kvs, uint32_t size, uint32_t depth, 
-             HyperParameter& hyper_para);
+             HyperParameter& hyper_para, NodeRegion* region=nullptr, 
+             std::vector<BuildTask<KT, VT>>* children=nullptr);
+  // Build the subtree with nodes placed in the region by the node layout
+  void build_tree(const KVT* kvs, uint32_t size, uint32_t depth, 
+                  HyperParameter& hyper_para, NodeRegion* region);
 };
 
 }
@@ -6,12 +6,20 @@
 namespace aflipara {
 
 template<typename KT, typename VT>
-TNodePara<KT, VT>::TNodePara(uint32_t id) {
+TNodePara<KT, VT>::TNodePara(uint32_t id, NodeArenas<KT, VT>* arenas) {
   this->id = id;
+  this->ref = 0;
+  this->arenas = arenas;
   this->model = nullptr;
   this->capacity = 0;
   this->bitmap0 = this->bitmap1 = nullptr;
   this->entries = nullptr;
+  this->filter = nullptr;
+  this->first_slot = 0;
+  this->in_region = false;
+  this->rank_stride = 0;
+  this->num_chunks = 0;
+  this->counters = nullptr;
   this->entry_lock = nullptr;
   this->node_lock = 0;
 }
@@ -27,13 +35,18 @@ uint32_t TNodePara<KT, VT>::get_capacity() { return capacity; }
 // User API interfaces
 template<typename KT, typename VT>
 bool TNodePara<KT, VT>::find(KT key, VT& value, uint32_t depth) {
+  if (filter != nullptr && !filter->may_contain(key)) {
+    return false;
+  }
   // Find the key-value pair in the model node.
-  uint32_t idx = std::min(std::max(model->predict(key), 0L), 
-                          static_cast<int64_t>(capacity - 1));
+  uint32_t idx = locate(key);
   // COUT_INFO("Depth " << depth << ", finding in the " << idx << "th slot of the " << id << "th node.")
   lock_entry(idx);
   uint8_t type = entry_type(idx);
-  if (type == kData) {
+  if (type == kNone) {
+    unlock_entry(idx);
+    return false;
+  } else if (type == kData) {
     KVT kv = entries[idx].kv;
     unlock_entry(idx);
     // COUT_INFO("Locate in the entry");
@@ -44,14 +57,14 @@ bool TNodePara<KT, VT>::find(KT key, VT& value, uint32_t depth) {
       return false;
     }
   } else if (type == kBucket) {
-    Bucket<KT, VT>* bucket = entries[idx].bucket;
+    Bucket<KT, VT>* bucket = entries[idx].get_bucket(arenas);
     ASSERT_WITH_MSG(bucket != nullptr, "Null bucket");
     bool res = bucket->find(key, value);
     unlock_entry(idx);
     // COUT_INFO("Locate in the bucket");
     return res;
   } else {
-    TNodePara<KT, VT>* child = entries[idx].child;
+    TNodePara<KT, VT>* child = entries[idx].get_child(arenas);
     ASSERT_WITH_MSG(child != nullptr, "Null child node");
     unlock_entry(idx);
     return child->find(key, value, depth + 1);
@@ -60,12 +73,17 @@ bool TNodePara<KT, VT>::find(KT key, VT& value, uint32_t depth) {
 
 template<typename KT, typename VT>
 bool TNodePara<KT, VT>::remove(KT key) {
+  if (filter != nullptr && !filter->may_contain(key)) {
+    return false;
+  }
   // Remove the key-value pair in the model node.
-  uint32_t idx = std::min(std::max(model->predict(key), 0L), 
-                          static_cast<int64_t>(capacity - 1));
+  uint32_t idx = locate(key);
   lock_entry(idx);
   uint8_t type = entry_type(idx);
-  if (type == kData) {
+  if (type == kNone) {
+    unlock_entry(idx);
+    return false;
+  } else if (type == kData) {
     bool res = false;
     KVT kv = entries[idx].kv;
     if (equal(kv.first, key)) {
@@ -75,27 +93,42 @@ bool TNodePara<KT, VT>::remove(KT key) {
       res = false;
     }
     unlock_entry(idx);
+    if (res) {
+      add_count(idx, -1);
+    }
     return res;
   } else if (type == kBucket) {
-    Bucket<KT, VT>* bucket = entries[idx].bucket;
+    Bucket<KT, VT>* bucket = entries[idx].get_bucket(arenas);
     bool res = bucket->remove(key);
     unlock_entry(idx);
+    if (res) {
+      add_count(idx, -1);
+    }
     return res;
   } else {
-    TNodePara<KT, VT>* child = entries[idx].child;
+    TNodePara<KT, VT>* child = entries[idx].get_child(arenas);
     unlock_entry(idx);
-    return child->remove(key);;
+    bool res = child->remove(key);
+    if (res) {
+      add_count(child->first_slot, -1);
+    }
+    return res;
   }
 }
 
 template<typename KT, typename VT>
 bool TNodePara<KT, VT>::update(KVT kv) {
+  if (filter != nullptr && !filter->may_contain(kv.first)) {
+    return false;
+  }
   // Update the key-value pair in the model node.
-  uint32_t idx = std::min(std::max(model->predict(kv.first), 0L), 
-                          static_cast<int64_t>(capacity - 1));
+  uint32_t idx = locate(kv.first);
   lock_entry(idx);
   uint8_t type = entry_type(idx);
-  if (type == kData) {
+  if (type == kNone) {
+    unlock_entry(idx);
+    return false;
+  } else if (type == kData) {
     bool res = false;
     if (equal(entries[idx].kv.first, kv.first)) {
       entries[idx].kv = kv;
@@ -106,12 +139,12 @@ bool TNodePara<KT, VT>::update(KVT kv) {
     unlock_entry(idx);
     return res;
   } else if (type == kBucket) {
-    Bucket<KT, VT>* bucket = entries[idx].bucket;
+    Bucket<KT, VT>* bucket = entries[idx].get_bucket(arenas);
     bool res = bucket->update(kv);
     unlock_entry(idx);
     return res;
   } else {
-    TNodePara<KT, VT>* child = entries[idx].child;
+    TNodePara<KT, VT>* child = entries[idx].get_child(arenas);
     unlock_entry(idx);
     return child->update(kv);
   }
@@ -120,39 +153,154 @@ bool TNodePara<KT, VT>::update(KVT kv) {
 template<typename KT, typename VT>
 AFLIBGParam<KT, VT>* TNodePara<KT, VT>::insert(KVT kv, uint32_t depth, 
                                                HyperParameter& hyper_para) {
-  uint32_t idx = std::min(std::max(model->predict(kv.first), 0L), 
-                          static_cast<int64_t>(capacity - 1));
-  lock_entry(idx);
-  uint8_t type = entry_type(idx);
-  if (type == kNone) {
-    set_entry_type(idx, kData);
-    entries[idx].kv = kv;
-    unlock_entry(idx);
-    return nullptr;
-  } else if (type == kData || type == kBucket) {
-    Bucket<KT, VT>* bucket = nullptr;
-    if (type == kData) {
-      KVT stored_kv = entries[idx].kv;
-      bucket = new Bucket<KT, VT>(&stored_kv, 1, hyper_para.max_bucket_size, 
-                                  id, idx);
-      entries[idx].bucket = bucket;
-      set_entry_type(idx, kBucket);
+  bool found = false;
+  VT old;
+  return put(kv, depth, hyper_para, false, found, old);
+}
+
+template<typename KT, typename VT>
+AFLIBGParam<KT, VT>* TNodePara<KT, VT>::upsert(KVT kv, uint32_t depth, 
+                                               HyperParameter& hyper_para, 
+                                               bool& found, VT& old) {
+  return put(kv, depth, hyper_para, true, found, old);
+}
+
+template<typename KT, typename VT>
+template<typename Fn>
+bool TNodePara<KT, VT>::modify(KT key, Fn& fn) {
+  if (filter != nullptr && !filter->may_contain(key)) {
+    return false;
+  }
+  uint32_t idx = locate(key);
+  while (true) {
+    if constexpr (AtomicPair<KT, VT>::value) {
+      // The pair is replaced by the bucket pointer with CAS once the slot 
+      // becomes a bucket, so a successful CAS never loses the new value
+      if (entry_type(idx) == kData) {
+        fence();
+        KVT expected = entries[idx].kv;
+        if (equal(expected.first, key)) {
+          KVT desired = expected;
+          if (!fn(desired.second)) {
+            return true;
+          }
+          if (cmpxchg16b(&entries[idx], (uint64_t*)&expected, 
+                         (const uint64_t*)&desired)) {
+            return true;
+          }
+          continue;
+        }
+        // The slot may be turning into a bucket, check it under the lock
+      }
     }
-    bucket = entries[idx].bucket;
-    bool need_rebuild = bucket->insert(kv, hyper_para.max_bucket_size);
-    if (need_rebuild) {
-      return new AFLIBGParam(this, depth, idx, hyper_para);
+    lock_entry(idx);
+    uint8_t type = entry_type(idx);
+    if (type == kNone) {
+      unlock_entry(idx);
+      return false;
+    } else if (type == kData) {
+      bool res = equal(entries[idx].kv.first, key);
+      if constexpr (AtomicPair<KT, VT>::value) {
+        unlock_entry(idx);
+        if (res) {
+          continue;
+        }
+        return false;
+      }
+      if (res) {
+        VT value = entries[idx].kv.second;
+        if (fn(value)) {
+          entries[idx].kv.second = value;
+        }
+      }
+      unlock_entry(idx);
+      return res;
+    } else if (type == kBucket) {
+      bool res = entries[idx].get_bucket(arenas)->modify(key, fn);
+      unlock_entry(idx);
+      return res;
     } else {
+      TNodePara<KT, VT>* child = entries[idx].get_child(arenas);
       unlock_entry(idx);
-      return nullptr;
+      return child->modify(key, fn);
     }
-  } else {
-    TNodePara<KT, VT>* child = entries[idx].child;
-    unlock_entry(idx);
-    return child->insert(kv, depth + 1, hyper_para);
   }
 }
 
+template<typename KT, typename VT>
+bool TNodePara<KT, VT>::neighbor(KT key, bool forward, bool inclusive, 
+                                 KVT& res) {
+  // Search the predicted slot first, since the models are monotone, the 
+  // answer is in the following (or preceding) slots if it is not there
+  uint32_t idx = locate(key);
+  TNodePara<KT, VT>* child = nullptr;
+  if (nearest_in_slot(idx, &key, forward, inclusive, res, child)) {
+    return true;
+  } else if (child != nullptr 
+             && child->neighbor(key, forward, inclusive, res)) {
+    return true;
+  }
+  return walk(idx, child, forward, res);
+}
+
+template<typename KT, typename VT>
+bool TNodePara<KT, VT>::edge(bool forward, KVT& res) {
+  return walk(forward ? -1 : static_cast<int64_t>(capacity), nullptr, 
+              forward, res);
+}
+
+template<typename KT, typename VT>
+double TNodePara<KT, VT>::approx_rank(KT key, bool inclusive, double max_error, 
+                                      double& error) {
+  // Keys before the chunk of the predicted slot are counted by the counters. 
+  // Within the chunk, the rank is interpolated if the number of keys of the 
+  // chunk is within the error bound, otherwise the slots before the predicted 
+  // one are counted and the predicted slot is searched.
+  uint32_t idx = locate(key);
+  TNodePara<KT, VT>* child = nullptr;
+  int64_t slot_rank = 0;
+  lock_entry(idx);
+  uint8_t type = entry_type(idx);
+  if (type == kData) {
+    const KT& k = entries[idx].kv.first;
+    slot_rank = inclusive ? !(key < k) : k < key;
+  } else if (type == kBucket) {
+    Bucket<KT, VT>* bucket = entries[idx].get_bucket(arenas);
+    for (uint32_t i = 0; i < bucket->size; ++ i) {
+      const KT& k = bucket->data[i].first;
+      slot_rank += inclusive ? !(key < k) : k < key;
+    }
+  } else if (type == kNode) {
+    child = entries[idx].get_child(arenas);
+  }
+  unlock_entry(idx);
+  uint32_t start = child != nullptr ? child->first_slot : idx;
+  uint32_t chunk = start / rank_stride;
+  int64_t base = prefix_count(chunk);
+  int64_t chunk_size = prefix_count(chunk + 1) - base;
+  if (chunk_size <= max_error) {
+    uint32_t chunk_len = std::min(rank_stride, capacity - chunk * rank_stride);
+    double f = (idx - chunk * rank_stride + 0.5) / chunk_len;
+    f = std::min(f, 1.);
+    error = chunk_size * std::max(f, 1 - f);
+    return base + chunk_size * f;
+  }
+  for (int64_t i = next_occupied(chunk * rank_stride); i < start; 
+       i = next_occupied(i + 1)) {
+    base += slot_count(i);
+  }
+  if (child != nullptr) {
+    return base + child->approx_rank(key, inclusive, max_error, error);
+  }
+  error = 0;
+  return base + slot_rank;
+}
+
+template<typename KT, typename VT>
+int64_t TNodePara<KT, VT>::count() {
+  return counters == nullptr ? 0 : prefix_count(num_chunks);
+}
+
 template<typename KT, typename VT>
 bool TNodePara<KT, VT>::node_locked() {
   return this->node_lock;
@@ -188,6 +336,12 @@ void TNodePara<KT, VT>::unlock_entry(uint32_t idx) {
   this->entry_lock[idx] = 0;
 }
 
+template<typename KT, typename VT>
+uint32_t TNodePara<KT, VT>::locate(const KT& key) {
+  int64_t idx = model->predict(KeyCodec<KT>::encode(key, prefix));
+  return std::min(std::max(idx, 0L), static_cast<int64_t>(capacity - 1));
+}
+
 template<typename KT, typename VT>
 uint8_t TNodePara<KT, VT>::entry_type(uint32_t idx) {
   uint32_t bit_idx = BIT_IDX(idx);
@@ -209,60 +363,578 @@ void TNodePara<KT, VT>::set_entry_type(uint32_t idx, uint8_t type) {
   }
 }
 
+template<typename KT, typename VT>
+uint64_t TNodePara<KT, VT>::occupied_word(uint32_t byte_idx) {
+  // The i-th bit is set if the (byte_idx * 8 + i)-th slot is not empty
+  uint32_t bit_len = BIT_LEN(capacity);
+  uint32_t n = std::min(bit_len - byte_idx, 8U);
+  uint64_t word0 = 0, word1 = 0;
+  memcpy(&word0, bitmap0 + byte_idx, n);
+  memcpy(&word1, bitmap1 + byte_idx, n);
+  return word0 | word1;
+}
+
+template<typename KT, typename VT>
+int64_t TNodePara<KT, VT>::next_occupied(int64_t idx) {
+  // Return the first non-empty slot from idx, or 'capacity' if not found
+  if (idx >= capacity) {
+    return capacity;
+  }
+  uint32_t bit_len = BIT_LEN(capacity);
+  uint32_t byte_idx = BIT_IDX(idx);
+  uint64_t word = occupied_word(byte_idx) & (~0ULL << BIT_POS(idx));
+  while (word == 0) {
+    byte_idx += 8;
+    if (byte_idx >= bit_len) {
+      return capacity;
+    }
+    word = occupied_word(byte_idx);
+  }
+  return std::min(static_cast<int64_t>(byte_idx * BIT_SIZE 
+                                       + __builtin_ctzll(word)), 
+                  static_cast<int64_t>(capacity));
+}
+
+template<typename KT, typename VT>
+int64_t TNodePara<KT, VT>::prev_occupied(int64_t idx) {
+  // Return the last non-empty slot until idx, or '-1' if not found
+  if (idx < 0) {
+    return -1;
+  }
+  idx = std::min(idx, static_cast<int64_t>(capacity) - 1);
+  int64_t first_byte = std::max(static_cast<int64_t>(BIT_IDX(idx)) - 7, 0L);
+  uint32_t offset = idx - first_byte * BIT_SIZE;
+  uint64_t word = occupied_word(first_byte);
+  if (offset < 63) {
+    word &= (1ULL << (offset + 1)) - 1;
+  }
+  while (word == 0) {
+    if (first_byte == 0) {
+      return -1;
+    }
+    int64_t next_byte = std::max(first_byte - 8, 0L);
+    uint32_t num_bits = (first_byte - next_byte) * BIT_SIZE;
+    word = occupied_word(next_byte);
+    if (num_bits < 64) {
+      word &= (1ULL << num_bits) - 1;
+    }
+    first_byte = next_byte;
+  }
+  return first_byte * BIT_SIZE + 63 - __builtin_clzll(word);
+}
+
+template<typename KT, typename VT>
+bool TNodePara<KT, VT>::nearest_in_slot(uint32_t idx, const KT* key, 
+                                        bool forward, bool inclusive, 
+                                        KVT& res, TNodePara<KT, VT>*& child) {
+  // Find the nearest pair in the slot following (or preceding) the key, 
+  // where 'nullptr' means any key. The child node is returned if the slot 
+  // points to a child node.
+  auto qualified = [&](const KT& k) {
+    if (key == nullptr) {
+      return true;
+    } else if (forward) {
+      return inclusive ? !(k < *key) : *key < k;
+    } else {
+      return inclusive ? !(*key < k) : k < *key;
+    }
+  };
+  bool found = false;
+  child = nullptr;
+  lock_entry(idx);
+  uint8_t type = entry_type(idx);
+  if (type == kData) {
+    if (qualified(entries[idx].kv.first)) {
+      res = entries[idx].kv;
+      found = true;
+    }
+  } else if (type == kBucket) {
+    Bucket<KT, VT>* bucket = entries[idx].get_bucket(arenas);
+    for (uint32_t i = 0; i < bucket->size; ++ i) {
+      const KVT& kv = bucket->data[i];
+      if (qualified(kv.first) && (!found || (forward ? kv.first < res.first 
+                                             : res.first < kv.first))) {
+        res = kv;
+        found = true;
+      }
+    }
+  } else if (type == kNode) {
+    child = entries[idx].get_child(arenas);
+  }
+  unlock_entry(idx);
+  return found;
+}
+
+template<typename KT, typename VT>
+bool TNodePara<KT, VT>::walk(int64_t idx, TNodePara<KT, VT>* child, 
+                             bool forward, KVT& res) {
+  // Walk to the following (or preceding) slots of idx, and return the first 
+  // (or the last) pair of them
+  while (true) {
+    // Skip the duplicated pointers of the visited child node
+    while (child != nullptr && (forward ? idx + 1 < capacity : idx > 0)
+           && entry_type(idx + (forward ? 1 : -1)) == kNode 
+           && entries[idx + (forward ? 1 : -1)].get_child(arenas) == child) {
+      idx += forward ? 1 : -1;
+    }
+    idx = forward ? next_occupied(idx + 1) : prev_occupied(idx - 1);
+    if (idx < 0 || idx >= capacity) {
+      return false;
+    }
+    if (nearest_in_slot(idx, nullptr, forward, true, res, child)) {
+      return true;
+    } else if (child != nullptr && child->edge(forward, res)) {
+      return true;
+    }
+  }
+}
+
+template<typename KT, typename VT>
+void TNodePara<KT, VT>::build_counters(uint32_t stride) {
+  // Count the keys of every chunk, then build the Fenwick tree in place
+  rank_stride = stride;
+  num_chunks = (capacity + stride - 1) / stride;
+  counters = new int64_t[num_chunks + 1];
+  memset(counters, 0, sizeof(int64_t) * (num_chunks + 1));
+  for (int64_t i = next_occupied(0); i < capacity; i = next_occupied(i + 1)) {
+    counters[i / stride + 1] += slot_count(i);
+  }
+  for (uint32_t i = 1; i <= num_chunks; ++ i) {
+    uint32_t j = i + (i & (-i));
+    if (j <= num_chunks) {
+      counters[j] += counters[i];
+    }
+  }
+}
+
+template<typename KT, typename VT>
+void TNodePara<KT, VT>::add_count(uint32_t idx, int64_t delta) {
+  if (counters == nullptr) {
+    return;
+  }
+  for (uint32_t i = idx / rank_stride + 1; i <= num_chunks; i += i & (-i)) {
+    __atomic_fetch_add(&counters[i], delta, __ATOMIC_RELAXED);
+  }
+}
+
+template<typename KT, typename VT>
+int64_t TNodePara<KT, VT>::prefix_count(uint32_t chunk) {
+  // The number of keys in the first 'chunk' chunks
+  int64_t res = 0;
+  for (uint32_t i = chunk; i > 0; i -= i & (-i)) {
+    res += __atomic_load_n(&counters[i], __ATOMIC_RELAXED);
+  }
+  return res;
+}
+
+template<typename KT, typename VT>
+int64_t TNodePara<KT, VT>::slot_count(uint32_t idx) {
+  // The number of keys counted at the slot
+  int64_t res = 0;
+  lock_entry(idx);
+  uint8_t type = entry_type(idx);
+  if (type == kData) {
+    res = 1;
+  } else if (type == kBucket) {
+    res = entries[idx].get_bucket(arenas)->size;
+  } else if (type == kNode && entries[idx].get_child(arenas)->first_slot == idx) {
+    res = entries[idx].get_child(arenas)->count();
+  }
+  unlock_entry(idx);
+  return res;
+}
+
+template<typename KT, typename VT>
+AFLIBGParam<KT, VT>* TNodePara<KT, VT>::put(KVT kv, uint32_t depth, 
+                                            HyperParameter& hyper_para, 
+                                            bool overwrite, bool& found, 
+                                            VT& old) {
+  if (filter != nullptr) {
+    filter->add(kv.first);
+  }
+  uint32_t idx = locate(kv.first);
+  lock_entry(idx);
+  uint8_t type = entry_type(idx);
+  if (type == kNode) {
+    TNodePara<KT, VT>* child = entries[idx].get_child(arenas);
+    unlock_entry(idx);
+    AFLIBGParam<KT, VT>* args = child->put(kv, depth + 1, hyper_para, 
+                                           overwrite, found, old);
+    if (!found) {
+      add_count(child->first_slot, 1);
+    }
+    return args;
+  }
+  found = false;
+  if (overwrite) {
+    if (type == kData && equal(entries[idx].kv.first, kv.first)) {
+      found = true;
+      if constexpr (AtomicPair<KT, VT>::value) {
+        __atomic_exchange(&entries[idx].kv.second, &kv.second, &old, 
+                          __ATOMIC_SEQ_CST);
+      } else {
+        old = entries[idx].kv.second;
+        entries[idx].kv.second = kv.second;
+      }
+    } else if (type == kBucket) {
+      found = entries[idx].get_bucket(arenas)->exchange(kv, old);
+    }
+    if (found) {
+      unlock_entry(idx);
+      return nullptr;
+    }
+  }
+  add_count(idx, 1);
+  if (type == kNone) {
+    // The pair is written before the type, since data slots are read by CAS 
+    // without locks
+    entries[idx].kv = kv;
+    fence();
+    set_entry_type(idx, kData);
+    unlock_entry(idx);
+    return nullptr;
+  } else {
+    Bucket<KT, VT>* bucket = nullptr;
+    if (type == kData) {
+      KVT stored_kv = entries[idx].kv;
+      bucket = create_bucket(&stored_kv, 1, hyper_para.max_bucket_size, 
+                             id, idx);
+      publish_bucket(idx, stored_kv, bucket);
+      set_entry_type(idx, kBucket);
+    }
+    bucket = entries[idx].get_bucket(arenas);
+    bool need_rebuild = bucket->insert(kv, hyper_para.max_bucket_size);
+    if (need_rebuild) {
+      return new AFLIBGParam(this, depth, idx, hyper_para);
+    } else {
+      unlock_entry(idx);
+      return nullptr;
+    }
+  }
+}
+
+template<typename KT, typename VT>
+void TNodePara<KT, VT>::publish_bucket(uint32_t idx, KVT stored_kv, 
+                                       Bucket<KT, VT>* bucket) {
+  if constexpr (AtomicPair<KT, VT>::value) {
+    // The value may be modified by CAS after it is copied, so the pointer 
+    // only replaces the copied pair
+    Entry<KT, VT> desired;
+    desired.set_bucket(bucket);
+    while (!cmpxchg16b(&entries[idx], (uint64_t*)&stored_kv, 
+                       (const uint64_t*)&desired)) {
+      bucket->data[0] = stored_kv;
+    }
+  } else {
+    entries[idx].set_bucket(bucket);
+  }
+}
+
+template<typename KT, typename VT>
+bool TNodePara<KT, VT>::same_slot(uint32_t idx, Bucket<KT, VT>* bucket, 
+                                  const std::vector<KVT>& stored) {
+  uint8_t type = entry_type(idx);
+  if (bucket == nullptr) {
+    return type == kNone;
+  }
+  if (type != kBucket || entries[idx].get_bucket(arenas) != bucket 
+      || bucket->get_size() != stored.size()) {
+    return false;
+  }
+  for (uint32_t i = 0; i < stored.size(); ++ i) {
+    if (!equal(bucket->data[i].first, stored[i].first) 
+        || !(bucket->data[i].second == stored[i].second)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template<typename KT, typename VT>
+uint32_t TNodePara<KT, VT>::put_batch(const KVT* kvs, uint32_t size, 
+                                      uint32_t depth, 
+                                      HyperParameter& hyper_para, 
+                                      bool overwrite) {
+  if (filter != nullptr) {
+    for (uint32_t i = 0; i < size; ++ i) {
+      filter->add(kvs[i].first);
+    }
+  }
+  uint32_t num_inserted = 0;
+  std::vector<KVT> fresh;
+  std::vector<KVT> stored;
+  bool hold_lock = false;   // Whether the child of the slot is built locked
+  for (uint32_t i = 0, j = 0; i < size; i = j) {
+    // Sorted keys of a slot are adjacent
+    uint32_t idx = locate(kvs[i].first);
+    for (j = i + 1; j < size && locate(kvs[j].first) == idx; ++ j) { }
+    lock_entry(idx);
+    uint8_t type = entry_type(idx);
+    if (type == kNode) {
+      TNodePara<KT, VT>* child = entries[idx].get_child(arenas);
+      unlock_entry(idx);
+      uint32_t num = child->put_batch(kvs + i, j - i, depth + 1, hyper_para, 
+                                      overwrite);
+      add_count(child->first_slot, num);
+      num_inserted += num;
+      hold_lock = false;
+      continue;
+    }
+    fresh.clear();
+    for (uint32_t k = i; k < j; ++ k) {
+      KVT kv = kvs[k];
+      bool found = false;
+      if (overwrite) {
+        VT old;
+        if (type == kData && equal(entries[idx].kv.first, kv.first)) {
+          found = true;
+          if constexpr (AtomicPair<KT, VT>::value) {
+            __atomic_exchange(&entries[idx].kv.second, &kv.second, &old, 
+                              __ATOMIC_SEQ_CST);
+          } else {
+            entries[idx].kv.second = kv.second;
+          }
+        } else if (type == kBucket) {
+          found = entries[idx].get_bucket(arenas)->exchange(kv, old);
+        }
+      }
+      if (!found) {
+        fresh.push_back(kv);
+      }
+    }
+    uint32_t num = fresh.size();
+    if (num == 0) {
+      unlock_entry(idx);
+      hold_lock = false;
+      continue;
+    }
+    if (type == kNone && num == 1) {
+      entries[idx].kv = fresh[0];
+      fence();
+      set_entry_type(idx, kData);
+      add_count(idx, num);
+      num_inserted += num;
+      unlock_entry(idx);
+      hold_lock = false;
+      continue;
+    }
+    uint32_t num_stored = type == kData ? 1 : type == kBucket 
+                          ? entries[idx].get_bucket(arenas)->get_size() : 0;
+    if (num_stored + num < hyper_para.max_bucket_size) {
+      Bucket<KT, VT>* bucket = nullptr;
+      if (type == kNone) {
+        bucket = create_bucket(fresh.data(), num, hyper_para.max_bucket_size, 
+                               id, idx);
+        entries[idx].set_bucket(bucket);
+        fence();
+        set_entry_type(idx, kBucket);
+      } else {
+        if (type == kData) {
+          KVT stored_kv = entries[idx].kv;
+          bucket = create_bucket(&stored_kv, 1, hyper_para.max_bucket_size, 
+                                 id, idx);
+          publish_bucket(idx, stored_kv, bucket);
+          set_entry_type(idx, kBucket);
+        }
+        bucket = entries[idx].get_bucket(arenas);
+        for (const KVT& kv : fresh) {
+          bucket->insert(kv, hyper_para.max_bucket_size);
+        }
+      }
+      add_count(idx, num);
+      num_inserted += num;
+      unlock_entry(idx);
+      hold_lock = false;
+      continue;
+    }
+    // The slot overflows, so it is rebuilt once with all its pairs. A data 
+    // slot becomes a bucket first, so its value is no longer modified by CAS.
+    Bucket<KT, VT>* bucket = nullptr;
+    if (type == kData) {
+      KVT stored_kv = entries[idx].kv;
+      bucket = create_bucket(&stored_kv, 1, hyper_para.max_bucket_size, 
+                             id, idx);
+      publish_bucket(idx, stored_kv, bucket);
+      set_entry_type(idx, kBucket);
+    } else if (type == kBucket) {
+      bucket = entries[idx].get_bucket(arenas);
+    }
+    stored.clear();
+    if (bucket != nullptr) {
+      stored.assign(bucket->data, bucket->data + bucket->get_size());
+    }
+    // Readers of the slot take its lock as well, so the child is built 
+    // unlocked, and replaces the slot only if the slot is unchanged meanwhile. 
+    // Otherwise the slot is put again with the lock held.
+    if (!hold_lock) {
+      unlock_entry(idx);
+    }
+    fresh.insert(fresh.end(), stored.begin(), stored.end());
+    std::sort(fresh.begin(), fresh.end(), 
+      [](auto const& a, auto const& b) {
+        return a.first < b.first;
+    });
+    TNodePara<KT, VT>* child = create_node(hyper_para.num_nodes ++, 
+                                           nullptr);
+    child->first_slot = idx;
+    child->build(fresh.data(), fresh.size(), depth + 1, hyper_para);
+    if (!hold_lock) {
+      lock_entry(idx);
+      if (!same_slot(idx, bucket, stored)) {
+        unlock_entry(idx);
+        release_node(child);
+        hold_lock = true;
+        j = i;
+        continue;
+      }
+    }
+    if (bucket != nullptr) {
+      release_bucket(bucket);
+    }
+    set_entry_type(idx, kNode);
+    entries[idx].set_child(child);
+    add_count(idx, num);
+    num_inserted += num;
+    unlock_entry(idx);
+    hold_lock = false;
+  }
+  return num_inserted;
+}
+
+template<typename KT, typename VT>
+template<typename... Args>
+Bucket<KT, VT>* TNodePara<KT, VT>::create_bucket(Args&&... args) {
+  if constexpr (NarrowSlot<KT, VT>::value) {
+    return arenas->buckets.create(std::forward<Args>(args)...);
+  } else {
+    return new Bucket<KT, VT>(std::forward<Args>(args)...);
+  }
+}
+
+template<typename KT, typename VT>
+void TNodePara<KT, VT>::release_bucket(Bucket<KT, VT>* bucket) {
+  if constexpr (NarrowSlot<KT, VT>::value) {
+    arenas->buckets.destroy(bucket);
+  } else {
+    delete bucket;
+  }
+}
+
+template<typename KT, typename VT>
+TNodePara<KT, VT>* TNodePara<KT, VT>::create_node(uint32_t id, 
+                                                  NodeRegion* region) {
+  if constexpr (NarrowSlot<KT, VT>::value) {
+    return arenas->nodes.create(id, arenas);
+  } else {
+    if (region != nullptr) {
+      TNodePara<KT, VT>* node = region->create_head<TNodePara<KT, VT>>(id);
+      node->in_region = true;
+      return node;
+    }
+    return new TNodePara<KT, VT>(id);
+  }
+}
+
+template<typename KT, typename VT>
+void TNodePara<KT, VT>::release_node(TNodePara<KT, VT>* node) {
+  if constexpr (NarrowSlot<KT, VT>::value) {
+    node->arenas->nodes.destroy(node);
+  } else {
+    if (node->in_region) {
+      node->~TNodePara();
+    } else {
+      delete node;
+    }
+  }
+}
+
 template<typename KT, typename VT>
 void TNodePara<KT, VT>::destroy_self() {    
-  delete model;
+  if (!in_region) {
+    delete model;
+  }
   model = nullptr;
   for (uint32_t i = 0; i < capacity; ++ i) {
     uint8_t type_i = entry_type(i);
     if (type_i == kBucket) {
-      Bucket<KT, VT>* bucket = entries[i].bucket;
-      delete bucket;
+      release_bucket(entries[i].get_bucket(arenas));
     } else if (type_i == kNode) {
-      TNodePara<KT, VT>* child = entries[i].child;
+      TNodePara<KT, VT>* child = entries[i].get_child(arenas);
       uint32_t j = i;
       for (; j < capacity; ++ j) {
         uint8_t type_j = entry_type(j);
-        TNodePara<KT, VT>* sibling = entries[j].child;
+        TNodePara<KT, VT>* sibling = entries[j].get_child(arenas);
         if (type_j != kNode || 
             child != sibling) {
           break;
         }
       }
-      delete child;
+      release_node(child);
       i = j - 1;
     }
   }
-  delete[] bitmap0;
+  if (!in_region) {
+    delete[] bitmap0;
+    delete[] bitmap1;
+    delete[] entries;
+    delete[] entry_lock;
+  }
   bitmap0 = nullptr;
-  delete[] bitmap1;
   bitmap1 = nullptr;
-  delete[] entries;
   entries = nullptr;
-  delete[] entry_lock;
   entry_lock = nullptr;
+  delete filter;
+  filter = nullptr;
+  delete[] counters;
+  counters = nullptr;
+  num_chunks = 0;
   capacity = 0;
   node_lock = 0;
 }
 
 template<typename KT, typename VT>
 void TNodePara<KT, VT>::build(const KVT* kvs, uint32_t size, uint32_t depth, 
-                              HyperParameter& hyper_para) {
+                              HyperParameter& hyper_para, NodeRegion* region, 
+                              std::vector<BuildTask<KT, VT>>* children) {
+  prefix = KeyCodec<KT>::make_prefix(kvs[0].first, kvs[size - 1].first);
+  in_region = region != nullptr;
+  if (in_region) {
+    model = region->create_head<LinearModel>();
+  }
   ConflictsInfo* ci = build_linear_model(kvs, size, model, 
-                                         hyper_para.kSizeAmplification);
+                                         hyper_para.kSizeAmplification, 
+                                         prefix);
   // Allocate memory for the node
   uint32_t bit_len = BIT_LEN(ci->max_size);
   capacity = ci->max_size;
-  bitmap0 = new BIT_TYPE[bit_len];
-  bitmap1 = new BIT_TYPE[bit_len];
-  entries = new Entry<KT, VT>[ci->max_size];
-  entry_lock = new uint8_t[ci->max_size]; // TODO: optimize space efficiency
+  if (in_region) {
+    // Entries, bitmaps and locks of the node are adjacent
+    uint64_t entry_bytes = sizeof(Entry<KT, VT>) * ci->max_size;
+    uint64_t bitmap_bytes = sizeof(BIT_TYPE) * bit_len;
+    char* arrays = (char*)region->alloc_array(entry_bytes + bitmap_bytes * 2 
+                                              + ci->max_size);
+    memset(arrays, 0, entry_bytes);
+    entries = reinterpret_cast<Entry<KT, VT>*>(arrays);
+    bitmap0 = reinterpret_cast<BIT_TYPE*>(arrays + entry_bytes);
+    bitmap1 = reinterpret_cast<BIT_TYPE*>(arrays + entry_bytes + bitmap_bytes);
+    entry_lock = reinterpret_cast<uint8_t*>(arrays + entry_bytes 
+                                            + bitmap_bytes * 2);
+  } else {
+    bitmap0 = new BIT_TYPE[bit_len];
+    bitmap1 = new BIT_TYPE[bit_len];
+    entries = new Entry<KT, VT>[ci->max_size];
+    entry_lock = new uint8_t[ci->max_size]; // TODO: optimize space efficiency
+  }
   memset(bitmap0, 0, sizeof(BIT_TYPE) * bit_len);
   memset(bitmap1, 0, sizeof(BIT_TYPE) * bit_len);
   for (uint32_t i = 0; i < ci->max_size; ++ i) {
     entry_lock[i] = 0;
   }
   node_lock = 0;
+  if (hyper_para.filter_bits_per_key > 0 
+      && size >= hyper_para.filter_min_keys) {
+    filter = new SubtreeFilter<KT>(kvs, size, hyper_para.filter_bits_per_key);
+  }
   // Recursively build the node
   for (uint32_t i = 0, j = 0; i < ci->num_conflicts; ++ i) {
     uint32_t p = ci->positions[i];
@@ -275,8 +947,8 @@ void TNodePara<KT, VT>::build(const KVT* kvs, uint32_t size, uint32_t depth,
       j = j + c;
     } else if (c <= hyper_para.max_bucket_size) {
       set_entry_type(p, kBucket);
-      entries[p].bucket = new Bucket<KT, VT>(kvs + j, c, 
-                                             hyper_para.max_bucket_size, id, p);
+      entries[p].set_bucket(create_bucket(kvs + j, c, 
+                            hyper_para.max_bucket_size, id, p));
       j = j + c;
     } else {
       uint32_t k = i + 1;
@@ -296,18 +968,31 @@ void TNodePara<KT, VT>::build(const KVT* kvs, uint32_t size, uint32_t depth,
           uint32_t p_k = ci->positions[u];
           uint32_t c_k = ci->conflicts[u];
           set_entry_type(p_k, kNode);
-          entries[p_k].child = new TNodePara<KT, VT>(hyper_para.num_nodes ++);
-          entries[p_k].child->build(kvs + j, c_k, depth + 1, hyper_para);
+          TNodePara<KT, VT>* child = create_node(hyper_para.num_nodes ++, 
+                                                 region);
+          entries[p_k].set_child(child);
+          child->first_slot = p_k;
+          if (children != nullptr) {
+            children->push_back({child, kvs + j, c_k, depth + 1});
+          } else {
+            child->build(kvs + j, c_k, depth + 1, hyper_para, region);
+          }
           j = j + c_k;
         }
       } else {
         set_entry_type(p, kNode);
-        entries[p].child = new TNodePara<KT, VT>(hyper_para.num_nodes ++);
-        entries[p].child->build(kvs + j, seg_size, depth + 1, hyper_para);
+        TNodePara<KT, VT>* child = create_node(hyper_para.num_nodes ++, 
+                                               region);
+        child->first_slot = p;
+        if (children != nullptr) {
+          children->push_back({child, kvs + j, seg_size, depth + 1});
+        } else {
+          child->build(kvs + j, seg_size, depth + 1, hyper_para, region);
+        }
         for (uint32_t u = i; u < k; ++ u) {
           uint32_t p_k = ci->positions[u];
           set_entry_type(p_k, kNode);
-          entries[p_k].child = entries[p].child;
+          entries[p_k].set_child(child);
         }
         j = j + seg_size;
       }
@@ -315,6 +1000,41 @@ void TNodePara<KT, VT>::build(const KVT* kvs, uint32_t size, uint32_t depth,
     }
   }
   delete ci;
+  if (hyper_para.rank_stride > 0) {
+    build_counters(hyper_para.rank_stride);
+  }
+}
+
+template<typename KT, typename VT>
+void TNodePara<KT, VT>::build_tree(const KVT* kvs, uint32_t size, 
+                                   uint32_t depth, HyperParameter& hyper_para, 
+                                   NodeRegion* region) {
+  if (region == nullptr || hyper_para.node_layout == kHeapLayout) {
+    build(kvs, size, depth, hyper_para);
+    return;
+  }
+  // Nodes of a block are built level by level, and the children below the 
+  // block start new blocks, which are built in depth-first order. The 
+  // breadth-first layout is one block of all levels.
+  uint32_t levels = hyper_para.node_layout == kBlocked 
+                    ? std::max(hyper_para.block_levels, 1u) : UINT32_MAX;
+  std::vector<BuildTask<KT, VT>> blocks(1, {this, kvs, size, depth});
+  std::vector<BuildTask<KT, VT>> level, next, below;
+  while (!blocks.empty()) {
+    level.assign(1, blocks.back());
+    blocks.pop_back();
+    for (uint32_t l = 1; !level.empty(); ++ l) {
+      std::vector<BuildTask<KT, VT>>& out = l < levels ? next : below;
+      for (BuildTask<KT, VT>& task : level) {
+        task.node->build(task.kvs, task.size, task.depth, hyper_para, region, 
+                         &out);
+      }
+      level.swap(next);
+      next.clear();
+    }
+    blocks.insert(blocks.end(), below.rbegin(), below.rend());
+    below.clear();
+  }
 }
 
 }
@@ -1,15 +1,21 @@
 #ifndef AFLI_PARA_H
 #define AFLI_PARA_H
 
-#include "core/afli_node_para_impl.h"
+#include "core/afli_cursor_impl.h"
+#include "core/frozen_afli_para_impl.h"
+#include "core/version_log_impl.h"
 
 namespace aflipara {
 
 template<typename KT, typename VT>
 class AFLIPara {
-typedef std::pair<KT, VT> KVT;
+typedef KVPair<KT, VT> KVT;
 private:
   TNodePara<KT, VT>* volatile root;
+  AppendTail<KT, VT>* tail;
+  NodeRegion* region;     // The nodes placed by the node layout
+  NodeArenas<KT, VT>* arenas;  // The buckets and the nodes of narrow slots
+  VersionLog<KT, VT>* versions;
   boost::asio::thread_pool* pool;
   bool self_pool = false;
 public:
@@ -23,7 +29,42 @@ public:
   bool remove(KT key);
   bool update(KVT kv);
   void insert(KVT kv);
+  // Read-modify-write operations in one traversal. 'fn' takes a copy of the 
+  // value and returns whether to write it back, it may be called more than 
+  // once under contention.
+  template<typename Fn>
+  bool modify(KT key, Fn fn);
+  bool upsert(KVT kv);    // Returns whether the pair is inserted
+  // Writes of a batch in key order, each slot is locked once for its keys. 
+  // Later pairs of equal keys win. Return the number of inserted keys.
+  uint32_t insert_batch(const KVT* kvs, uint32_t size);
+  uint32_t upsert_batch(const KVT* kvs, uint32_t size);
+  bool fetch_add(KT key, VT delta, VT& old);
+  bool compare_exchange(KT key, VT& expected, VT desired);
   uint32_t scan(KT begin, KT end, std::vector<KVT>& res);
+  // Ordered point queries
+  bool lower_bound(KT key, KVT& res);   // The smallest key not less than key
+  bool predecessor(KT key, KVT& res);   // The largest key not larger than key
+  bool successor(KT key, KVT& res);     // The smallest key larger than key
+  bool neighbor(KT key, bool forward, bool inclusive, KVT& res);
+  // Estimations from the rank counters, the absolute error is bounded by 
+  // 'max_error' without concurrent writes
+  double approx_rank(KT key, double max_error=0);   // The number of keys less than key
+  double estimate_count(KT begin, KT end, double max_error=0);  // The number of keys in [begin, end]
+  AFLICursor<KT, VT> cursor();
+  // Snapshot reads, writes log the prior states of keys once snapshots are 
+  // enabled
+  void enable_snapshots();
+  Snapshot get_snapshot();
+  void release_snapshot(const Snapshot& snapshot);
+  bool find(KT key, VT& value, const Snapshot& snapshot);
+  uint32_t multi_get(const KT* keys, uint32_t num_keys, VT* values, 
+                     bool* found, const Snapshot& snapshot);
+  uint32_t scan(KT begin, KT end, std::vector<KVT>& res, 
+                const Snapshot& snapshot);
+  // A read-only copy in a compact layout, writes must be stopped meanwhile. 
+  // Keys of 64-bit integers are delta encoded to the slots if 'compress'.
+  FrozenAFLIPara<KT, VT>* freeze(bool compress=false);
 
   uint64_t model_size();
   uint64_t index_size();
@@ -31,6 +72,14 @@ public:
   void print_statistics();
 private:
   static void rebuild(AFLIBGParam<KT, VT>* args);
+  bool remove_latest(KT key);
+  bool update_latest(KVT kv);
+  template<typename Fn>
+  bool modify_latest(KT key, Fn& fn);
+  void submit_rebuild(AFLIBGParam<KT, VT>* args);
+  uint32_t put_batch(const KVT* kvs, uint32_t size, bool overwrite);
+  double rank(KT key, bool inclusive, double max_error);
+  uint64_t collect_size(TNodePara<KT, VT>* node, bool model_only);
 
   void adapt_bucket_size(const KVT* kvs, uint32_t size, 
                          HyperParameter& hyper_para);
@@ -38,5 +87,29 @@ private:
   //                                  uint32_t depth, TreeStat& ts);
 };
 
+// The key-only set, whose slots and buckets hold keys without values
+template<typename KT>
+class AFLIPara<KT, void> : private AFLIPara<KT, Nil> {
+typedef AFLIPara<KT, Nil> Base;
+public:
+  using Base::hyper_para;
+public:
+  AFLIPara(uint32_t num_bg=1, boost::asio::thread_pool* p=nullptr);
+
+  void bulk_load(const KT* keys, uint32_t size);
+  bool find(KT key);
+  using Base::remove;
+  void insert(KT key);
+  uint32_t scan(KT begin, KT end, std::vector<KT>& res);
+  bool lower_bound(KT key, KT& res);
+  bool predecessor(KT key, KT& res);
+  bool successor(KT key, KT& res);
+  using Base::approx_rank;
+  using Base::estimate_count;
+
+  using Base::model_size;
+  using Base::index_size;
+};
+
 }
 #endif
\ No newline at end of file
@@ -8,6 +8,10 @@ namespace aflipara {
 template<typename KT, typename VT>
 AFLIPara<KT, VT>::AFLIPara(uint32_t num_bg, boost::asio::thread_pool* p) {
   root = nullptr;
+  tail = nullptr;
+  region = nullptr;
+  arenas = NarrowSlot<KT, VT>::value ? new NodeArenas<KT, VT>() : nullptr;
+  versions = nullptr;
   self_pool = false;
   if (num_bg > 0) {
     if (p == nullptr) {
@@ -24,7 +28,24 @@ AFLIPara<KT, VT>::AFLIPara(uint32_t num_bg, boost::asio::thread_pool* p) {
 template<typename KT, typename VT>
 AFLIPara<KT, VT>::~AFLIPara() {
   if (root != nullptr) {
-    delete root;
+    if (region != nullptr) {
+      root->~TNodePara();
+    } else {
+      delete root;
+    }
+  }
+  if (tail != nullptr) {
+    delete tail;
+  }
+  if (region != nullptr) {
+    delete region;
+  }
+  // Nodes of narrow slots are released to the arenas
+  if (arenas != nullptr) {
+    delete arenas;
+  }
+  if (versions != nullptr) {
+    delete versions;
   }
   if (self_pool) {
     delete pool;
@@ -35,60 +56,323 @@ template<typename KT, typename VT>
 void AFLIPara<KT, VT>::bulk_load(const KVT* kvs, uint32_t size) {
   ASSERT_WITH_MSG(root == nullptr, 
                   "The index must be empty before bulk loading");
-  root = new TNodePara<KT, VT>(hyper_para.num_nodes ++);
+  if (hyper_para.node_layout != kHeapLayout) {
+    region = new NodeRegion();
+    root = region->create_head<TNodePara<KT, VT>>(hyper_para.num_nodes ++, 
+                                                  arenas);
+  } else {
+    root = new TNodePara<KT, VT>(hyper_para.num_nodes ++, arenas);
+  }
   // adapt_bucket_size(kvs, size, hyper_para);
-  root->build(kvs, size, 1, hyper_para);
+  root->build_tree(kvs, size, 1, hyper_para, region);
+  // The tail starts after the maximum key, so empty loads have none
+  if (hyper_para.append_mode && size > 0) {
+    tail = new AppendTail<KT, VT>(kvs[size - 1].first, 
+                                  hyper_para.kMinAppendSize, region, arenas);
+  }
 }
 
 template<typename KT, typename VT>
 bool AFLIPara<KT, VT>::find(KT key, VT& value) {
+  if (tail != nullptr && tail->cover(key)) {
+    return tail->find(key, value);
+  }
   bool res = root->find(key, value);
   return res;
 }
 
 template<typename KT, typename VT>
 bool AFLIPara<KT, VT>::remove(KT key) {
-  return root->remove(key);
+  if (versions == nullptr) {
+    return remove_latest(key);
+  }
+  // Writes of a key are serialized by its lock, so the prior value stays 
+  // until the key is removed
+  VT value;
+  versions->lock_key(key);
+  bool res = find(key, value) && remove_latest(key);
+  if (res) {
+    versions->record(key, true, value);
+  }
+  versions->unlock_key(key);
+  return res;
 }
 
 template<typename KT, typename VT>
 bool AFLIPara<KT, VT>::update(KVT kv) {
-  return root->update(kv);
+  if (versions == nullptr) {
+    return update_latest(kv);
+  }
+  VT value;
+  versions->lock_key(kv.first);
+  bool res = find(kv.first, value) && update_latest(kv);
+  if (res) {
+    versions->record(kv.first, true, value);
+  }
+  versions->unlock_key(kv.first);
+  return res;
 }
 
 template<typename KT, typename VT>
 void AFLIPara<KT, VT>::insert(KVT kv) {
-  AFLIBGParam<KT, VT>* args = root->insert(kv, 1, hyper_para);
-  if (args != nullptr) {
-    if (pool != nullptr) {
-      boost::asio::post(*pool, boost::bind(AFLIPara<KT, VT>::rebuild, args));
-    } else { // No background threads, directly rebuild
-      AFLIPara::rebuild(args);
-    }
+  AFLIBGParam<KT, VT>* args = nullptr;
+  if (versions != nullptr) {
+    versions->lock_key(kv.first);
   }
+  if (tail != nullptr && tail->cover(kv.first)) {
+    // Out-of-bound keys are appended to the right edge
+    args = tail->insert(kv, hyper_para);
+  } else {
+    args = root->insert(kv, 1, hyper_para);
+  }
+  if (versions != nullptr) {
+    versions->record(kv.first, false, VT());
+    versions->unlock_key(kv.first);
+  }
+  submit_rebuild(args);
+}
+
+template<typename KT, typename VT>
+template<typename Fn>
+bool AFLIPara<KT, VT>::modify(KT key, Fn fn) {
+  if (versions == nullptr) {
+    return modify_latest(key, fn);
+  }
+  VT prior = VT();
+  bool written = false;
+  auto logged_fn = [&](VT& value) {
+    VT v = value;
+    written = fn(value);
+    prior = v;
+    return written;
+  };
+  versions->lock_key(key);
+  bool res = modify_latest(key, logged_fn);
+  if (res && written) {
+    versions->record(key, true, prior);
+  }
+  versions->unlock_key(key);
+  return res;
+}
+
+template<typename KT, typename VT>
+bool AFLIPara<KT, VT>::upsert(KVT kv) {
+  AFLIBGParam<KT, VT>* args = nullptr;
+  bool found = false;
+  VT old = VT();
+  if (versions != nullptr) {
+    versions->lock_key(kv.first);
+  }
+  if (tail != nullptr && tail->cover(kv.first)) {
+    args = tail->upsert(kv, hyper_para, found, old);
+  } else {
+    args = root->upsert(kv, 1, hyper_para, found, old);
+  }
+  if (versions != nullptr) {
+    versions->record(kv.first, found, old);
+    versions->unlock_key(kv.first);
+  }
+  submit_rebuild(args);
+  return !found;
+}
+
+template<typename KT, typename VT>
+uint32_t AFLIPara<KT, VT>::insert_batch(const KVT* kvs, uint32_t size) {
+  return put_batch(kvs, size, false);
+}
+
+template<typename KT, typename VT>
+uint32_t AFLIPara<KT, VT>::upsert_batch(const KVT* kvs, uint32_t size) {
+  return put_batch(kvs, size, true);
+}
+
+template<typename KT, typename VT>
+bool AFLIPara<KT, VT>::fetch_add(KT key, VT delta, VT& old) {
+  return modify(key, [&](VT& value) {
+    old = value;
+    value += delta;
+    return true;
+  });
+}
+
+template<typename KT, typename VT>
+bool AFLIPara<KT, VT>::compare_exchange(KT key, VT& expected, VT desired) {
+  // Fails if the key does not exist, otherwise 'expected' is set to the 
+  // current value on failure
+  VT target = expected;
+  bool res = false;
+  bool found = modify(key, [&](VT& value) {
+    res = value == target;
+    if (res) {
+      value = desired;
+    } else {
+      expected = value;
+    }
+    return res;
+  });
+  return found && res;
 }
 
 template<typename KT, typename VT>
 uint32_t AFLIPara<KT, VT>::scan(KT begin, KT end, std::vector<KVT>& res) {
-  return 0;
+  // Collect the pairs in range [begin, end] in key order
+  uint32_t num = 0;
+  AFLICursor<KT, VT> it(root, tail);
+  for (it.seek(begin); it.valid() && !(end < it.key()); it.next()) {
+    res.push_back({it.key(), it.value()});
+    num ++;
+  }
+  return num;
+}
+
+template<typename KT, typename VT>
+bool AFLIPara<KT, VT>::lower_bound(KT key, KVT& res) {
+  return neighbor(key, true, true, res);
+}
+
+template<typename KT, typename VT>
+bool AFLIPara<KT, VT>::predecessor(KT key, KVT& res) {
+  return neighbor(key, false, true, res);
+}
+
+template<typename KT, typename VT>
+bool AFLIPara<KT, VT>::successor(KT key, KVT& res) {
+  return neighbor(key, true, false, res);
+}
+
+template<typename KT, typename VT>
+bool AFLIPara<KT, VT>::neighbor(KT key, bool forward, bool inclusive, 
+                                KVT& res) {
+  // The keys of the tail are ordered after the keys of the root
+  if (tail != nullptr && tail->cover(key)) {
+    return tail->neighbor(&key, forward, inclusive, res) 
+           || (!forward && root->edge(false, res));
+  }
+  return root->neighbor(key, forward, inclusive, res) 
+         || (forward && tail != nullptr 
+             && tail->neighbor(nullptr, true, true, res));
+}
+
+template<typename KT, typename VT>
+double AFLIPara<KT, VT>::approx_rank(KT key, double max_error) {
+  return rank(key, false, max_error);
+}
+
+template<typename KT, typename VT>
+double AFLIPara<KT, VT>::estimate_count(KT begin, KT end, double max_error) {
+  if (end < begin) {
+    return 0;
+  }
+  return std::max(rank(end, true, max_error / 2) 
+                  - rank(begin, false, max_error / 2), 0.);
+}
+
+template<typename KT, typename VT>
+AFLICursor<KT, VT> AFLIPara<KT, VT>::cursor() {
+  return AFLICursor<KT, VT>(root, tail);
+}
+
+template<typename KT, typename VT>
+void AFLIPara<KT, VT>::enable_snapshots() {
+  // Must be called before concurrent writes
+  if (versions == nullptr) {
+    versions = new VersionLog<KT, VT>();
+  }
+}
+
+template<typename KT, typename VT>
+Snapshot AFLIPara<KT, VT>::get_snapshot() {
+  ASSERT_WITH_MSG(versions != nullptr, "Snapshots are disabled")
+  return versions->acquire();
+}
+
+template<typename KT, typename VT>
+void AFLIPara<KT, VT>::release_snapshot(const Snapshot& snapshot) {
+  versions->release(snapshot);
+}
+
+template<typename KT, typename VT>
+bool AFLIPara<KT, VT>::find(KT key, VT& value, const Snapshot& snapshot) {
+  // Read the latest state first, writes after the snapshot are logged 
+  // before their locks are released
+  bool exist = find(key, value);
+  versions->lookup(key, snapshot.version, exist, value);
+  return exist;
+}
+
+template<typename KT, typename VT>
+uint32_t AFLIPara<KT, VT>::multi_get(const KT* keys, uint32_t num_keys, 
+                                     VT* values, bool* found, 
+                                     const Snapshot& snapshot) {
+  uint32_t num = 0;
+  for (uint32_t i = 0; i < num_keys; ++ i) {
+    found[i] = find(keys[i], values[i], snapshot);
+    num += found[i];
+  }
+  return num;
+}
+
+template<typename KT, typename VT>
+uint32_t AFLIPara<KT, VT>::scan(KT begin, KT end, std::vector<KVT>& res, 
+                                const Snapshot& snapshot) {
+  // Merge the latest pairs with the prior states of the keys written after 
+  // the snapshot
+  std::vector<KVT> latest;
+  scan(begin, end, latest);
+  std::vector<std::pair<KT, Version<VT>>> prior;
+  versions->collect(begin, end, snapshot.version, prior);
+  uint32_t num = 0;
+  uint32_t i = 0, j = 0;
+  while (i < latest.size() || j < prior.size()) {
+    if (j == prior.size() 
+        || (i < latest.size() && latest[i].first < prior[j].first)) {
+      res.push_back(latest[i ++]);
+      num ++;
+      continue;
+    }
+    if (i < latest.size() && !(prior[j].first < latest[i].first)) {
+      i ++;
+    }
+    if (prior[j].second.exist) {
+      res.push_back({prior[j].first, prior[j].second.value});
+      num ++;
+    }
+    j ++;
+  }
+  return num;
+}
+
+template<typename KT, typename VT>
+FrozenAFLIPara<KT, VT>* AFLIPara<KT, VT>::freeze(bool compress) {
+  ASSERT_WITH_MSG(root != nullptr, "The index must be bulk loaded first")
+  return new FrozenAFLIPara<KT, VT>(root, tail, compress);
 }
 
 template<typename KT, typename VT>
 uint64_t AFLIPara<KT, VT>::model_size() {
-  // TreeStat ts;
-  // ts.bucket_size_ = hyper_para.max_bucket_size;
-  // collect_tree_statistics(root, 1, ts);
-  // return ts.model_size_;
-  return 0;
+  uint64_t res = sizeof(AFLIPara<KT, VT>) + collect_size(root, true);
+  if (tail != nullptr) {
+    res += sizeof(AppendTail<KT, VT>);
+    for (uint32_t i = 0; i < tail->num_segments; ++ i) {
+      res += collect_size(tail->segments[i], true);
+    }
+  }
+  return res;
 }
 
 template<typename KT, typename VT>
 uint64_t AFLIPara<KT, VT>::index_size() {
-  // TreeStat ts;
-  // ts.bucket_size_ = hyper_para.max_bucket_size;
-  // collect_tree_statistics(root, 1, ts);
-  // return ts.index_size_;
-  return 0;
+  uint64_t res = sizeof(AFLIPara<KT, VT>) + collect_size(root, false);
+  if (tail != nullptr) {
+    res += sizeof(AppendTail<KT, VT>) + sizeof(KVT) * tail->capacity;
+    for (uint32_t i = 0; i < tail->num_segments; ++ i) {
+      res += collect_size(tail->segments[i], false);
+    }
+  }
+  if (versions != nullptr) {
+    res += versions->size();
+  }
+  return res;
 }
 
 template<typename KT, typename VT>
@@ -104,7 +388,7 @@ void AFLIPara<KT, VT>::rebuild(AFLIBGParam<KT, VT>* args) {
   TNodePara<KT, VT>* node = args->node_ptr;
   uint32_t depth = args->depth;
   uint32_t idx = args->idx;
-  Bucket<KT, VT>* bucket = node->entries[idx].bucket;
+  Bucket<KT, VT>* bucket = node->entries[idx].get_bucket(node->arenas);
   assert(bucket->idx == idx);
   assert(bucket->node_id == node->id);
   uint32_t bucket_size = bucket->get_size();
@@ -113,20 +397,159 @@ void AFLIPara<KT, VT>::rebuild(AFLIBGParam<KT, VT>* args) {
     [](auto const& a, auto const& b) {
       return a.first < b.first;
   });
-  delete bucket;
-  TNodePara<KT, VT>* child = new TNodePara<KT, VT>(args->hyper_para.num_nodes++);
+  node->release_bucket(bucket);
+  TNodePara<KT, VT>* child = node->create_node(args->hyper_para.num_nodes++, 
+                                               nullptr);
+  child->first_slot = idx;
   child->build(kvs, bucket_size, args->depth + 1, args->hyper_para);
   node->set_entry_type(idx, kNode);
-  node->entries[idx].child = child;
+  node->entries[idx].set_child(child);
   node->unlock_entry(idx);
   delete[] kvs;
   delete args;
 }
 
+template<typename KT, typename VT>
+bool AFLIPara<KT, VT>::remove_latest(KT key) {
+  if (tail != nullptr && tail->cover(key)) {
+    return tail->remove(key);
+  }
+  return root->remove(key);
+}
+
+template<typename KT, typename VT>
+bool AFLIPara<KT, VT>::update_latest(KVT kv) {
+  if (tail != nullptr && tail->cover(kv.first)) {
+    return tail->update(kv);
+  }
+  return root->update(kv);
+}
+
+template<typename KT, typename VT>
+template<typename Fn>
+bool AFLIPara<KT, VT>::modify_latest(KT key, Fn& fn) {
+  if (tail != nullptr && tail->cover(key)) {
+    return tail->modify(key, fn);
+  }
+  return root->modify(key, fn);
+}
+
+template<typename KT, typename VT>
+void AFLIPara<KT, VT>::submit_rebuild(AFLIBGParam<KT, VT>* args) {
+  if (args != nullptr) {
+    if (pool != nullptr) {
+      boost::asio::post(*pool, boost::bind(AFLIPara<KT, VT>::rebuild, args));
+    } else { // No background threads, directly rebuild
+      AFLIPara::rebuild(args);
+    }
+  }
+}
+
+template<typename KT, typename VT>
+uint32_t AFLIPara<KT, VT>::put_batch(const KVT* kvs, uint32_t size, 
+                                     bool overwrite) {
+  std::vector<KVT> batch(kvs, kvs + size);
+  std::stable_sort(batch.begin(), batch.end(), 
+    [](auto const& a, auto const& b) {
+      return a.first < b.first;
+  });
+  // Keep the last pair of each key
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < size; ++ i) {
+    if (n > 0 && equal(batch[n - 1].first, batch[i].first)) {
+      batch[n - 1] = batch[i];
+    } else {
+      batch[n ++] = batch[i];
+    }
+  }
+  uint32_t num_inserted = 0;
+  if (versions != nullptr) {
+    // Writes are logged key by key under the locks of keys
+    for (uint32_t i = 0; i < n; ++ i) {
+      if (overwrite) {
+        num_inserted += upsert(batch[i]);
+      } else {
+        insert(batch[i]);
+        num_inserted ++;
+      }
+    }
+    return num_inserted;
+  }
+  // Keys beyond the root are appended to the tail in order
+  uint32_t num_root = n;
+  if (tail != nullptr) {
+    num_root = std::partition_point(batch.begin(), batch.begin() + n, 
+                 [&](const KVT& kv) {
+                   return !tail->cover(kv.first);
+               }) - batch.begin();
+  }
+  num_inserted += root->put_batch(batch.data(), num_root, 1, hyper_para, 
+                                  overwrite);
+  for (uint32_t i = num_root; i < n; ++ i) {
+    bool found = false;
+    VT old;
+    if (overwrite) {
+      submit_rebuild(tail->upsert(batch[i], hyper_para, found, old));
+    } else {
+      submit_rebuild(tail->insert(batch[i], hyper_para));
+    }
+    num_inserted += !found;
+  }
+  return num_inserted;
+}
+
+template<typename KT, typename VT>
+double AFLIPara<KT, VT>::rank(KT key, bool inclusive, double max_error) {
+  ASSERT_WITH_MSG(hyper_para.rank_stride > 0, "Rank counters are disabled")
+  double error = 0;
+  if (tail != nullptr && tail->cover(key)) {
+    return root->count() + tail->rank(key, inclusive, max_error);
+  }
+  return root->approx_rank(key, inclusive, max_error, error);
+}
+
+template<typename KT, typename VT>
+uint64_t AFLIPara<KT, VT>::collect_size(TNodePara<KT, VT>* node, 
+                                        bool model_only) {
+  if (node == nullptr) {
+    return 0;
+  }
+  uint64_t res = sizeof(TNodePara<KT, VT>) + sizeof(LinearModel);
+  if (!model_only) {
+    res += sizeof(BIT_TYPE) * 2 * BIT_LEN(node->capacity) 
+         + (sizeof(Entry<KT, VT>) + sizeof(uint8_t)) * node->capacity;
+    if (node->filter != nullptr) {
+      res += node->filter->size();
+    }
+    if (node->counters != nullptr) {
+      res += sizeof(int64_t) * (node->num_chunks + 1);
+    }
+  }
+  for (uint32_t i = 0; i < node->capacity; ++ i) {
+    uint8_t type = node->entry_type(i);
+    if (type == kBucket) {
+      res += sizeof(Bucket<KT, VT>);
+      if (!model_only) {
+        res += sizeof(KVT) 
+               * node->entries[i].get_bucket(node->arenas)->alloc_size;
+      }
+    } else if (type == kNode) {
+      TNodePara<KT, VT>* child = node->entries[i].get_child(node->arenas);
+      res += collect_size(child, model_only);
+      // Skip the duplicated child node pointers
+      while (i + 1 < node->capacity && node->entry_type(i + 1) == kNode 
+             && node->entries[i + 1].get_child(node->arenas) == child) {
+        i ++;
+      }
+    }
+  }
+  return res;
+}
+
 template<typename KT, typename VT>
 void AFLIPara<KT, VT>::adapt_bucket_size(const KVT* kvs, uint32_t size, 
                                          HyperParameter& hyper_para) {
-  uint32_t tail_conflicts = compute_tail_conflicts<KT, VT>(kvs, size, 
+  uint32_t tail_conflicts = compute_tail_conflicts(kvs, size, 
                               hyper_para.kSizeAmplification, 
                               hyper_para.kTailPercent);
   tail_conflicts = std::min(hyper_para.kMaxBucketSize, tail_conflicts);
@@ -219,5 +642,61 @@ void AFLIPara<KT, VT>::adapt_bucket_size(const KVT* kvs, uint32_t size,
 //   return 0;
 // }
 
+template<typename KT>
+AFLIPara<KT, void>::AFLIPara(uint32_t num_bg, boost::asio::thread_pool* p) 
+  : Base(num_bg, p) { }
+
+template<typename KT>
+void AFLIPara<KT, void>::bulk_load(const KT* keys, uint32_t size) {
+  std::vector<KeyPair<KT>> kvs(keys, keys + size);
+  Base::bulk_load(kvs.data(), size);
+}
+
+template<typename KT>
+bool AFLIPara<KT, void>::find(KT key) {
+  Nil nil;
+  return Base::find(key, nil);
+}
+
+template<typename KT>
+void AFLIPara<KT, void>::insert(KT key) {
+  Base::insert(KeyPair<KT>(key));
+}
+
+template<typename KT>
+uint32_t AFLIPara<KT, void>::scan(KT begin, KT end, std::vector<KT>& res) {
+  uint32_t num = 0;
+  AFLICursor<KT, Nil> it = Base::cursor();
+  for (it.seek(begin); it.valid() && !(end < it.key()); it.next()) {
+    res.push_back(it.key());
+    num ++;
+  }
+  return num;
+}
+
+template<typename KT>
+bool AFLIPara<KT, void>::lower_bound(KT key, KT& res) {
+  KeyPair<KT> kv;
+  bool found = Base::lower_bound(key, kv);
+  res = kv.first;
+  return found;
+}
+
+template<typename KT>
+bool AFLIPara<KT, void>::predecessor(KT key, KT& res) {
+  KeyPair<KT> kv;
+  bool found = Base::predecessor(key, kv);
+  res = kv.first;
+  return found;
+}
+
+template<typename KT>
+bool AFLIPara<KT, void>::successor(KT key, KT& res) {
+  KeyPair<KT> kv;
+  bool found = Base::successor(key, kv);
+  res = kv.first;
+  return found;
+}
+
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,109 @@
+#ifndef APPEND_TAIL_PARA_H
+#define APPEND_TAIL_PARA_H
+
+#include "core/afli_node_para_impl.h"
+#include "core/common.h"
+
+namespace aflipara {
+
+// The right edge of the index. Keys larger than the maximum key of the root
+// are appended to a sorted open segment instead of being clamped to the last
+// slot of the root. Once the open segment is full, it is sealed into a new
+// node, and the capacity of the next open segment is doubled, so that
+// sequential inserts take amortized O(1) work and the number of sealed
+// segments stays logarithmic. Writers hold the lock of the tail and make the
+// version odd while writing, and readers take no locks and retry if the
+// version changes (a seqlock). Replaced segment arrays are released after the
+// readers of the past epoch, as in RunSet.
+template<typename KT, typename VT>
+class AppendTail {
+typedef KVPair<KT, VT> KVT;
+public:
+  static const uint32_t kMaxSegments = 64;
+
+  // The unsealed pairs and the sealed segments at a time
+  struct View {
+    const KVT*                sealing;
+    uint32_t                  sealing_size;
+    const KVT*                data;
+    uint32_t                  size;
+    uint32_t                  num_segments;
+  };
+
+  KT                          max_key;   // The maximum key covered by the root
+  KVT*                        data;      // The open segment, sorted by keys
+  uint32_t                    size;
+  uint32_t                    capacity;
+  KVT*                        sealing;   // The full segment under building
+  uint32_t                    sealing_size;
+  // Sealed segments ordered by keys
+  volatile uint32_t           num_segments;
+  KT                          seg_max_keys[kMaxSegments];
+  TNodePara<KT, VT>*          segments[kMaxSegments];
+  NodeRegion*                 region;    // Sealed segments are placed in the region of the index if any
+  NodeArenas<KT, VT>*         arenas;    // The arenas of the index of narrow slots
+
+  volatile uint8_t            tail_lock;
+  volatile uint32_t           version;   // Odd while written
+  volatile uint32_t           epoch;
+  std::atomic<uint64_t>       readers[2];
+
+public:
+  AppendTail() = delete;
+  explicit AppendTail(KT max_key, uint32_t capacity, 
+                      NodeRegion* region=nullptr, 
+                      NodeArenas<KT, VT>* arenas=nullptr);
+  ~AppendTail();
+
+  inline bool cover(KT key) { return key > max_key; }
+
+  bool find(KT key, VT& value);
+  bool remove(KT key);
+  bool update(KVT kv);
+  AFLIBGParam<KT, VT>* insert(KVT kv, HyperParameter& hyper_para);
+  AFLIBGParam<KT, VT>* upsert(KVT kv, HyperParameter& hyper_para, bool& found, 
+                              VT& old);
+  template<typename Fn>
+  bool modify(KT key, Fn& fn);
+
+  // Ordered accesses for cursors
+  uint32_t first_segment(KT key);
+  uint32_t copy_buffer(const KT* key, bool forward, bool inclusive, 
+                       uint32_t max_size, std::vector<KVT>& res);
+  bool neighbor(const KT* key, bool forward, bool inclusive, KVT& res);
+  double rank(KT key, bool inclusive, double max_error);
+
+private:
+  void lock_tail();
+  void unlock_tail();
+  inline void begin_write();
+  inline void end_write();
+  inline uint32_t enter();
+  inline void leave(uint32_t e);
+  // Wait for the readers of the past epoch, under the lock
+  void synchronize();
+  // Run 'fn' over a consistent view of the tail without the lock, again if 
+  // it is written meanwhile
+  template<typename Fn>
+  void read(Fn fn);
+
+  inline View view() const {
+    return {sealing, sealing_size, data, size, num_segments};
+  }
+  // The first of the 'n' sealed segments whose maximum key is not less than 
+  // the key
+  uint32_t segment_of(uint32_t n, KT key) const;
+  // The sealed segment of the key for writers, 'nullptr' if it is unsealed
+  TNodePara<KT, VT>* locate_segment(KT key);
+  AFLIBGParam<KT, VT>* put(KVT kv, HyperParameter& hyper_para, bool overwrite, 
+                           bool& found, VT& old);
+  static uint32_t lower_bound(const KVT* kvs, uint32_t size, KT key);
+  static inline const KVT& buffer_at(const View& v, uint32_t i);
+  static uint32_t buffer_bound(const View& v, const KT* key, bool forward, 
+                               bool inclusive);
+  void seal(HyperParameter& hyper_para);
+};
+
+}
+
+#endif
@@ -0,0 +1,497 @@
+#ifndef APPEND_TAIL_PARA_IMPL_H
+#define APPEND_TAIL_PARA_IMPL_H
+
+#include "core/append_tail.h"
+
+namespace aflipara {
+
+template<typename KT, typename VT>
+AppendTail<KT, VT>::AppendTail(KT mk, uint32_t c, NodeRegion* r, 
+                               NodeArenas<KT, VT>* a) {
+  max_key = mk;
+  capacity = std::max(c, 2U);
+  size = 0;
+  data = new KVT[capacity];
+  sealing = nullptr;
+  sealing_size = 0;
+  num_segments = 0;
+  for (uint32_t i = 0; i < kMaxSegments; ++ i) {
+    segments[i] = nullptr;
+  }
+  region = r;
+  arenas = a;
+  tail_lock = 0;
+  version = 0;
+  epoch = 0;
+  readers[0] = 0;
+  readers[1] = 0;
+}
+
+template<typename KT, typename VT>
+AppendTail<KT, VT>::~AppendTail() {
+  for (uint32_t i = 0; i < num_segments; ++ i) {
+    if (region != nullptr) {
+      segments[i]->~TNodePara();
+    } else {
+      delete segments[i];
+    }
+    segments[i] = nullptr;
+  }
+  if (data != nullptr) {
+    delete[] data;
+    data = nullptr;
+  }
+  if (sealing != nullptr) {
+    delete[] sealing;
+    sealing = nullptr;
+  }
+}
+
+template<typename KT, typename VT>
+bool AppendTail<KT, VT>::find(KT key, VT& value) {
+  TNodePara<KT, VT>* segment = nullptr;
+  bool found = false;
+  read([&](const View& v) {
+    uint32_t s = segment_of(v.num_segments, key);
+    segment = s < v.num_segments ? segments[s] : nullptr;
+    found = false;
+    if (segment != nullptr) {
+      return;
+    }
+    // The sealing segment is immutable, so it is searchable while building
+    bool in_sealing = v.sealing != nullptr
+                      && !(key > v.sealing[v.sealing_size - 1].first);
+    const KVT* kvs = in_sealing ? v.sealing : v.data;
+    uint32_t kvs_size = in_sealing ? v.sealing_size : v.size;
+    uint32_t idx = lower_bound(kvs, kvs_size, key);
+    if (idx < kvs_size && equal(kvs[idx].first, key)) {
+      value = kvs[idx].second;
+      found = true;
+    }
+  });
+  // Sealed segments are released with the tail only
+  if (segment != nullptr) {
+    return segment->find(key, value);
+  }
+  return found;
+}
+
+template<typename KT, typename VT>
+bool AppendTail<KT, VT>::remove(KT key) {
+  lock_tail();
+  TNodePara<KT, VT>* segment = locate_segment(key);
+  if (segment != nullptr) {
+    unlock_tail();
+    return segment->remove(key);
+  }
+  uint32_t idx = lower_bound(data, size, key);
+  bool found = idx < size && equal(data[idx].first, key);
+  if (found) {
+    begin_write();
+    for (uint32_t i = idx; i + 1 < size; ++ i) {
+      data[i] = data[i + 1];
+    }
+    size --;
+    end_write();
+  }
+  unlock_tail();
+  return found;
+}
+
+template<typename KT, typename VT>
+bool AppendTail<KT, VT>::update(KVT kv) {
+  lock_tail();
+  TNodePara<KT, VT>* segment = locate_segment(kv.first);
+  if (segment != nullptr) {
+    unlock_tail();
+    return segment->update(kv);
+  }
+  uint32_t idx = lower_bound(data, size, kv.first);
+  bool found = idx < size && equal(data[idx].first, kv.first);
+  if (found) {
+    begin_write();
+    data[idx] = kv;
+    end_write();
+  }
+  unlock_tail();
+  return found;
+}
+
+template<typename KT, typename VT>
+AFLIBGParam<KT, VT>* AppendTail<KT, VT>::insert(KVT kv,
+                                                HyperParameter& hyper_para) {
+  bool found = false;
+  VT old;
+  return put(kv, hyper_para, false, found, old);
+}
+
+template<typename KT, typename VT>
+AFLIBGParam<KT, VT>* AppendTail<KT, VT>::upsert(KVT kv, 
+                                                HyperParameter& hyper_para, 
+                                                bool& found, VT& old) {
+  return put(kv, hyper_para, true, found, old);
+}
+
+template<typename KT, typename VT>
+template<typename Fn>
+bool AppendTail<KT, VT>::modify(KT key, Fn& fn) {
+  lock_tail();
+  TNodePara<KT, VT>* segment = locate_segment(key);
+  if (segment != nullptr) {
+    unlock_tail();
+    return segment->modify(key, fn);
+  }
+  uint32_t idx = lower_bound(data, size, key);
+  bool found = idx < size && equal(data[idx].first, key);
+  if (found) {
+    VT value = data[idx].second;
+    if (fn(value)) {
+      begin_write();
+      data[idx].second = value;
+      end_write();
+    }
+  }
+  unlock_tail();
+  return found;
+}
+
+template<typename KT, typename VT>
+uint32_t AppendTail<KT, VT>::first_segment(KT key) {
+  // Sealed segments are only appended, and published after their keys
+  return segment_of(num_segments, key);
+}
+
+template<typename KT, typename VT>
+uint32_t AppendTail<KT, VT>::copy_buffer(const KT* key, bool forward, 
+                                         bool inclusive, uint32_t max_size, 
+                                         std::vector<KVT>& res) {
+  // Copy at most 'max_size' unsealed pairs following (or preceding) the key, 
+  // where 'nullptr' means the first (or the last) one. The number of sealed 
+  // segments is returned, so that callers can tell whether any segment is 
+  // sealed since they checked it.
+  uint32_t num = 0;
+  read([&](const View& v) {
+    res.clear();
+    uint32_t n = v.sealing_size + v.size;
+    uint32_t l = buffer_bound(v, key, forward, inclusive);
+    uint32_t begin = forward ? l : l - std::min(l, max_size);
+    uint32_t end = forward ? std::min(n, l + max_size) : l;
+    for (uint32_t i = begin; i < end; ++ i) {
+      res.push_back(buffer_at(v, i));
+    }
+    num = v.num_segments;
+  });
+  return num;
+}
+
+template<typename KT, typename VT>
+bool AppendTail<KT, VT>::neighbor(const KT* key, bool forward, bool inclusive, 
+                                  KVT& res) {
+  // The nearest pair following (or preceding) the key, where 'nullptr' means 
+  // the first (or the last) pair of the tail
+  if (forward) {
+    uint32_t s = key == nullptr ? 0 : first_segment(*key);
+    while (true) {
+      uint32_t n = num_segments;
+      for (; s < n; ++ s) {
+        if (key == nullptr ? segments[s]->edge(true, res) 
+            : segments[s]->neighbor(*key, true, inclusive, res)) {
+          return true;
+        }
+      }
+      bool sealed = false, found = false;
+      read([&](const View& v) {
+        // Some unsealed data are sealed meanwhile
+        sealed = v.num_segments != n;
+        uint32_t l = buffer_bound(v, key, true, inclusive);
+        found = !sealed && l < v.sealing_size + v.size;
+        if (found) {
+          res = buffer_at(v, l);
+        }
+      });
+      if (!sealed) {
+        return found;
+      }
+    }
+  } else {
+    uint32_t l = 0;
+    int64_t s = 0;
+    read([&](const View& v) {
+      l = buffer_bound(v, key, false, inclusive);
+      if (l > 0) {
+        res = buffer_at(v, l - 1);
+      }
+      s = static_cast<int64_t>(v.num_segments) - 1;
+    });
+    if (l > 0) {
+      return true;
+    }
+    if (key != nullptr) {
+      s = std::min(s, static_cast<int64_t>(first_segment(*key)));
+    }
+    for (; s >= 0; -- s) {
+      if (key == nullptr ? segments[s]->edge(false, res) 
+          : segments[s]->neighbor(*key, false, inclusive, res)) {
+        return true;
+      }
+    }
+    return false;
+  }
+}
+
+template<typename KT, typename VT>
+double AppendTail<KT, VT>::rank(KT key, bool inclusive, double max_error) {
+  // The estimated number of keys of the tail less than (or not larger than) 
+  // the key, unsealed keys are counted exactly
+  uint32_t s = first_segment(key);
+  double res = 0;
+  for (uint32_t i = 0; i < s; ++ i) {
+    res += segments[i]->count();
+  }
+  if (s < num_segments) {
+    double error = 0;
+    return res + segments[s]->approx_rank(key, inclusive, max_error, error);
+  }
+  uint32_t num = 0;
+  read([&](const View& v) {
+    num = buffer_bound(v, &key, true, !inclusive);
+  });
+  return res + num;
+}
+
+template<typename KT, typename VT>
+void AppendTail<KT, VT>::lock_tail() {
+  uint8_t unlocked = 0, locked = 1;
+  while (unlikely(cmpxchgb((uint8_t *)&this->tail_lock, unlocked, locked) !=
+                  unlocked))
+    ;
+}
+
+template<typename KT, typename VT>
+void AppendTail<KT, VT>::unlock_tail() {
+  tail_lock = 0;
+}
+
+template<typename KT, typename VT>
+inline void AppendTail<KT, VT>::begin_write() {
+  version = version + 1;
+  fence();
+}
+
+template<typename KT, typename VT>
+inline void AppendTail<KT, VT>::end_write() {
+  fence();
+  version = version + 1;
+}
+
+template<typename KT, typename VT>
+inline uint32_t AppendTail<KT, VT>::enter() {
+  while (true) {
+    uint32_t e = epoch;
+    readers[e & 1] ++;
+    // The epoch may be advanced before the reader is counted
+    if (epoch == e) {
+      return e;
+    }
+    readers[e & 1] --;
+  }
+}
+
+template<typename KT, typename VT>
+inline void AppendTail<KT, VT>::leave(uint32_t e) {
+  readers[e & 1] --;
+}
+
+template<typename KT, typename VT>
+void AppendTail<KT, VT>::synchronize() {
+  uint32_t e = epoch;
+  epoch = e + 1;
+  fence();
+  while (readers[e & 1] != 0) {
+    std::this_thread::yield();
+  }
+}
+
+template<typename KT, typename VT>
+template<typename Fn>
+void AppendTail<KT, VT>::read(Fn fn) {
+  uint32_t e = enter();
+  while (true) {
+    uint32_t v = version;
+    if (v & 1) {
+      continue;
+    }
+    fence();
+    View snapshot = view();
+    fence();
+    // The arrays and their sizes are taken in one write
+    if (version != v) {
+      continue;
+    }
+    fn(snapshot);
+    fence();
+    if (version == v) {
+      break;
+    }
+  }
+  leave(e);
+}
+
+template<typename KT, typename VT>
+uint32_t AppendTail<KT, VT>::segment_of(uint32_t n, KT key) const {
+  uint32_t l = 0, r = n;
+  while (l < r) {
+    uint32_t mid = (l + r) >> 1;
+    if (seg_max_keys[mid] < key) {
+      l = mid + 1;
+    } else {
+      r = mid;
+    }
+  }
+  return l;
+}
+
+template<typename KT, typename VT>
+TNodePara<KT, VT>* AppendTail<KT, VT>::locate_segment(KT key) {
+  // Keys falling in the sealing segment can only be modified after it is
+  // published, so writers wait for the sealing here.
+  while (sealing != nullptr && !(key > sealing[sealing_size - 1].first)) {
+    unlock_tail();
+    // The sealing thread takes the lock to publish the segment, so waiters 
+    // yield rather than take the lock back at once
+    std::this_thread::yield();
+    lock_tail();
+  }
+  uint32_t l = segment_of(num_segments, key);
+  return l < num_segments ? segments[l] : nullptr;
+}
+
+template<typename KT, typename VT>
+AFLIBGParam<KT, VT>* AppendTail<KT, VT>::put(KVT kv, HyperParameter& hyper_para, 
+                                             bool overwrite, bool& found, 
+                                             VT& old) {
+  lock_tail();
+  TNodePara<KT, VT>* segment = locate_segment(kv.first);
+  if (segment != nullptr) {
+    unlock_tail();
+    return overwrite ? segment->upsert(kv, 1, hyper_para, found, old) 
+                     : segment->insert(kv, 1, hyper_para);
+  }
+  found = false;
+  if (overwrite) {
+    uint32_t idx = lower_bound(data, size, kv.first);
+    if (idx < size && equal(data[idx].first, kv.first)) {
+      found = true;
+      old = data[idx].second;
+      begin_write();
+      data[idx].second = kv.second;
+      end_write();
+      unlock_tail();
+      return nullptr;
+    }
+  }
+  // Keys usually arrive in order, so shifting from the end is O(1)
+  begin_write();
+  uint32_t idx = size;
+  for (; idx > 0 && data[idx - 1].first > kv.first; -- idx) {
+    data[idx] = data[idx - 1];
+  }
+  data[idx] = kv;
+  size ++;
+  end_write();
+  if (size < capacity) {
+    unlock_tail();
+  } else if (sealing == nullptr && num_segments < kMaxSegments) {
+    seal(hyper_para);
+  } else {
+    // Another segment is being sealed, so we enlarge the open segment
+    KVT* kvs = new KVT[capacity * 2];
+    std::copy(data, data + size, kvs);
+    begin_write();
+    std::swap(data, kvs);
+    capacity = capacity * 2;
+    end_write();
+    synchronize();
+    unlock_tail();
+    delete[] kvs;
+  }
+  return nullptr;
+}
+
+template<typename KT, typename VT>
+uint32_t AppendTail<KT, VT>::lower_bound(const KVT* kvs, uint32_t size,
+                                         KT key) {
+  uint32_t l = 0, r = size;
+  while (l < r) {
+    uint32_t mid = (l + r) >> 1;
+    if (kvs[mid].first < key) {
+      l = mid + 1;
+    } else {
+      r = mid;
+    }
+  }
+  return l;
+}
+
+template<typename KT, typename VT>
+const KVPair<KT, VT>& AppendTail<KT, VT>::buffer_at(const View& v, uint32_t i) {
+  // The sealing segment and the open segment are treated as one sorted array
+  return i < v.sealing_size ? v.sealing[i] : v.data[i - v.sealing_size];
+}
+
+template<typename KT, typename VT>
+uint32_t AppendTail<KT, VT>::buffer_bound(const View& v, const KT* key, 
+                                          bool forward, bool inclusive) {
+  // The position of the first unsealed pair larger than the key if 'forward' 
+  // differs from 'inclusive', otherwise the first one not less than the key
+  if (key == nullptr) {
+    return forward ? 0 : v.sealing_size + v.size;
+  }
+  bool strict = forward != inclusive;
+  uint32_t l = 0, r = v.sealing_size + v.size;
+  while (l < r) {
+    uint32_t mid = (l + r) >> 1;
+    const KT& k = buffer_at(v, mid).first;
+    if (strict ? !(*key < k) : k < *key) {
+      l = mid + 1;
+    } else {
+      r = mid;
+    }
+  }
+  return l;
+}
+
+template<typename KT, typename VT>
+void AppendTail<KT, VT>::seal(HyperParameter& hyper_para) {
+  // Detach the full segment and build it without holding the lock
+  begin_write();
+  sealing = data;
+  sealing_size = size;
+  capacity = capacity * 2;
+  data = new KVT[capacity];
+  size = 0;
+  end_write();
+  unlock_tail();
+  TNodePara<KT, VT>* segment = region != nullptr 
+    ? region->create_head<TNodePara<KT, VT>>(hyper_para.num_nodes ++, arenas)
+    : new TNodePara<KT, VT>(hyper_para.num_nodes ++, arenas);
+  segment->build_tree(sealing, sealing_size, 1, hyper_para, region);
+  lock_tail();
+  begin_write();
+  uint32_t n = num_segments;
+  segments[n] = segment;
+  seg_max_keys[n] = sealing[sealing_size - 1].first;
+  fence();
+  num_segments = n + 1;
+  KVT* kvs = sealing;
+  sealing = nullptr;
+  sealing_size = 0;
+  end_write();
+  synchronize();
+  unlock_tail();
+  delete[] kvs;
+}
+
+}
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef BLOOM_FILTER_PARA_H
+#define BLOOM_FILTER_PARA_H
+
+#include "core/key_codec.h"
+#include "core/common.h"
+
+namespace aflipara {
+
+// The finalizer of MurmurHash3
+inline uint64_t mix_hash(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+template<typename KT>
+inline uint64_t hash_key(const KT& key) {
+  if constexpr (KeyCodec<KT>::kBytes) {
+    // Mix the bytes word by word
+    const uint8_t* b = key.bytes();
+    uint32_t n = key.length();
+    uint64_t h = n;
+    for (uint32_t i = 0; i < n; i += 8) {
+      uint64_t w = 0;
+      memcpy(&w, b + i, std::min(n - i, 8U));
+      h = mix_hash(h ^ w);
+    }
+    return h;
+  } else {
+    uint64_t h = 0;
+    memcpy(&h, &key, std::min(sizeof(KT), sizeof(uint64_t)));
+    return mix_hash(h);
+  }
+}
+
+// A blocked Bloom filter, all probes of a key fall in one cache line. Keys
+// can be added concurrently, while they cannot be removed.
+class BlockedBloomFilter {
+public:
+  struct alignas(64) Block {
+    uint64_t words[8];
+  };
+
+  Block* blocks;
+  uint32_t num_blocks;
+
+  static const uint32_t kNumProbes = 6;
+
+public:
+  BlockedBloomFilter() = delete;
+  explicit BlockedBloomFilter(uint32_t num_keys, uint32_t bits_per_key) {
+    uint64_t num_bits = static_cast<uint64_t>(num_keys) * bits_per_key;
+    num_blocks = std::max(static_cast<uint32_t>((num_bits + 511) / 512), 1U);
+    blocks = new Block[num_blocks];
+    memset(blocks, 0, sizeof(Block) * num_blocks);
+  }
+
+  ~BlockedBloomFilter() {
+    delete[] blocks;
+    blocks = nullptr;
+  }
+
+  uint64_t size() {
+    return sizeof(BlockedBloomFilter) + sizeof(Block) * num_blocks;
+  }
+
+  inline void add(uint64_t h) {
+    Block& block = blocks[locate(h)];
+    uint64_t g = h * 0x9E3779B97F4A7C15ULL;
+    for (uint32_t i = 0; i < kNumProbes; ++ i, g >>= 9) {
+      uint32_t bit = g & 511;
+      __atomic_fetch_or(&block.words[bit >> 6], 1ULL << (bit & 63),
+                        __ATOMIC_RELAXED);
+    }
+  }
+
+  inline bool may_contain(uint64_t h) const {
+    const Block& block = blocks[locate(h)];
+    uint64_t g = h * 0x9E3779B97F4A7C15ULL;
+    for (uint32_t i = 0; i < kNumProbes; ++ i, g >>= 9) {
+      uint32_t bit = g & 511;
+      if (!((block.words[bit >> 6] >> (bit & 63)) & 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+private:
+  inline uint32_t locate(uint64_t h) const {
+    return static_cast<uint32_t>(((h >> 32) * num_blocks) >> 32);
+  }
+};
+
+// The fence keys and the Bloom filter of a subtree, so that lookups of
+// absent keys return without reaching slots or buckets.
+template<typename KT>
+class SubtreeFilter {
+public:
+  KT min_key;
+  KT max_key;
+  BlockedBloomFilter bloom;
+  volatile uint8_t fence_lock;   // Guards the fences of keys wider than a word
+
+public:
+  template<typename P>
+  explicit SubtreeFilter(const P* kvs, uint32_t size,
+                         uint32_t bits_per_key)
+                         : bloom(size, bits_per_key) {
+    fence_lock = 0;
+    min_key = kvs[0].first;
+    max_key = kvs[size - 1].first;
+    for (uint32_t i = 0; i < size; ++ i) {
+      bloom.add(hash_key(kvs[i].first));
+    }
+  }
+
+  uint64_t size() {
+    return sizeof(SubtreeFilter<KT>) - sizeof(BlockedBloomFilter)
+           + bloom.size();
+  }
+
+  inline bool may_contain(KT key) const {
+    return !(key < min_key) && !(max_key < key)
+           && bloom.may_contain(hash_key(key));
+  }
+
+  // The fences are extended before the key becomes visible in the subtree
+  inline void add(KT key) {
+    if constexpr (sizeof(KT) <= sizeof(uint64_t)) {
+      KT cur;
+      __atomic_load(&min_key, &cur, __ATOMIC_RELAXED);
+      while (key < cur && !__atomic_compare_exchange(&min_key, &cur, &key,
+                            false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) { }
+      __atomic_load(&max_key, &cur, __ATOMIC_RELAXED);
+      while (cur < key && !__atomic_compare_exchange(&max_key, &cur, &key,
+                            false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) { }
+    } else {
+      uint8_t unlocked = 0, locked = 1;
+      while (unlikely(cmpxchgb((uint8_t *)&fence_lock, unlocked, locked)
+                      != unlocked)) { }
+      if (key < min_key) {
+        min_key = key;
+      }
+      if (max_key < key) {
+        max_key = key;
+      }
+      fence_lock = 0;
+    }
+    bloom.add(hash_key(key));
+  }
+};
+
+}
+
+#endif
@@ -1,84 +1,299 @@
 #ifndef BNAF_H
 #define BNAF_H
 
-#include "core/common.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
-#include <mkl.h>
-#include <mkl_cblas.h>
+#include "core/common.h"
+#include "core/infer_backend.h"
 
 namespace aflipara {
 
+// The precision of the hidden layers of flows. Floats double the lanes of
+// SIMD and halve the bytes of weights and activations, and int8 weights take
+// a byte each, scaled by their columns. Flows only have to keep the order of
+// keys, so reduced modes are taken if they keep it on the bulk-loaded keys.
+enum FlowPrecision {
+  kDoublePrecision = 0,
+  kFloatPrecision = 1,
+  kInt8Precision = 2,
+};
+
+inline const char* precision_name(FlowPrecision precision) {
+  static const char* names[] = {"double", "float32", "int8"};
+  return names[precision];
+}
+
+// The header of binary weight files, in the byte order of the host. The
+// layers follow it in order, each at an offset aligned to 64 bytes, so the
+// weights of a mapped file are read in place and shared by the processes
+// mapping it.
+struct FlowFileHeader {
+  static constexpr char kMagic[8] = "NFLFLOW";
+  static const uint32_t kVersion = 1;
+  static const uint32_t kAlign = 64;
+
+  char                        magic[8];
+  uint32_t                    version;
+  int32_t                     in_dim;
+  int32_t                     hidden_dim;
+  int32_t                     num_layers;
+  double                      mean;
+  double                      var;
+  uint64_t                    data_size;  // The bytes following the header
+  uint64_t                    checksum;   // FNV-1a of the header, with the checksum zeroed, and the bytes following it
+  uint64_t                    reserved;
+
+  // The checksum of the header and the bytes following it
+  uint64_t compute_checksum(const char* data) const {
+    FlowFileHeader header = *this;
+    header.checksum = 0;
+    uint64_t h = fnv1a(14695981039346656037ULL, 
+                       reinterpret_cast<const char*>(&header), 
+                       sizeof(header));
+    return fnv1a(h, data, data_size);
+  }
+
+  // FNV-1a over 8-byte words, the size is a multiple of 8
+  static uint64_t fnv1a(uint64_t h, const char* data, uint64_t size) {
+    for (uint64_t i = 0; i < size; i += 8) {
+      uint64_t w;
+      memcpy(&w, data + i, 8);
+      h = (h ^ w) * 1099511628211ULL;
+    }
+    return h;
+  }
+};
+static_assert(sizeof(FlowFileHeader) == FlowFileHeader::kAlign, 
+              "The layers follow the header at an aligned offset");
+
 template<typename KT, typename VT>
 class BNAF_Infer {
 typedef std::pair<KT, VT> KVT;
 typedef std::pair<double, KVT> KKVT;
 public:
+  // The scratch space of inferences, grown to the rows of each call. Every 
+  // thread has its own, so the weights are shared by concurrent transforms.
+  // Buffers are reallocated by the backend of the model using them.
+  struct Workspace {
+    const InferBackend*       backend = nullptr;
+    double*                   inputs = nullptr;
+    double*                   outputs[2] = {nullptr, nullptr};
+    uint64_t                  num_inputs = 0;
+    uint64_t                  num_outputs = 0;
+
+    ~Workspace() {
+      release();
+    }
+
+    void reserve(uint64_t n_inputs, uint64_t n_outputs, 
+                 const InferBackend* b) {
+      if (b != backend) {
+        release();
+        backend = b;
+      }
+      if (n_inputs > num_inputs) {
+        if (inputs != nullptr) {
+          backend->release(inputs);
+        }
+        inputs = backend->alloc(n_inputs);
+        num_inputs = n_inputs;
+      }
+      if (n_outputs > num_outputs) {
+        for (uint32_t i = 0; i < 2; ++ i) {
+          if (outputs[i] != nullptr) {
+            backend->release(outputs[i]);
+          }
+          outputs[i] = backend->alloc(n_outputs);
+        }
+        num_outputs = n_outputs;
+      }
+    }
+
+    void release() {
+      if (inputs != nullptr) {
+        backend->release(inputs);
+      }
+      for (uint32_t i = 0; i < 2; ++ i) {
+        if (outputs[i] != nullptr) {
+          backend->release(outputs[i]);
+        }
+      }
+      inputs = outputs[0] = outputs[1] = nullptr;
+      num_inputs = num_outputs = 0;
+    }
+  };
+
+  // A forward pass specialized for a shape, over the normalized keys
+  typedef void (BNAF_Infer::*Kernel)(KKVT*, uint32_t) const;
+  static const uint32_t kLanes = 8;  // Keys per pass of reduced precision
+  static constexpr int kMaxReducedHidden = 128;  // Hidden units on the stack
+
   int num_layers;
-  MKL_INT batch_size;
-  MKL_INT in_dim;
-  MKL_INT hidden_dim;
+  int in_dim;
+  int hidden_dim;
+  double mean;      // Keys are normalized by the mean and the variance first
+  double var;
   double** weights;
+  const InferBackend* backend;
+  Kernel kernel;    // 'nullptr' if the shape goes through the backend
   // 1: in_dim * hidden_dim
   // 2: hidden_dim * hidden_dim
   // ....
   // n: hidden_dim * in_dim
-  double* inputs;
-  double* outputs[2];
+  FlowPrecision precision;
+  // The layers taking hidden units in reduced precision, the first is empty.
+  // Weights are divided by the scales of their columns, as the weights of
+  // the last layer may exceed floats.
+  std::vector<std::vector<float>> float_weights;
+  std::vector<std::vector<int8_t>> int8_weights;
+  std::vector<std::vector<double>> scales;
+  char* mapping;    // The mapped weight file, 'nullptr' if weights are owned
+  uint64_t mapping_size;
 public:
-  BNAF_Infer() : inputs(nullptr), weights(nullptr) {
-    outputs[0] = nullptr;
-    outputs[1] = nullptr;
-  }
+  BNAF_Infer() : num_layers(0), weights(nullptr), backend(nullptr), 
+                 kernel(nullptr), precision(kDoublePrecision), 
+                 mapping(nullptr), mapping_size(0) { }
 
   ~BNAF_Infer() {
-    for (int i = 0; i < num_layers; ++ i) {
-      if (weights[i] != nullptr) {
-        mkl_free(weights[i]);
+    if (mapping != nullptr) {
+      munmap(mapping, mapping_size);
+    } else {
+      for (int i = 0; i < num_layers; ++ i) {
+        if (weights[i] != nullptr) {
+          backend->release(weights[i]);
+        }
       }
     }
-    if (inputs != nullptr) {
-      mkl_free(inputs);
+    if (weights != nullptr) {
+      delete[] weights;
+    }
+  }
+
+  // The weights are immutable once loaded, so indexes may share them. Without
+  // 'fuse', shapes with kernels go through the backend as well. Binary files
+  // are mapped and told by their magic, others are parsed as text.
+  static std::shared_ptr<const BNAF_Infer<KT, VT>> load(std::string path, 
+      const InferBackend* backend=InferBackend::get_default(), 
+      bool fuse=true) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      std::cout << "File:" << path << " doesn't exist" << std::endl;
+      exit(-1);
     }
-    if (outputs[0] != nullptr) {
-      mkl_free(outputs[0]);
+    char magic[sizeof(FlowFileHeader::kMagic)] = {0};
+    bool binary = pread(fd, magic, sizeof(magic), 0) == sizeof(magic)
+                  && memcmp(magic, FlowFileHeader::kMagic, sizeof(magic)) == 0;
+    BNAF_Infer<KT, VT>* model = new BNAF_Infer<KT, VT>();
+    model->backend = backend;
+    if (binary) {
+      model->map_binary(fd, path);
+    } else {
+      model->parse_text(path);
+    }
+    close(fd);
+    if (fuse) {
+      model->kernel = select_kernel(model->in_dim, model->hidden_dim);
+    }
+    return std::shared_ptr<const BNAF_Infer<KT, VT>>(model);
+  }
+
+  // Write the weights in the binary format
+  void save(std::string path) const {
+    FlowFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FlowFileHeader::kMagic, sizeof(header.magic));
+    header.version = FlowFileHeader::kVersion;
+    header.in_dim = in_dim;
+    header.hidden_dim = hidden_dim;
+    header.num_layers = num_layers;
+    header.mean = mean;
+    header.var = var;
+    std::vector<char> data;
+    for (int w = 0; w < num_layers; ++ w) {
+      const char* layer = reinterpret_cast<const char*>(weights[w]);
+      data.insert(data.end(), layer, layer + layer_bytes(w));
+      data.resize(aligned_size(data.size()), 0);
+    }
+    header.data_size = data.size();
+    header.checksum = header.compute_checksum(data.data());
+    std::ofstream out(path, std::ios::out | std::ios::binary);
+    ASSERT_WITH_MSG(out.is_open(), "Cannot create the weight file [" << path 
+                    << "]")
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(data.data(), data.size());
+    out.close();
+    ASSERT_WITH_MSG(out.good(), "Cannot write the weight file [" << path 
+                    << "]")
+  }
+
+  // A copy whose hidden layers run in the precision
+  std::shared_ptr<const BNAF_Infer<KT, VT>> reduce(
+      FlowPrecision p) const {
+    ASSERT_WITH_MSG(p == kDoublePrecision || hidden_dim <= kMaxReducedHidden,
+                    "Reduced precision takes up to " << kMaxReducedHidden 
+                    << " hidden dimensions, not " << hidden_dim)
+    BNAF_Infer<KT, VT>* model = new BNAF_Infer<KT, VT>();
+    model->backend = backend;
+    model->num_layers = num_layers;
+    model->in_dim = in_dim;
+    model->hidden_dim = hidden_dim;
+    model->mean = mean;
+    model->var = var;
+    model->weights = new double*[num_layers];
+    for (int w = 0; w < num_layers; ++ w) {
+      uint64_t n = static_cast<uint64_t>(rows(w)) * cols(w);
+      model->weights[w] = backend->alloc(n);
+      std::copy(weights[w], weights[w] + n, model->weights[w]);
     }
-    if (outputs[1] != nullptr) {
-      mkl_free(outputs[1]);
+    model->kernel = kernel;
+    model->precision = p;
+    if (p != kDoublePrecision) {
+      model->quantize();
+      model->kernel = p == kFloatPrecision 
+                      ? &BNAF_Infer<KT, VT>::reduced_forward<float>
+                      : &BNAF_Infer<KT, VT>::reduced_forward<int8_t>;
     }
+    return std::shared_ptr<const BNAF_Infer<KT, VT>>(model);
   }
 
-  uint64_t model_size() {
+  // The workspace of the calling thread
+  static Workspace& local_workspace() {
+    static thread_local Workspace workspace;
+    return workspace;
+  }
+
+  uint64_t model_size() const {
     return 0;
   }
 
-  uint64_t size() {
-    return sizeof(BNAF_Infer<KT, VT>) + sizeof(double*) * num_layers 
-          + sizeof(double) * (batch_size * in_dim + batch_size * hidden_dim * 2)
+  uint64_t size() const {
+    uint64_t res = sizeof(BNAF_Infer<KT, VT>) + sizeof(double*) * num_layers 
           + sizeof(double) * (in_dim * hidden_dim * 2 + (num_layers - 2) * hidden_dim * hidden_dim);
+    for (uint32_t w = 0; w < scales.size(); ++ w) {
+      res += float_weights[w].size() * sizeof(float) + int8_weights[w].size()
+             + scales[w].size() * sizeof(double);
+    }
+    return res;
   }
 
-  void set_batch_size(uint32_t bs) {
-    batch_size = bs;
-    if (inputs != nullptr) {
-      mkl_free(inputs);
-    }
-    if (outputs[0] != nullptr) {
-      mkl_free(outputs[0]);
+  // The keys of the pairs are normalized already. Shapes with kernels take
+  // the kernels for batches and single keys alike, so a key is transformed
+  // to the same value on every path.
+  void transform(KKVT* tran_kvs, uint32_t size, Workspace& ws) const {
+    if (kernel != nullptr) {
+      (this->*kernel)(tran_kvs, size);
+      return;
     }
-    if (outputs[1] != nullptr) {
-      mkl_free(outputs[1]);
-    }
-    inputs= (double*)mkl_calloc(bs * in_dim, sizeof(double), 64);
-    outputs[0] = (double*)mkl_calloc(bs * hidden_dim, sizeof(double), 64);
-    outputs[1] = (double*)mkl_calloc(bs * hidden_dim, sizeof(double), 64);
+    ws.reserve(static_cast<uint64_t>(size) * in_dim, 
+               static_cast<uint64_t>(size) * hidden_dim, backend);
+    prepare_inputs(tran_kvs, size, ws.inputs);
+    forward(size, ws);
+    prepare_outputs(tran_kvs, size, ws.inputs);
   }
 
-  void transform(KKVT* tran_kvs, uint32_t size) {
-    prepare_inputs(tran_kvs, size);
-    forward();
-    prepare_outputs(tran_kvs, size);
-  }
-  void print_parameters() {
+  void print_parameters() const {
     std::cout << "Layers\t" << num_layers << std::endl;
     std::cout << "Input Dim\t" << in_dim << std::endl;
     std::cout << "Hidden Dim\t" << hidden_dim << std::endl;
@@ -88,31 +303,306 @@ public:
   }
 
 private:
-  void prepare_inputs(const KKVT* tran_kvs, uint32_t size) {
-    if (in_dim == 1) {
-      for (uint32_t i = 0; i < size; ++ i) {
-        inputs[i] = tran_kvs[i].first;
+  inline int rows(int w) const { return w == 0 ? in_dim : hidden_dim; }
+  inline int cols(int w) const { 
+    return w == num_layers - 1 ? in_dim : hidden_dim; 
+  }
+  inline uint64_t layer_bytes(int w) const {
+    return static_cast<uint64_t>(rows(w)) * cols(w) * sizeof(double);
+  }
+  static inline uint64_t aligned_size(uint64_t size) {
+    return (size + FlowFileHeader::kAlign - 1) / FlowFileHeader::kAlign 
+           * FlowFileHeader::kAlign;
+  }
+
+  // The kernels take 1, 2, or 4 input dimensions, and a flow has at least 
+  // the input and the output layers
+  void check_dims(std::string path) const {
+    ASSERT_WITH_MSG((in_dim == 1 || in_dim == 2 || in_dim == 4) 
+                    && hidden_dim > 0 && num_layers >= 2, "Weight file [" 
+                    << path << "] has " << in_dim << " input dimensions, " 
+                    << hidden_dim << " hidden dimensions and " << num_layers 
+                    << " layers")
+  }
+
+  // The dimensions, the mean, the variance, and each layer as its rows and
+  // columns followed by the weights, all separated by spaces
+  void parse_text(std::string path) {
+    std::fstream in(path, std::ios::in);
+    in >> in_dim >> hidden_dim >> num_layers;
+    ASSERT_WITH_MSG(in.good(), "Cannot read the weight file [" << path << "]")
+    check_dims(path);
+    in >> mean >> var;
+    weights = new double*[num_layers];
+    for (int w = 0; w < num_layers; ++ w) {
+      uint32_t n, m;
+      in >> n >> m;
+      ASSERT_WITH_MSG(in.good() && n == static_cast<uint32_t>(rows(w)) 
+                      && m == static_cast<uint32_t>(cols(w)), "Layer " << w 
+                      << " of [" << path << "] is not " << rows(w) << " * " 
+                      << cols(w))
+      weights[w] = backend->alloc(n * m);
+      for (uint32_t i = 0; i < n; ++ i) {
+        for (uint32_t j = 0; j < m; ++ j) {
+          in >> weights[w][i * m + j];
+        }
       }
-    } else if (in_dim == 2) {
-      for (uint32_t i = 0; i < size; ++ i) {
-        inputs[2 * i] = tran_kvs[i].first;
-        inputs[2 * i + 1] = tran_kvs[i].first - std::floor(inputs[2 * i]);
+    }
+    in.close();
+  }
+
+  // Weights point into the shared read-only mapping of the file
+  void map_binary(int fd, std::string path) {
+    struct stat st;
+    ASSERT_WITH_MSG(fstat(fd, &st) == 0 && static_cast<uint64_t>(st.st_size) 
+                                           >= sizeof(FlowFileHeader), 
+                    "Cannot read the weight file [" << path << "]")
+    mapping_size = st.st_size;
+    mapping = (char*)mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    ASSERT_WITH_MSG(mapping != MAP_FAILED, "Cannot map the weight file [" 
+                    << path << "]")
+    const FlowFileHeader* header = 
+        reinterpret_cast<const FlowFileHeader*>(mapping);
+    ASSERT_WITH_MSG(header->version == FlowFileHeader::kVersion, 
+                    "Weight file [" << path << "] of version " 
+                    << header->version << ", expected " 
+                    << FlowFileHeader::kVersion)
+    ASSERT_WITH_MSG(header->data_size + sizeof(FlowFileHeader) 
+                    == mapping_size, "Weight file [" << path 
+                    << "] is truncated")
+    const char* data = mapping + sizeof(FlowFileHeader);
+    ASSERT_WITH_MSG(header->compute_checksum(data) == header->checksum, 
+                    "Weight file [" << path << "] is corrupted")
+    in_dim = header->in_dim;
+    hidden_dim = header->hidden_dim;
+    num_layers = header->num_layers;
+    check_dims(path);
+    mean = header->mean;
+    var = header->var;
+    weights = new double*[num_layers];
+    uint64_t offset = 0;
+    for (int w = 0; w < num_layers; ++ w) {
+      ASSERT_WITH_MSG(offset + layer_bytes(w) <= header->data_size, 
+                      "Weight file [" << path << "] is truncated")
+      weights[w] = const_cast<double*>(
+                     reinterpret_cast<const double*>(data + offset));
+      offset = aligned_size(offset + layer_bytes(w));
+    }
+  }
+
+  // Round the layers taking hidden units to the precision. Columns are 
+  // scaled to the largest weights, which map to 1 in floats and 127 in int8.
+  void quantize() {
+    float_weights.resize(num_layers);
+    int8_weights.resize(num_layers);
+    scales.resize(num_layers);
+    double top = precision == kFloatPrecision ? 1 : 127;
+    for (int w = 1; w < num_layers; ++ w) {
+      int n = rows(w), m = cols(w);
+      scales[w].resize(m);
+      if (precision == kFloatPrecision) {
+        float_weights[w].resize(n * m);
+      } else {
+        int8_weights[w].resize(n * m);
       }
+      for (int j = 0; j < m; ++ j) {
+        double max_weight = 0;
+        for (int i = 0; i < n; ++ i) {
+          max_weight = std::max(max_weight, std::fabs(weights[w][i * m + j]));
+        }
+        double scale = max_weight > 0 ? max_weight / top : 1;
+        scales[w][j] = scale;
+        for (int i = 0; i < n; ++ i) {
+          double weight = weights[w][i * m + j] / scale;
+          if (precision == kFloatPrecision) {
+            float_weights[w][i * m + j] = weight;
+          } else {
+            int8_weights[w][i * m + j] = static_cast<int8_t>(
+              std::lround(weight));
+          }
+        }
+      }
+    }
+  }
+
+  // The 'in_dim' inputs of a normalized key, for all precisions
+  inline void key_inputs(double key, double* inputs) const {
+    inputs[0] = key;
+    if (in_dim == 2) {
+      inputs[1] = key - std::floor(key);
     } else if (in_dim == 4) {
-      for (uint32_t i = 0; i < size; ++ i) {
-        inputs[4 * i] = tran_kvs[i].first;
-        inputs[4 * i + 1] = std::floor(inputs[2 * i]);
-        double tmp = (tran_kvs[i].first - inputs[4 * i + 1]) * 1000000;
-        inputs[4 * i + 2] = std::floor(tmp);
-        inputs[4 * i + 3] = tmp - inputs[4 * i + 2];
+      inputs[1] = std::floor(key);
+      double tmp = (key - inputs[1]) * 1000000;
+      inputs[2] = std::floor(tmp);
+      inputs[3] = tmp - inputs[2];
+    }
+  }
+
+  // Hidden layers in floats, with weights in floats or in int8, 'kLanes'
+  // keys at a time with a lane per key, and the keys left one by one. The
+  // first layer takes the keys in doubles, and the scales of columns and the
+  // outputs are applied in doubles. Lanes don't interact and take the same
+  // operations at any width, so a key is transformed alike alone or in a 
+  // batch.
+  template<typename W>
+  __attribute__((noinline)) void reduced_forward(KKVT* tran_kvs, 
+                                                 uint32_t size) const {
+    uint32_t l = 0;
+    for (; l + kLanes <= size; l += kLanes) {
+      reduced_pass<W, kLanes>(tran_kvs + l);
+    }
+    for (; l < size; ++ l) {
+      reduced_pass<W, 1>(tran_kvs + l);
+    }
+  }
+
+  template<typename W, uint32_t L>
+  inline void reduced_pass(KKVT* tran_kvs) const {
+    typedef VecMath<L, float> F;
+    typedef VecMath<L, double> D;
+    typename D::D x[4];
+    typename F::D h[kMaxReducedHidden];
+    typename D::D g[kMaxReducedHidden];
+    double inputs[L][4];
+    double lanes[4][L];
+    for (uint32_t k = 0; k < L; ++ k) {
+      key_inputs(tran_kvs[k].first, inputs[k]);
+    }
+    for (int i = 0; i < in_dim; ++ i) {
+      for (uint32_t k = 0; k < L; ++ k) {
+        lanes[i][k] = inputs[k][i];
+      }
+      memcpy(&x[i], lanes[i], sizeof(x[i]));
+    }
+    for (int j = 0; j < hidden_dim; ++ j) {
+      typename D::D sum = {};
+      for (int i = 0; i < in_dim; ++ i) {
+        sum += x[i] * weights[0][i * hidden_dim + j];
+      }
+      h[j] = F::tanh(__builtin_convertvector(sum, typename F::D));
+    }
+    for (int w = 1; w < num_layers - 1; ++ w) {
+      for (int j = 0; j < hidden_dim; ++ j) {
+        g[j] = reduced_unit<W, L>(h, w, j);
+      }
+      for (int j = 0; j < hidden_dim; ++ j) {
+        h[j] = F::tanh(__builtin_convertvector(g[j], typename F::D));
+      }
+    }
+    typename D::D out = {};
+    for (int j = 0; j < in_dim; ++ j) {
+      out += reduced_unit<W, L>(h, num_layers - 1, j);
+    }
+    memcpy(lanes[0], &out, sizeof(out));
+    for (uint32_t k = 0; k < L; ++ k) {
+      tran_kvs[k].first = lanes[0][k];
+    }
+  }
+
+  // The 'j'-th unit of layer 'w' before activation, over the lanes
+  template<typename W, uint32_t L>
+  inline typename VecMath<L, double>::D reduced_unit(
+      const typename VecMath<L, float>::D* h, int w, int j) const {
+    typename VecMath<L, float>::D sum = {};
+    int m = cols(w);
+    if (std::is_same<W, float>::value) {
+      const float* ws = float_weights[w].data();
+      for (int i = 0; i < hidden_dim; ++ i) {
+        sum += h[i] * ws[i * m + j];
       }
     } else {
-      std::cout << "Unsupported dimensions\t" << in_dim << std::endl;
-      exit(-1);
+      const int8_t* qs = int8_weights[w].data();
+      for (int i = 0; i < hidden_dim; ++ i) {
+        sum += h[i] * static_cast<float>(qs[i * m + j]);
+      }
+    }
+    return __builtin_convertvector(sum, typename VecMath<L, double>::D)
+           * scales[w][j];
+  }
+
+  // The shapes we ship have kernels, add others here
+  static Kernel select_kernel(int in_dim, int hidden_dim) {
+    if (in_dim == 1 && hidden_dim == 2) {
+      return &BNAF_Infer<KT, VT>::fused_forward<1, 2>;
+    } else if (in_dim == 2 && hidden_dim == 2) {
+      return &BNAF_Infer<KT, VT>::fused_forward<2, 2>;
+    } else if (in_dim == 2 && hidden_dim == 4) {
+      return &BNAF_Infer<KT, VT>::fused_forward<2, 4>;
+    }
+    return nullptr;
+  }
+
+  // Push keys one by one through the layers in SSE registers, a pair of
+  // hidden units per register, with the tanh fused into the products. No 
+  // scratch space is touched, so a single key takes tens of nanoseconds
+  // instead of the calls of the backend. Not inlined, so all paths run one
+  // code.
+  template<int IN, int HID>
+  __attribute__((noinline)) void fused_forward(KKVT* tran_kvs, 
+                                               uint32_t size) const {
+    static_assert((IN == 1 || IN == 2) && HID % 2 == 0, "Unsupported shape");
+    const int H = HID / 2;
+    const double* w_in = weights[0];
+    const double* w_out = weights[num_layers - 1];
+    for (uint32_t k = 0; k < size; ++ k) {
+      double x[2] = {tran_kvs[k].first, 0};
+      if (IN == 2) {
+        x[1] = x[0] - std::floor(x[0]);
+      }
+      __m128d h[H];
+      for (int j = 0; j < H; ++ j) {
+        h[j] = _mm_setzero_pd();
+        for (int i = 0; i < IN; ++ i) {
+          h[j] = _mm_add_pd(h[j], _mm_mul_pd(_mm_set1_pd(x[i]), 
+                            _mm_load_pd(w_in + i * HID + 2 * j)));
+        }
+        h[j] = (__m128d)VecMath<2>::tanh((VecMath<2>::D)h[j]);
+      }
+      for (int l = 1; l < num_layers - 1; ++ l) {
+        __m128d g[H];
+        for (int j = 0; j < H; ++ j) {
+          g[j] = _mm_setzero_pd();
+          for (int i = 0; i < HID; ++ i) {
+            g[j] = _mm_add_pd(g[j], _mm_mul_pd(unit(h, i), 
+                              _mm_load_pd(weights[l] + i * HID + 2 * j)));
+          }
+        }
+        for (int j = 0; j < H; ++ j) {
+          h[j] = (__m128d)VecMath<2>::tanh((VecMath<2>::D)g[j]);
+        }
+      }
+      // The outputs of the last layer are summed up, as in 'prepare_outputs'
+      __m128d out = _mm_setzero_pd();
+      if (IN == 2) {
+        for (int i = 0; i < HID; ++ i) {
+          out = _mm_add_pd(out, _mm_mul_pd(unit(h, i), 
+                                           _mm_load_pd(w_out + i * 2)));
+        }
+      } else {
+        for (int j = 0; j < H; ++ j) {
+          out = _mm_add_pd(out, _mm_mul_pd(h[j], _mm_load_pd(w_out + 2 * j)));
+        }
+      }
+      tran_kvs[k].first = _mm_cvtsd_f64(_mm_add_sd(out, 
+                                        _mm_unpackhi_pd(out, out)));
+    }
+  }
+
+  // The 'i'-th hidden unit in both lanes
+  static inline __m128d unit(const __m128d* h, int i) {
+    return i & 1 ? _mm_unpackhi_pd(h[i >> 1], h[i >> 1]) 
+                 : _mm_unpacklo_pd(h[i >> 1], h[i >> 1]);
+  }
+
+  void prepare_inputs(const KKVT* tran_kvs, uint32_t size, 
+                      double* inputs) const {
+    for (uint32_t i = 0; i < size; ++ i) {
+      key_inputs(tran_kvs[i].first, inputs + in_dim * i);
     }
   }
 
-  void prepare_outputs(KKVT* tran_kvs, uint32_t size) {
+  void prepare_outputs(KKVT* tran_kvs, uint32_t size, 
+                       const double* inputs) const {
     if (in_dim == 1) {
       for (uint32_t i = 0; i < size; ++ i) {
         tran_kvs[i] = {inputs[i], tran_kvs[i].second};
@@ -131,48 +621,39 @@ private:
     }
   }
 
-  void forward() {
+  void forward(int batch_size, Workspace& ws) const {
+    double* inputs = ws.inputs;
+    double** outputs = ws.outputs;
     // print_outputs(-1, inputs, batch_size, in_dim);
-    // Compute the formula: 
-    //            alpha * mat_a [m * k] * mat_b [k * n] + beta * mat_c [m * n]
-    // cblas_dgemm(layout, trans_a, trans_b, m, n, k, alpha, mat_a, lda, 
-    //              mat_b, ldb, beta, mat_c, ldc)
     // IN [batch_size * in_dim] * W_0 [in_dim * hidden_dim] = 
     // OUT [batch_size * hidden_dim]
-    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-                batch_size, hidden_dim, in_dim, 
-                1, inputs, in_dim, 
-                weights[0], hidden_dim, 
-                0, outputs[0], hidden_dim);
+    backend->gemm(batch_size, hidden_dim, in_dim, inputs, weights[0], 
+                  outputs[0]);
     // print_weight_matrix(0);
     // print_outputs(0, outputs[0], batch_size, hidden_dim);
-    vdTanh(batch_size * hidden_dim, outputs[0], outputs[1]);
+    backend->tanh(static_cast<uint64_t>(batch_size) * hidden_dim, outputs[0], 
+                  outputs[1]);
     // print_outputs(0, outputs[1], batch_size, hidden_dim);
     for (int i = 1; i < num_layers - 1; ++ i) {
       // IN [batch_size * hidden_dim] * W_i [hidden_dim * hidden_dim] = 
       // OUT [batch_size * hidden_dim]
-      cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-                  batch_size, hidden_dim, hidden_dim, 
-                  1, outputs[1], hidden_dim, 
-                  weights[i], hidden_dim, 
-                  0, outputs[0], hidden_dim);
+      backend->gemm(batch_size, hidden_dim, hidden_dim, outputs[1], 
+                    weights[i], outputs[0]);
       // print_weight_matrix(i);
       // print_outputs(i, outputs[0], batch_size, hidden_dim);      
-      vdTanh(batch_size * hidden_dim, outputs[0], outputs[1]);
+      backend->tanh(static_cast<uint64_t>(batch_size) * hidden_dim, 
+                    outputs[0], outputs[1]);
       // print_outputs(i, outputs[1], batch_size, hidden_dim);      
     }
     // IN [batch_size * hidden_dim] * W_L [hidden_dim * in_dim] = 
     // OUT [batch_size * in_dim]
-    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, 
-                batch_size, in_dim, hidden_dim, 
-                1, outputs[1], hidden_dim, 
-                weights[num_layers - 1], in_dim, 
-                0, inputs, in_dim);
+    backend->gemm(batch_size, in_dim, hidden_dim, outputs[1], 
+                  weights[num_layers - 1], inputs);
     // print_weight_matrix(num_layers);
     // print_outputs(num_layers, inputs, batch_size, in_dim);
   }
 
-  void print_weight_matrix(int l) {
+  void print_weight_matrix(int l) const {
     if (l == 0) {
       std::cout << std::fixed << "Weight (0)" << std::endl;
       for (int i = 0; i < in_dim; ++ i) {
@@ -200,7 +681,7 @@ private:
     }
   }
 
-  void print_outputs(int idx, double* outputs, int num_rows, int num_columns) {
+  void print_outputs(int idx, double* outputs, int num_rows, int num_columns) const {
     if (idx == -1) {
       std::cout << "Input" << std::endl;
     } else {
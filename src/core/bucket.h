@@ -1,19 +1,26 @@
 #ifndef BUCKET_PARA_H
 #define BUCKET_PARA_H
 
+#include "core/kv_pair.h"
 #include "core/common.h"
 
 namespace aflipara {
 
 template<typename KT, typename VT>
 class Bucket {
-typedef std::pair<KT, VT> KVT;
+typedef KVPair<KT, VT> KVT;
 public:
+  // Arrays of compact pairs grow on inserts instead of taking the capacity 
+  // at once, since most buckets hold a few pairs
+  static const bool kCompact = sizeof(KVT) <= sizeof(uint64_t);
+
   int node_id;
   int idx;
   KVT* data;
   uint8_t size;
   volatile uint8_t status = 0;
+  uint8_t alloc_size;   // The number of allocated pairs
+  uint32_t ref = 0;     // The arena reference of narrow slots
 
 public:
   Bucket() = delete;
@@ -26,6 +33,9 @@ public:
   
   bool find(KT key, VT& value);
   bool update(KVT kv);
+  bool exchange(KVT kv, VT& old);
+  template<typename Fn>
+  bool modify(KT key, Fn& fn);
   bool remove(KT key);
   bool insert(KVT kv, const uint32_t capacity);
 
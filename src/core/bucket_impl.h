@@ -9,7 +9,8 @@ template<typename KT, typename VT>
 Bucket<KT, VT>::Bucket(const KVT* kvs, uint32_t s, const uint32_t capacity, 
                        int a, int b) {
   size = s;
-  data = new KVT[capacity + 1];
+  alloc_size = kCompact ? std::max(s, 2U) : capacity + 1;
+  data = new KVT[alloc_size];
   node_id = a;
   idx = b;
   for (uint32_t i = 0; i < s; ++ i) {
@@ -31,7 +32,7 @@ uint8_t Bucket<KT, VT>::get_size() {
 }
 
 template<typename KT, typename VT>
-std::pair<KT, VT>* Bucket<KT, VT>::copy() {
+KVPair<KT, VT>* Bucket<KT, VT>::copy() {
   KVT* kvs = new KVT[size];
   for (uint32_t i = 0; i < size; ++ i) {
     kvs[i] = data[i];
@@ -65,6 +66,33 @@ bool Bucket<KT, VT>::update(KVT kv) {
   return found;
 }
 
+template<typename KT, typename VT>
+bool Bucket<KT, VT>::exchange(KVT kv, VT& old) {
+  for (uint8_t i = 0; i < size; ++ i) {
+    if (equal(data[i].first, kv.first)) {
+      old = data[i].second;
+      data[i].second = kv.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+template<typename KT, typename VT>
+template<typename Fn>
+bool Bucket<KT, VT>::modify(KT key, Fn& fn) {
+  for (uint8_t i = 0; i < size; ++ i) {
+    if (equal(data[i].first, key)) {
+      VT value = data[i].second;
+      if (fn(value)) {
+        data[i].second = value;
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
 template<typename KT, typename VT>
 bool Bucket<KT, VT>::remove(KT key) {
   bool found = false;
@@ -82,6 +110,14 @@ bool Bucket<KT, VT>::remove(KT key) {
 
 template<typename KT, typename VT>
 bool Bucket<KT, VT>::insert(KVT kv, const uint32_t capacity) {
+  if (size == alloc_size) {
+    // Entries are locked while buckets are read
+    alloc_size = std::min(alloc_size * 2U, capacity + 1);
+    KVT* new_data = new KVT[alloc_size];
+    std::copy(data, data + size, new_data);
+    delete[] data;
+    data = new_data;
+  }
   data[size] = kv;
   size ++;
   bool need_rebuild = !(size < capacity);
@@ -34,6 +34,7 @@
 #include <string>
 #include <time.h>
 #include <thread>
+#include <type_traits>
 #include <vector>
 #include <unistd.h>
 
@@ -93,6 +94,18 @@ inline uint8_t cmpxchgb(uint8_t *object, uint8_t expected,
   return expected;
 }
 
+// Compare and swap 16 aligned bytes, 'expected' is reloaded on failure
+inline bool cmpxchg16b(void *object, uint64_t *expected,
+                       const uint64_t *desired) {
+  bool res;
+  asm volatile("lock; cmpxchg16b %1; setz %0"
+               : "=q"(res), "+m"(*(volatile __int128 *)object),
+                 "+a"(expected[0]), "+d"(expected[1])
+               : "b"(desired[0]), "c"(desired[1])
+               : "cc", "memory");
+  return res;
+}
+
 volatile uint8_t out_locked = 0;
 
 void lock_stdout() {
@@ -119,10 +132,10 @@ const int kINF = 0x7fffffff;
 // Help functions
 template<typename T>
 inline bool equal(const T& a, const T& b) {
-  if (std::numeric_limits<T>::is_integer) {
-    return a == b;
-  } else {
+  if constexpr (std::is_floating_point<T>::value) {
     return std::fabs(a - b) < std::numeric_limits<T>::epsilon();
+  } else {
+    return a == b;
   }
 }
 
@@ -1,6 +1,8 @@
 #ifndef CONFLICTS_PARA_H
 #define CONFLICTS_PARA_H
 
+#include "core/key_codec.h"
+#include "core/kv_pair.h"
 #include "core/linear_model.h"
 #include "core/common.h"
 
@@ -32,9 +34,12 @@ struct ConflictsInfo {
   }
 };
 
-template<typename KT, typename VT>
-ConflictsInfo* build_linear_model(const std::pair<KT, VT>* kvs, uint32_t size,
-                                  LinearModel*& model, double size_amp=1) {
+template<typename P, typename KT=PairKey<P>>
+ConflictsInfo* build_linear_model(const P* kvs, uint32_t size,
+                                  LinearModel*& model, double size_amp=1, 
+                                  const typename KeyCodec<KT>::Prefix& prefix 
+                                    = typename KeyCodec<KT>::Prefix()) {
+  typedef KeyCodec<KT> Codec;
   if (model != nullptr) {
     model->slope = model->intercept = 0;
   } else {
@@ -48,10 +53,11 @@ ConflictsInfo* build_linear_model(const std::pair<KT, VT>* kvs, uint32_t size,
                   << max_key << "], Size: " << size 
                   << ", all keys used to build the linear model are the same.")
   int64_t capacity = static_cast<int64_t>(size * size_amp);
-  double key_space = (max_key - min_key) / static_cast<double>(capacity);
+  double key_space = Codec::distance(max_key, min_key, prefix) 
+                     / static_cast<double>(capacity);
   LinearModelBuilder builder;
   for (uint32_t i = 0; i < size; ++ i) {
-    double key = (kvs[i].first - min_key) / key_space;
+    double key = Codec::distance(kvs[i].first, min_key, prefix) / key_space;
     // double key = kvs[i].first;
     double y = i;
     builder.add(key, y);
@@ -66,17 +72,26 @@ ConflictsInfo* build_linear_model(const std::pair<KT, VT>* kvs, uint32_t size,
     // y = k * z + b
     // z = (x - u) / s
     // y = k * (x - u) / s + b = (k / s) * x - k * u / s + b
+    double min_code = Codec::encode(min_key, prefix);
+    double max_code = Codec::encode(max_key, prefix);
     model->slope = model->slope / key_space;
-    model->intercept = -model->slope * min_key + 0.5;
-    ASSERT_WITH_MSG(model->predict(min_key) == 0, 
+    model->intercept = -model->slope * min_code + 0.5;
+    // The half slot is lost in the rounding of keys beyond 2^52, so the 
+    // intercept is moved by ulps until the first key is predicted at zero
+    for (uint32_t i = 0; i < 64 && model->predict(min_code) != 0; ++ i) {
+      model->intercept = std::nextafter(model->intercept, 
+                                        model->predict(min_code) > 0 
+                                        ? -INFINITY : INFINITY);
+    }
+    ASSERT_WITH_MSG(model->predict(min_code) == 0, 
                     "The first prediction must be zero")
-    int64_t predicted_size = model->predict(max_key) + 1;
+    int64_t predicted_size = model->predict(max_code) + 1;
     if (predicted_size > 1) {
       capacity = std::min(predicted_size, capacity);
     }
-    int64_t first_pos = std::min(std::max(model->predict(min_key), 0L), 
+    int64_t first_pos = std::min(std::max(model->predict(min_code), 0L), 
                                           capacity - 1);
-    int64_t last_pos = std::min(std::max(model->predict(max_key), 0L), 
+    int64_t last_pos = std::min(std::max(model->predict(max_code), 0L), 
                                          capacity - 1);
     if (last_pos == first_pos) {
       // Model fails to predict since all predicted positions are rounded to 
@@ -85,13 +100,13 @@ ConflictsInfo* build_linear_model(const std::pair<KT, VT>* kvs, uint32_t size,
                 << "] is the same as the first predicted position [" 
                 << first_pos << "]");
       model->slope = size / key_space;
-      model->intercept = -model->slope * min_key + 0.5;
+      model->intercept = -model->slope * min_code + 0.5;
     }
     ConflictsInfo* ci = new ConflictsInfo(size, capacity);
     int64_t p_last = first_pos;
     uint32_t conflict = 1;
     for (uint32_t i = 1; i < size; ++ i) {
-      double key = kvs[i].first;
+      double key = Codec::encode(kvs[i].first, prefix);
       int64_t p = std::min(std::max(model->predict(key), 0L), capacity - 1);
       if (p == p_last) {
         conflict ++;
@@ -108,12 +123,12 @@ ConflictsInfo* build_linear_model(const std::pair<KT, VT>* kvs, uint32_t size,
   }
 }
 
-template<typename KT, typename VT>
-uint32_t compute_tail_conflicts(const std::pair<KT, VT>* kvs, uint32_t size, 
+template<typename P>
+uint32_t compute_tail_conflicts(const P* kvs, uint32_t size, 
                                 double size_amp, float kTailPercent=0.99) {
   // The input keys should be ordered
   LinearModel* model = new LinearModel();
-  ConflictsInfo* ci = build_linear_model<KT, VT>(kvs, size, model, size_amp);
+  ConflictsInfo* ci = build_linear_model(kvs, size, model, size_amp);
   delete model;
 
   if (ci->num_conflicts == 0) {
@@ -0,0 +1,122 @@
+#ifndef FROZEN_AFLI_PARA_H
+#define FROZEN_AFLI_PARA_H
+
+#include "core/append_tail_impl.h"
+#include "core/common.h"
+
+namespace aflipara {
+
+// An immutable copy of AFLIPara for read-only phases. Nodes, slot types,
+// slots and bucket pairs are placed in four arrays in breadth-first order,
+// and slots refer to child nodes and buckets by their offsets in the arrays
+// instead of pointers. Nodes keep the models of the mutable tree, so keys are
+// located in the same slots, while buckets take exactly their sizes and
+// slots have no locks. The sealed segments of the append tail are frozen as
+// more top nodes, and its open segment as a sorted array.
+//
+// With compression, keys of a slot share the high bits of the smallest key
+// predicted to the slot, which is the base computed from the inverse of the
+// model. So 64-bit integer keys are stored as 32-bit deltas to the bases
+// where they fit. Such nodes put the values or references of slots and the
+// deltas in two arrays in 'blocks', and such buckets put their values and
+// deltas likewise, where the deltas are compared by SIMD.
+template<typename KT, typename VT>
+class FrozenAFLIPara {
+typedef KVPair<KT, VT> KVT;
+// Bucket references take 64 bits unless slots are narrower
+typedef typename std::conditional<(sizeof(KVT) >= sizeof(uint64_t)),
+                                  uint64_t, uint32_t>::type Ref;
+public:
+  static const uint32_t kSizeBits = 3;    // Buckets hold at most 7 pairs
+  static const uint32_t kFlagBits = 4;    // The size and whether the bucket is delta encoded
+  static const uint32_t kPadWords = 4;    // Deltas are loaded in 32 bytes
+  // Pairs of 16 bytes shrink to 12 bytes
+  static const bool kDelta = std::is_integral<KT>::value
+                             && sizeof(KT) == sizeof(uint64_t)
+                             && sizeof(VT) <= sizeof(uint64_t)
+                             && sizeof(KVT) > sizeof(uint64_t)
+                                              + sizeof(int32_t);
+
+  struct Node {
+    LinearModel               model;
+    double                    inv_slope;  // Map slots back to their base keys
+    typename KeyCodec<KT>::Prefix prefix;
+    bool                      delta;      // Whether the slots are delta encoded
+    uint32_t                  capacity;
+    uint32_t                  offset;     // The first slot in 'slots', or the first word in 'blocks' if delta encoded
+    uint32_t                  type_offset; // The first slot type in 'types'
+  };
+
+  union Slot {
+    KVT                       kv;
+    uint32_t                  child;      // The index of the child in 'nodes'
+    Ref                       bucket;     // The offset, the encoding and the size of the bucket
+
+    // Slots are raw bytes whichever member is active
+    Slot() {
+      memset(static_cast<void*>(this), 0, sizeof(Slot));
+    }
+
+    Slot& operator=(const Slot& o) {
+      memcpy(static_cast<void*>(this), static_cast<const void*>(&o), 
+             sizeof(Slot));
+      return *this;
+    }
+  };
+
+  std::vector<Node>           nodes;      // The root is the first node
+  std::vector<uint8_t>        types;      // Two bits per slot
+  uint64_t                    num_types;
+  std::vector<Slot>           slots;
+  std::vector<KVT>            pairs;
+  std::vector<uint64_t>       blocks;     // Delta encoded nodes and buckets
+  uint64_t                    num_keys;
+  bool                        compress;
+  // The append tail, empty if the index is not in the append mode
+  bool                        has_tail;
+  KT                          max_key;    // The maximum key covered by the root
+  std::vector<KT>             seg_max_keys;
+  std::vector<uint32_t>       seg_nodes;  // The top nodes of sealed segments
+  std::vector<KVT>            buffer;     // The open segment, sorted by keys
+
+public:
+  // The index must not be modified while freezing, pending rebuilds are
+  // waited by the entry locks
+  explicit FrozenAFLIPara(TNodePara<KT, VT>* root, AppendTail<KT, VT>* tail,
+                          bool compress=false);
+
+  bool find(KT key, VT& value) const;
+  uint32_t multi_get(const KT* keys, uint32_t num_keys, VT* values,
+                     bool* found) const;
+  inline uint64_t size() const { return num_keys; }
+
+  uint64_t model_size() const;
+  uint64_t index_size() const;
+
+private:
+  uint32_t freeze_node(TNodePara<KT, VT>* node,
+                       std::map<TNodePara<KT, VT>*, uint32_t>& ids,
+                       std::queue<TNodePara<KT, VT>*>& queue);
+  void freeze_slots(TNodePara<KT, VT>* node, uint32_t id,
+                    std::map<TNodePara<KT, VT>*, uint32_t>& ids,
+                    std::queue<TNodePara<KT, VT>*>& queue);
+  Ref freeze_bucket(Bucket<KT, VT>* bucket, const KT& base);
+  bool find_in_node(uint32_t id, const KT& key, VT& value) const;
+  bool find_in_bucket(Ref ref, const KT& base, const KT& key,
+                      VT& value) const;
+  inline uint8_t slot_type(uint64_t s) const;
+  inline void set_slot_type(uint64_t s, uint8_t type);
+
+  // The smallest key predicted to the slot, roughly
+  static inline KT base_of(const Node& node, uint32_t idx);
+  // Deltas wrap around, so equal deltas mean equal keys
+  static inline bool delta_of(const KT& key, const KT& base, int32_t& delta);
+  // The first position of the delta in 'n' deltas, 'n' if absent
+  static inline uint32_t match(const int32_t* deltas, uint32_t n,
+                               int32_t delta);
+  inline const int32_t* deltas_of(uint64_t block, uint32_t n) const;
+};
+
+}
+
+#endif
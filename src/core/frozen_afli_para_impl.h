@@ -0,0 +1,353 @@
+#ifndef FROZEN_AFLI_PARA_IMPL_H
+#define FROZEN_AFLI_PARA_IMPL_H
+
+#include "core/frozen_afli_para.h"
+
+namespace aflipara {
+
+template<typename KT, typename VT>
+FrozenAFLIPara<KT, VT>::FrozenAFLIPara(TNodePara<KT, VT>* root,
+                                       AppendTail<KT, VT>* tail, bool c) {
+  num_types = 0;
+  num_keys = 0;
+  compress = c && kDelta;
+  has_tail = tail != nullptr;
+  std::map<TNodePara<KT, VT>*, uint32_t> ids;
+  std::queue<TNodePara<KT, VT>*> queue;
+  freeze_node(root, ids, queue);
+  if (has_tail) {
+    max_key = tail->max_key;
+    for (uint32_t i = 0; i < tail->num_segments; ++ i) {
+      seg_max_keys.push_back(tail->seg_max_keys[i]);
+      seg_nodes.push_back(freeze_node(tail->segments[i], ids, queue));
+    }
+    buffer.assign(tail->data, tail->data + tail->size);
+    num_keys += buffer.size();
+  }
+  // Top nodes are numbered first, then nodes are numbered and placed level
+  // by level
+  while (!queue.empty()) {
+    TNodePara<KT, VT>* node = queue.front();
+    queue.pop();
+    freeze_slots(node, ids[node], ids, queue);
+  }
+  if (compress) {
+    blocks.resize(blocks.size() + kPadWords, 0);
+  }
+}
+
+template<typename KT, typename VT>
+bool FrozenAFLIPara<KT, VT>::find(KT key, VT& value) const {
+  if (has_tail && key > max_key) {
+    uint32_t l = std::lower_bound(seg_max_keys.begin(), seg_max_keys.end(),
+                                  key) - seg_max_keys.begin();
+    if (l < seg_nodes.size()) {
+      return find_in_node(seg_nodes[l], key, value);
+    }
+    auto it = std::lower_bound(buffer.begin(), buffer.end(), key,
+      [](const KVT& kv, const KT& k) {
+        return kv.first < k;
+    });
+    if (it != buffer.end() && equal(it->first, key)) {
+      value = it->second;
+      return true;
+    }
+    return false;
+  }
+  return find_in_node(0, key, value);
+}
+
+template<typename KT, typename VT>
+uint32_t FrozenAFLIPara<KT, VT>::multi_get(const KT* keys, uint32_t n,
+                                           VT* values, bool* found) const {
+  uint32_t num_found = 0;
+  for (uint32_t i = 0; i < n; ++ i) {
+    found[i] = find(keys[i], values[i]);
+    num_found += found[i];
+  }
+  return num_found;
+}
+
+template<typename KT, typename VT>
+uint64_t FrozenAFLIPara<KT, VT>::model_size() const {
+  return sizeof(Node) * nodes.size();
+}
+
+template<typename KT, typename VT>
+uint64_t FrozenAFLIPara<KT, VT>::index_size() const {
+  return sizeof(FrozenAFLIPara<KT, VT>) + sizeof(Node) * nodes.size()
+       + types.size() + sizeof(Slot) * slots.size()
+       + sizeof(KVT) * (pairs.size() + buffer.size())
+       + sizeof(uint64_t) * blocks.size()
+       + (sizeof(KT) + sizeof(uint32_t)) * seg_nodes.size();
+}
+
+template<typename KT, typename VT>
+uint32_t FrozenAFLIPara<KT, VT>::freeze_node(TNodePara<KT, VT>* node,
+    std::map<TNodePara<KT, VT>*, uint32_t>& ids,
+    std::queue<TNodePara<KT, VT>*>& queue) {
+  auto it = ids.find(node);
+  if (it != ids.end()) {
+    return it->second;
+  }
+  ASSERT_WITH_MSG(node->model != nullptr, "Nodes without models are not "
+                  << "supported")
+  uint32_t id = nodes.size();
+  Node frozen;
+  frozen.model = *node->model;
+  frozen.inv_slope = frozen.model.slope != 0 ? 1. / frozen.model.slope : 0;
+  frozen.prefix = node->prefix;
+  frozen.delta = false;
+  frozen.capacity = node->capacity;
+  frozen.offset = 0;
+  frozen.type_offset = 0;
+  nodes.push_back(frozen);
+  ids[node] = id;
+  queue.push(node);
+  return id;
+}
+
+template<typename KT, typename VT>
+void FrozenAFLIPara<KT, VT>::freeze_slots(TNodePara<KT, VT>* node,
+    uint32_t id, std::map<TNodePara<KT, VT>*, uint32_t>& ids,
+    std::queue<TNodePara<KT, VT>*>& queue) {
+  uint32_t capacity = node->capacity;
+  // Slots under rebuilding are locked until the rebuilds finish
+  for (uint32_t i = 0; i < capacity; ++ i) {
+    node->lock_entry(i);
+    node->unlock_entry(i);
+  }
+  // Slots are delta encoded if the keys of all data slots fit
+  bool delta = compress;
+  for (uint32_t i = 0; i < capacity && delta; ++ i) {
+    int32_t d = 0;
+    delta = node->entry_type(i) != kData
+            || delta_of(node->entries[i].kv.first, base_of(nodes[id], i), d);
+  }
+  uint64_t offset = delta ? blocks.size() : slots.size();
+  ASSERT_WITH_MSG(offset <= std::numeric_limits<uint32_t>::max(),
+                  "Too many slots to freeze")
+  nodes[id].delta = delta;
+  nodes[id].offset = offset;
+  nodes[id].type_offset = num_types;
+  num_types += capacity;
+  types.resize((num_types + 3) / 4, 0);
+  if (delta) {
+    blocks.resize(offset + capacity + (capacity + 1) / 2, 0);
+  } else {
+    slots.resize(offset + capacity);
+  }
+  for (uint32_t i = 0; i < capacity; ++ i) {
+    uint8_t type = node->entry_type(i);
+    Slot slot;
+    int32_t d = 0;
+    if (type == kData) {
+      slot.kv = node->entries[i].kv;
+      if (delta) {
+        delta_of(slot.kv.first, base_of(nodes[id], i), d);
+        memcpy(&slot.bucket, &slot.kv.second, sizeof(VT));
+      }
+      num_keys ++;
+    } else if (type == kBucket) {
+      KT base = compress ? base_of(nodes[id], i) : KT();
+      slot.bucket = freeze_bucket(node->entries[i].get_bucket(node->arenas), 
+                                  base);
+    } else if (type == kNode) {
+      slot.child = freeze_node(node->entries[i].get_child(node->arenas), ids, 
+                               queue);
+    }
+    // Blocks are written after the buckets are appended
+    if (delta) {
+      blocks[offset + i] = slot.bucket;
+      const_cast<int32_t*>(deltas_of(offset, capacity))[i] = d;
+    } else {
+      slots[offset + i] = slot;
+    }
+    set_slot_type(nodes[id].type_offset + i, type);
+  }
+}
+
+template<typename KT, typename VT>
+typename FrozenAFLIPara<KT, VT>::Ref
+FrozenAFLIPara<KT, VT>::freeze_bucket(Bucket<KT, VT>* bucket,
+                                      const KT& base) {
+  uint32_t size = bucket->get_size();
+  ASSERT_WITH_MSG(size < (1U << kSizeBits), "Too large buckets to freeze")
+  std::vector<KVT> kvs(bucket->data, bucket->data + size);
+  std::sort(kvs.begin(), kvs.end(),
+    [](auto const& a, auto const& b) {
+      return a.first < b.first;
+  });
+  num_keys += size;
+  const uint64_t kMaxOffset = 1ULL << (sizeof(Ref) * 8 - kFlagBits);
+  // The values and the deltas take 12 bytes per pair
+  bool delta = compress && size > 1;
+  std::vector<int32_t> deltas(size);
+  for (uint32_t i = 0; i < size && delta; ++ i) {
+    delta = delta_of(kvs[i].first, base, deltas[i]);
+  }
+  if (delta) {
+    uint64_t block = blocks.size();
+    ASSERT_WITH_MSG(block < kMaxOffset, "Too many blocks to freeze")
+    blocks.resize(block + size + (size + 1) / 2, 0);
+    for (uint32_t i = 0; i < size; ++ i) {
+      memcpy(&blocks[block + i], &kvs[i].second, sizeof(VT));
+    }
+    memcpy(const_cast<int32_t*>(deltas_of(block, size)), deltas.data(),
+           sizeof(int32_t) * size);
+    return (static_cast<Ref>(block) << kFlagBits) | (1U << kSizeBits) | size;
+  }
+  ASSERT_WITH_MSG(pairs.size() < kMaxOffset, "Too many pairs to freeze")
+  Ref ref = (static_cast<Ref>(pairs.size()) << kFlagBits) | size;
+  pairs.insert(pairs.end(), kvs.begin(), kvs.end());
+  return ref;
+}
+
+template<typename KT, typename VT>
+bool FrozenAFLIPara<KT, VT>::find_in_node(uint32_t id, const KT& key,
+                                          VT& value) const {
+  while (true) {
+    const Node& node = nodes[id];
+    int64_t idx = node.model.predict(KeyCodec<KT>::encode(key, node.prefix));
+    idx = std::min(std::max(idx, 0L), static_cast<int64_t>(node.capacity - 1));
+    uint8_t type = slot_type(node.type_offset + idx);
+    if (type == kNone) {
+      return false;
+    }
+    if constexpr (kDelta) {
+      if (node.delta) {
+        uint64_t word = blocks[node.offset + idx];
+        if (type == kData) {
+          int32_t d = 0;
+          if (delta_of(key, base_of(node, idx), d)
+              && deltas_of(node.offset, node.capacity)[idx] == d) {
+            memcpy(&value, &word, sizeof(VT));
+            return true;
+          }
+          return false;
+        } else if (type == kBucket) {
+          return find_in_bucket(word, base_of(node, idx), key, value);
+        }
+        id = static_cast<uint32_t>(word);
+        continue;
+      }
+    }
+    const Slot& slot = slots[node.offset + idx];
+    if (type == kData) {
+      if (equal(slot.kv.first, key)) {
+        value = slot.kv.second;
+        return true;
+      }
+      return false;
+    } else if (type == kBucket) {
+      KT base = KT();
+      if constexpr (kDelta) {
+        base = (slot.bucket >> kSizeBits) & 1 ? base_of(node, idx) : base;
+      }
+      return find_in_bucket(slot.bucket, base, key, value);
+    } else {
+      id = slot.child;
+    }
+  }
+}
+
+template<typename KT, typename VT>
+bool FrozenAFLIPara<KT, VT>::find_in_bucket(Ref ref, const KT& base,
+                                            const KT& key, VT& value) const {
+  uint32_t size = ref & ((1U << kSizeBits) - 1);
+  uint64_t offset = ref >> kFlagBits;
+  if constexpr (kDelta) {
+    if ((ref >> kSizeBits) & 1) {
+      int32_t d = 0;
+      if (!delta_of(key, base, d)) {
+        return false;
+      }
+      uint32_t i = match(deltas_of(offset, size), size, d);
+      if (i < size) {
+        memcpy(&value, &blocks[offset + i], sizeof(VT));
+        return true;
+      }
+      return false;
+    }
+  }
+  // Keys are matched by 'equal' as the buckets of the mutable index, so the 
+  // scan does not stop at a larger key that is equal within the tolerance
+  const KVT* kvs = pairs.data() + offset;
+  for (uint32_t i = 0; i < size; ++ i) {
+    if (equal(kvs[i].first, key)) {
+      value = kvs[i].second;
+      return true;
+    }
+  }
+  return false;
+}
+
+template<typename KT, typename VT>
+uint8_t FrozenAFLIPara<KT, VT>::slot_type(uint64_t s) const {
+  return (types[s >> 2] >> ((s & 3) << 1)) & 3;
+}
+
+template<typename KT, typename VT>
+void FrozenAFLIPara<KT, VT>::set_slot_type(uint64_t s, uint8_t type) {
+  types[s >> 2] |= type << ((s & 3) << 1);
+}
+
+template<typename KT, typename VT>
+KT FrozenAFLIPara<KT, VT>::base_of(const Node& node, uint32_t idx) {
+  if constexpr (kDelta) {
+    // Any deterministic base works, so the bases are clamped into the key 
+    // type
+    double x = (idx - node.model.intercept) * node.inv_slope;
+    const double lo = static_cast<double>(std::numeric_limits<KT>::lowest());
+    const double hi = static_cast<double>(std::numeric_limits<KT>::max());
+    if (!(x > lo)) {
+      return std::numeric_limits<KT>::lowest();
+    } else if (x >= hi) {
+      return std::numeric_limits<KT>::max();
+    }
+    return static_cast<KT>(x);
+  } else {
+    return KT();
+  }
+}
+
+template<typename KT, typename VT>
+bool FrozenAFLIPara<KT, VT>::delta_of(const KT& key, const KT& base,
+                                      int32_t& delta) {
+  if constexpr (kDelta) {
+    int64_t d = static_cast<int64_t>(static_cast<uint64_t>(key)
+                                     - static_cast<uint64_t>(base));
+    delta = static_cast<int32_t>(d);
+    return d == delta;
+  } else {
+    return false;
+  }
+}
+
+template<typename KT, typename VT>
+uint32_t FrozenAFLIPara<KT, VT>::match(const int32_t* deltas, uint32_t n,
+                                       int32_t delta) {
+  // Buckets hold at most 7 deltas, which are loaded by two 16-byte loads,
+  // and the blocks are padded for the loads
+  __m128i d = _mm_set1_epi32(delta);
+  __m128i lo = _mm_loadu_si128((const __m128i*)deltas);
+  __m128i hi = _mm_loadu_si128((const __m128i*)(deltas + 4));
+  uint32_t mask = static_cast<uint32_t>(
+                    _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(lo, d))))
+                | (static_cast<uint32_t>(
+                    _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(hi, d))))
+                   << 4);
+  mask &= (1U << n) - 1;
+  return mask == 0 ? n : __builtin_ctz(mask);
+}
+
+template<typename KT, typename VT>
+const int32_t* FrozenAFLIPara<KT, VT>::deltas_of(uint64_t block,
+                                                 uint32_t n) const {
+  // The deltas follow the 'n' words of values or references
+  return reinterpret_cast<const int32_t*>(&blocks[block + n]);
+}
+
+}
+
+#endif
@@ -0,0 +1,255 @@
+#ifndef INFER_BACKEND_H
+#define INFER_BACKEND_H
+
+#include "core/common.h"
+
+// At most one BLAS is linked, MKL takes precedence
+#if defined(HAVE_MKL)
+#include <mkl.h>
+#include <mkl_cblas.h>
+#elif defined(HAVE_OPENBLAS)
+#include <cblas.h>
+#endif
+
+namespace aflipara {
+
+// Math over vectors of 'N' doubles (or floats), lowered by the compiler to
+// the widest registers of the target (SSE2, AVX2 or AVX-512)
+template<int N, typename T=double>
+struct VecMath {
+  typedef typename std::conditional<sizeof(T) == 8, int64_t, int32_t>::type 
+          IT;
+  typedef T D __attribute__((vector_size(N * sizeof(T))));
+  typedef IT I __attribute__((vector_size(N * sizeof(T))));
+  static const int kMantissa = sizeof(T) == 8 ? 52 : 23;
+  static const int kBias = sizeof(T) == 8 ? 1023 : 127;
+  // Taylor terms reaching an ulp
+  static const int kDegree = sizeof(T) == 8 ? 13 : 7;
+
+  static inline D splat(T x) { return D{} + x; }
+
+  // exp(x) for 0 <= x <= 44, by 2^k * exp(r) with |r| <= ln(2) / 2 and the
+  // Taylor series of exp(r), within an ulp or two
+  static inline D exp(D x) {
+    // Adding 1.5 * 2^kMantissa rounds to an integer held in the low bits
+    const D magic = splat(T(1.5) * (IT(1) << kMantissa));
+    D k = x * T(1.4426950408889634) + magic;
+    I bits = (I)k;
+    k = k - magic;
+    // ln(2) in two parts, so 'k * ln2_hi' is exact
+    const T ln2_hi = sizeof(T) == 8 ? T(6.93147180369123816490e-1) 
+                                    : T(0.693359375);
+    const T ln2_lo = sizeof(T) == 8 ? T(1.90821492927058770002e-10) 
+                                    : T(-2.12194440e-4);
+    D r = x - k * ln2_hi - k * ln2_lo;
+    static const double inv_factorials[14] = {
+      1, 1, 1. / 2, 1. / 6, 1. / 24, 1. / 120, 1. / 720, 1. / 5040, 
+      1. / 40320, 1. / 362880, 1. / 3628800, 1. / 39916800, 1. / 479001600,
+      1. / 6227020800};
+    D p = splat(T(inv_factorials[kDegree]));
+    for (int i = kDegree - 1; i >= 0; -- i) {
+      p = p * r + T(inv_factorials[i]);
+    }
+    return p * (D)((bits + kBias) << kMantissa);
+  }
+
+  // tanh(x) within a few ulps. Small inputs take the rational approximation
+  // of Cephes, larger ones 1 - 2 / (exp(2|x|) + 1), and tanh(x) is 1 in
+  // doubles beyond 22.
+  static inline D tanh(D x) {
+    // Not a splat of -0., which adds it to +0.
+    const I sign_mask = I{} + std::numeric_limits<IT>::min();
+    I sign = (I)x & sign_mask;
+    D a = (D)((I)x & ~sign_mask);
+    a = a < T(22) ? a : splat(T(22));
+    D z = a * a;
+    D p = ((z * T(-9.64399179425052238628e-1) - T(9.92877231001918586564e1)) 
+           * z - T(1.61468768441708447952e3));
+    D q = ((z + T(1.12811678491632931402e2)) * z 
+           + T(2.23548839060100448583e3)) * z + T(4.84406305325125486048e3);
+    D small = a + a * z * p / q;
+    D large = T(1) - T(2) / (exp(a + a) + T(1));
+    D res = a < T(0.625) ? small : large;
+    return (D)((I)res | sign);
+  }
+};
+
+// The primitives of flow inference. Matrices are dense and row major, and
+// buffers are zeroed and aligned to cache lines.
+class InferBackend {
+public:
+  static const uint32_t kAlign = 64;
+
+  virtual ~InferBackend() { }
+  virtual const char* name() const = 0;
+  virtual double* alloc(uint64_t n) const = 0;
+  virtual void release(double* buf) const = 0;
+  // c [m * n] = a [m * k] * b [k * n]
+  virtual void gemm(int m, int n, int k, const double* a, const double* b,
+                    double* c) const = 0;
+  // y = tanh(x), elementwise
+  virtual void tanh(uint64_t n, const double* x, double* y) const = 0;
+
+  // The backend of the name, 'nullptr' if it is not built in
+  static const InferBackend* find(const std::string& name);
+  static std::vector<const InferBackend*> all();
+  // Models are loaded with the default backend unless told otherwise. It is
+  // MKL, then OpenBLAS, then the native one, whichever is built in first.
+  static const InferBackend* get_default() { return default_slot(); }
+  static void set_default(const InferBackend* backend) {
+    default_slot() = backend;
+  }
+
+protected:
+  static const InferBackend*& default_slot();
+
+  // tanh over vectors of 8 doubles, the tail is padded
+  static void vector_tanh(uint64_t n, const double* x, double* y) {
+    typedef VecMath<8> M;
+    M::D v;
+    uint64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      memcpy(&v, x + i, sizeof(v));
+      v = M::tanh(v);
+      memcpy(y + i, &v, sizeof(v));
+    }
+    if (i < n) {
+      v = M::D{};
+      memcpy(&v, x + i, (n - i) * sizeof(double));
+      v = M::tanh(v);
+      memcpy(y + i, &v, (n - i) * sizeof(double));
+    }
+  }
+};
+
+// Self-contained, for hosts without BLAS. The matrices of flows are thin, so
+// rows are accumulated by the columns of 'b' without blocking, and small 
+// shapes are unrolled at compile time.
+class NativeBackend : public InferBackend {
+public:
+  const char* name() const override { return "native"; }
+
+  double* alloc(uint64_t n) const override {
+    uint64_t bytes = (n * sizeof(double) + kAlign - 1) / kAlign * kAlign;
+    double* buf = (double*)aligned_alloc(kAlign, std::max<uint64_t>(bytes,
+                                                                    kAlign));
+    ASSERT_WITH_MSG(buf != nullptr, "Cannot allocate " << bytes << " bytes")
+    memset(buf, 0, bytes);
+    return buf;
+  }
+
+  void release(double* buf) const override { free(buf); }
+
+  void gemm(int m, int n, int k, const double* a, const double* b,
+            double* c) const override {
+    if (n <= 4 && k <= 4) {
+      switch (n * 8 + k) {
+        case 1 * 8 + 2: return gemm_fixed<1, 2>(m, a, b, c);
+        case 1 * 8 + 4: return gemm_fixed<1, 4>(m, a, b, c);
+        case 2 * 8 + 1: return gemm_fixed<2, 1>(m, a, b, c);
+        case 2 * 8 + 2: return gemm_fixed<2, 2>(m, a, b, c);
+        case 2 * 8 + 4: return gemm_fixed<2, 4>(m, a, b, c);
+        case 4 * 8 + 1: return gemm_fixed<4, 1>(m, a, b, c);
+        case 4 * 8 + 2: return gemm_fixed<4, 2>(m, a, b, c);
+        case 4 * 8 + 4: return gemm_fixed<4, 4>(m, a, b, c);
+        default: break;
+      }
+    }
+    for (int64_t i = 0; i < m; ++ i) {
+      double* row = c + i * n;
+      std::fill(row, row + n, 0.);
+      for (int64_t p = 0; p < k; ++ p) {
+        double x = a[i * k + p];
+        const double* w = b + p * n;
+        for (int64_t j = 0; j < n; ++ j) {
+          row[j] += x * w[j];
+        }
+      }
+    }
+  }
+
+  void tanh(uint64_t n, const double* x, double* y) const override {
+    vector_tanh(n, x, y);
+  }
+
+private:
+  template<int N, int K>
+  static void gemm_fixed(int m, const double* a, const double* b, 
+                         double* c) {
+    for (int64_t i = 0; i < m; ++ i) {
+      for (int j = 0; j < N; ++ j) {
+        double sum = 0;
+        for (int p = 0; p < K; ++ p) {
+          sum += a[i * K + p] * b[p * N + j];
+        }
+        c[i * N + j] = sum;
+      }
+    }
+  }
+};
+
+#if defined(HAVE_MKL)
+class MKLBackend : public InferBackend {
+public:
+  const char* name() const override { return "mkl"; }
+
+  double* alloc(uint64_t n) const override {
+    return (double*)mkl_calloc(n, sizeof(double), kAlign);
+  }
+
+  void release(double* buf) const override { mkl_free(buf); }
+
+  void gemm(int m, int n, int k, const double* a, const double* b,
+            double* c) const override {
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k,
+                1, a, k, b, n, 0, c, n);
+  }
+
+  void tanh(uint64_t n, const double* x, double* y) const override {
+    vdTanh(n, x, y);
+  }
+};
+#elif defined(HAVE_OPENBLAS)
+// OpenBLAS has no vector math, tanh is the native one
+class OpenBLASBackend : public NativeBackend {
+public:
+  const char* name() const override { return "openblas"; }
+
+  void gemm(int m, int n, int k, const double* a, const double* b,
+            double* c) const override {
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k,
+                1, a, k, b, n, 0, c, n);
+  }
+};
+#endif
+
+inline std::vector<const InferBackend*> InferBackend::all() {
+  static NativeBackend native;
+#if defined(HAVE_MKL)
+  static MKLBackend mkl;
+  return {&mkl, &native};
+#elif defined(HAVE_OPENBLAS)
+  static OpenBLASBackend openblas;
+  return {&openblas, &native};
+#else
+  return {&native};
+#endif
+}
+
+inline const InferBackend* InferBackend::find(const std::string& name) {
+  for (const InferBackend* backend : all()) {
+    if (name == backend->name()) {
+      return backend;
+    }
+  }
+  return nullptr;
+}
+
+inline const InferBackend*& InferBackend::default_slot() {
+  static const InferBackend* backend = all()[0];
+  return backend;
+}
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef KEY_CODEC_PARA_H
+#define KEY_CODEC_PARA_H
+
+#include "core/common.h"
+
+namespace aflipara {
+
+// Keys are mapped to the numeric model keys of nodes in order. Arithmetic keys
+// are converted directly. Byte keys are ordered by their bytes, so a node
+// skips the common prefix of its keys and takes the next 8 bytes as a
+// big-endian integer. Keys without the prefix are ordered before or after all
+// keys of the node. Models only locate slots, and the full keys are compared
+// in data slots and buckets.
+template<typename KT, typename Enable=void>
+struct KeyCodec {
+  static const bool kBytes = false;
+
+  struct Prefix { };
+
+  static inline Prefix make_prefix(const KT&, const KT&) {
+    return Prefix();
+  }
+
+  static inline double encode(const KT& key, const Prefix&) {
+    return static_cast<double>(key);
+  }
+
+  // The distance is computed in the key type to keep the precision of large
+  // integer keys
+  static inline double distance(const KT& a, const KT& b, const Prefix&) {
+    return static_cast<double>(a - b);
+  }
+};
+
+template<typename KT>
+struct KeyCodec<KT, typename std::enable_if<KT::kByteKey>::type> {
+  static const bool kBytes = true;
+
+  struct Prefix {
+    uint32_t                  len = 0;
+    uint8_t                   bytes[KT::kMaxLength];
+  };
+
+  static inline Prefix make_prefix(const KT& min_key, const KT& max_key) {
+    Prefix prefix;
+    uint32_t n = std::min(min_key.length(), max_key.length());
+    const uint8_t* a = min_key.bytes();
+    const uint8_t* b = max_key.bytes();
+    while (prefix.len < n && a[prefix.len] == b[prefix.len]) {
+      prefix.bytes[prefix.len] = a[prefix.len];
+      prefix.len ++;
+    }
+    return prefix;
+  }
+
+  static inline double encode(const KT& key, const Prefix& prefix) {
+    const uint8_t* b = key.bytes();
+    uint32_t n = key.length();
+    if (prefix.len > 0) {
+      int c = memcmp(b, prefix.bytes, std::min(n, prefix.len));
+      if (c < 0 || (c == 0 && n < prefix.len)) {
+        return -1;
+      } else if (c > 0) {
+        return std::ldexp(1., 64);
+      }
+    }
+    uint64_t v = 0;
+    uint32_t m = std::min(n - prefix.len, 8U);
+    for (uint32_t i = 0; i < 8; ++ i) {
+      v = (v << 8) | (i < m ? b[prefix.len + i] : 0);
+    }
+    return static_cast<double>(v);
+  }
+
+  static inline double distance(const KT& a, const KT& b,
+                                const Prefix& prefix) {
+    return encode(a, prefix) - encode(b, prefix);
+  }
+};
+
+// A string of at most 'N' bytes stored inline, ordered by bytes
+template<uint32_t N=24>
+struct StrKey {
+  static_assert(N <= 255, "The length of string keys is held in a byte");
+  static const bool kByteKey = true;
+  static const uint32_t kMaxLength = N;
+
+  uint8_t                     len;
+  uint8_t                     data[N];
+
+  StrKey() : len(0) {
+    memset(data, 0, N);
+  }
+
+  StrKey(const char* s, uint32_t n) {
+    ASSERT_WITH_MSG(n <= N, "The string key is longer than " << N << " bytes")
+    len = n;
+    memcpy(data, s, n);
+    memset(data + n, 0, N - n);
+  }
+
+  explicit StrKey(const std::string& s) : StrKey(s.data(), s.size()) { }
+
+  inline const uint8_t* bytes() const { return data; }
+  inline uint32_t length() const { return len; }
+  std::string str() const { return std::string((const char*)data, len); }
+
+  inline int compare(const StrKey& o) const {
+    int c = memcmp(data, o.data, std::min(len, o.len));
+    return c != 0 ? c : static_cast<int>(len) - static_cast<int>(o.len);
+  }
+};
+
+// A pair of integers, e.g., (tenant, timestamp), stored in big-endian order
+// so that the bytes are ordered as the pair
+struct CompositeKey {
+  static const bool kByteKey = true;
+  static const uint32_t kMaxLength = 16;
+
+  uint8_t                     data[16];
+
+  CompositeKey() {
+    memset(data, 0, 16);
+  }
+
+  CompositeKey(uint64_t first, uint64_t second) {
+    for (uint32_t i = 0; i < 8; ++ i) {
+      data[i] = first >> (56 - 8 * i);
+      data[8 + i] = second >> (56 - 8 * i);
+    }
+  }
+
+  inline const uint8_t* bytes() const { return data; }
+  inline uint32_t length() const { return 16; }
+
+  inline uint64_t first() const { return load(0); }
+  inline uint64_t second() const { return load(8); }
+
+  inline int compare(const CompositeKey& o) const {
+    return memcmp(data, o.data, 16);
+  }
+
+private:
+  inline uint64_t load(uint32_t offset) const {
+    uint64_t v = 0;
+    for (uint32_t i = 0; i < 8; ++ i) {
+      v = (v << 8) | data[offset + i];
+    }
+    return v;
+  }
+};
+
+#define BYTE_KEY_OPERATORS(TEMPLATE, KT) \
+  TEMPLATE inline bool operator<(const KT& a, const KT& b) { \
+    return a.compare(b) < 0; \
+  } \
+  TEMPLATE inline bool operator>(const KT& a, const KT& b) { \
+    return a.compare(b) > 0; \
+  } \
+  TEMPLATE inline bool operator<=(const KT& a, const KT& b) { \
+    return a.compare(b) <= 0; \
+  } \
+  TEMPLATE inline bool operator>=(const KT& a, const KT& b) { \
+    return a.compare(b) >= 0; \
+  } \
+  TEMPLATE inline bool operator==(const KT& a, const KT& b) { \
+    return a.compare(b) == 0; \
+  } \
+  TEMPLATE inline bool operator!=(const KT& a, const KT& b) { \
+    return a.compare(b) != 0; \
+  }
+
+BYTE_KEY_OPERATORS(template<uint32_t N>, StrKey<N>)
+BYTE_KEY_OPERATORS(, CompositeKey)
+
+#undef BYTE_KEY_OPERATORS
+
+template<uint32_t N>
+std::ostream& operator<<(std::ostream& os, const StrKey<N>& key) {
+  return os << key.str();
+}
+
+inline std::ostream& operator<<(std::ostream& os, const CompositeKey& key) {
+  return os << "(" << key.first() << ", " << key.second() << ")";
+}
+
+}
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef KV_PAIR_PARA_H
+#define KV_PAIR_PARA_H
+
+#include "core/common.h"
+
+namespace aflipara {
+
+// The value of key-only sets
+struct Nil {
+  inline bool operator==(const Nil&) const { return true; }
+  inline bool operator!=(const Nil&) const { return false; }
+};
+
+inline std::ostream& operator<<(std::ostream& os, const Nil&) {
+  return os << "nil";
+}
+
+// A key without the padding of an empty value, so slots of sets only hold 
+// keys
+template<typename KT>
+struct KeyPair {
+  KT                          first;
+  [[no_unique_address]] Nil   second;
+
+  KeyPair() = default;
+  KeyPair(const KT& key, Nil=Nil()) : first(key) { }
+
+  inline bool operator==(const KeyPair& o) const { return first == o.first; }
+  inline bool operator!=(const KeyPair& o) const { return first != o.first; }
+};
+
+template<typename KT, typename VT>
+struct PairOf {
+  typedef std::pair<KT, VT> type;
+};
+
+template<typename KT>
+struct PairOf<KT, Nil> {
+  typedef KeyPair<KT> type;
+};
+
+// The pair stored in slots and buckets
+template<typename KT, typename VT>
+using KVPair = typename PairOf<KT, VT>::type;
+
+// The key type of a pair type
+template<typename P>
+using PairKey = typename std::remove_cv<decltype(P::first)>::type;
+
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef LHASH_PARA_H
+#define LHASH_PARA_H
+
+#include "core/linear_model.h"
+#include "core/common.h"
+
+namespace aflipara {
+
+#define LHASH_GROUP_SIZE 16
+
+// A group of slots probed together. The tag of a slot is zero if it is empty,
+// otherwise it stores 7 bits of the key hash with the highest bit set. The
+// lock and the version of a head group guard its overflow groups as well, 
+// and share the cache line of the tags.
+template<typename KT, typename VT>
+struct alignas(32) LHashGroup {
+  uint8_t                     tags[LHASH_GROUP_SIZE];
+  LHashGroup<KT, VT>*         next;      // The overflow group
+  volatile uint32_t           version;   // Odd while written
+  volatile uint8_t            group_lock;
+  std::pair<KT, VT>           slots[LHASH_GROUP_SIZE];
+
+  LHashGroup() : next(nullptr), version(0), group_lock(0) {
+    memset(tags, 0, sizeof(tags));
+  }
+};
+
+// The learned hash index for point lookups. A two-layer model learned from
+// the CDF of the bulk-loaded keys maps a key to a group of a flat table, so
+// keys are spread almost uniformly. Groups overflow into chained groups, 
+// which are released with the index only. Writers hold the lock of the head
+// group and make its version odd while writing, and readers take no locks,
+// they retry if the version changes (a seqlock).
+template<typename KT, typename VT>
+class LHashPara {
+typedef std::pair<KT, VT> KVT;
+public:
+  double                      min_key;
+  LinearModel                 root;      // Map keys to the leaf models
+  LinearModel*                leaves;
+  uint32_t                    num_leaves;
+  double                      groups_per_key;
+  uint32_t                    num_groups;
+  LHashGroup<KT, VT>*         groups;
+  std::atomic<uint64_t>       num_keys;
+  std::atomic<uint64_t>       num_overflows;
+
+  const uint32_t kKeysPerLeaf = 256;
+  const double kLoadFactor = 0.8;
+public:
+  LHashPara();
+  ~LHashPara();
+
+  void bulk_load(const KVT* kvs, uint32_t size);
+  bool find(KT key, VT& value);
+  bool remove(KT key);
+  bool update(KVT kv);
+  // The value is overwritten if the key exists
+  void insert(KVT kv);
+
+  uint64_t model_size();
+  uint64_t index_size();
+
+  void print_statistics();
+private:
+  inline uint32_t locate(KT key);
+  inline uint8_t tag(KT key);
+  inline uint32_t match(const LHashGroup<KT, VT>* group, uint8_t t);
+
+  void lock_group(uint32_t idx);
+  void unlock_group(uint32_t idx);
+  inline void begin_write(uint32_t idx);
+  inline void end_write(uint32_t idx);
+
+  void build_models(const KVT* kvs, uint32_t size);
+  KVT* find_slot(uint32_t idx, KT key);
+  void place(uint32_t idx, KVT kv);
+};
+
+}
+
+#endif
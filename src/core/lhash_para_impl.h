@@ -0,0 +1,268 @@
+#ifndef LHASH_PARA_IMPL_H
+#define LHASH_PARA_IMPL_H
+
+#include "core/lhash_para.h"
+
+namespace aflipara {
+
+template<typename KT, typename VT>
+LHashPara<KT, VT>::LHashPara() : num_keys(0), num_overflows(0) {
+  min_key = 0;
+  leaves = nullptr;
+  num_leaves = 0;
+  groups_per_key = 0;
+  num_groups = 0;
+  groups = nullptr;
+}
+
+template<typename KT, typename VT>
+LHashPara<KT, VT>::~LHashPara() {
+  for (uint32_t i = 0; i < num_groups; ++ i) {
+    LHashGroup<KT, VT>* group = groups[i].next;
+    while (group != nullptr) {
+      LHashGroup<KT, VT>* next = group->next;
+      delete group;
+      group = next;
+    }
+  }
+  delete[] groups;
+  groups = nullptr;
+  delete[] leaves;
+  leaves = nullptr;
+}
+
+template<typename KT, typename VT>
+void LHashPara<KT, VT>::bulk_load(const KVT* kvs, uint32_t size) {
+  ASSERT_WITH_MSG(groups == nullptr,
+                  "The index must be empty before bulk loading");
+  ASSERT_WITH_MSG(size > 0, "No data for bulk loading");
+  num_groups = static_cast<uint32_t>(std::ceil(size
+                / (LHASH_GROUP_SIZE * kLoadFactor)));
+  groups_per_key = num_groups * 1. / size;
+  groups = new LHashGroup<KT, VT>[num_groups];
+  build_models(kvs, size);
+  for (uint32_t i = 0; i < size; ++ i) {
+    place(locate(kvs[i].first), kvs[i]);
+  }
+  num_keys = size;
+}
+
+template<typename KT, typename VT>
+bool LHashPara<KT, VT>::find(KT key, VT& value) {
+  uint32_t idx = locate(key);
+  const LHashGroup<KT, VT>& head = groups[idx];
+  while (true) {
+    uint32_t version = head.version;
+    if (version & 1) {
+      continue;
+    }
+    fence();
+    KVT* slot = find_slot(idx, key);
+    bool found = slot != nullptr;
+    VT v;
+    if (found) {
+      v = slot->second;
+    }
+    fence();
+    if (head.version == version) {
+      if (found) {
+        value = v;
+      }
+      return found;
+    }
+  }
+}
+
+template<typename KT, typename VT>
+bool LHashPara<KT, VT>::remove(KT key) {
+  uint32_t idx = locate(key);
+  uint8_t t = tag(key);
+  bool found = false;
+  lock_group(idx);
+  for (LHashGroup<KT, VT>* group = groups + idx; group != nullptr && !found;
+       group = group->next) {
+    for (uint32_t mask = match(group, t); mask != 0; mask &= mask - 1) {
+      uint32_t i = __builtin_ctz(mask);
+      if (equal(group->slots[i].first, key)) {
+        begin_write(idx);
+        group->tags[i] = 0;
+        end_write(idx);
+        found = true;
+        break;
+      }
+    }
+  }
+  unlock_group(idx);
+  num_keys -= found;
+  return found;
+}
+
+template<typename KT, typename VT>
+bool LHashPara<KT, VT>::update(KVT kv) {
+  uint32_t idx = locate(kv.first);
+  lock_group(idx);
+  KVT* slot = find_slot(idx, kv.first);
+  bool found = slot != nullptr;
+  if (found) {
+    begin_write(idx);
+    slot->second = kv.second;
+    end_write(idx);
+  }
+  unlock_group(idx);
+  return found;
+}
+
+template<typename KT, typename VT>
+void LHashPara<KT, VT>::insert(KVT kv) {
+  uint32_t idx = locate(kv.first);
+  lock_group(idx);
+  KVT* slot = find_slot(idx, kv.first);
+  begin_write(idx);
+  if (slot != nullptr) {
+    slot->second = kv.second;
+  } else {
+    place(idx, kv);
+  }
+  end_write(idx);
+  unlock_group(idx);
+  num_keys += slot == nullptr;
+}
+
+template<typename KT, typename VT>
+uint64_t LHashPara<KT, VT>::model_size() {
+  return sizeof(LHashPara<KT, VT>) + sizeof(LinearModel) * num_leaves;
+}
+
+template<typename KT, typename VT>
+uint64_t LHashPara<KT, VT>::index_size() {
+  return model_size() + sizeof(LHashGroup<KT, VT>) * num_groups + sizeof(LHashGroup<KT, VT>) * num_overflows;
+}
+
+template<typename KT, typename VT>
+void LHashPara<KT, VT>::print_statistics() {
+  COUT_INFO("# Keys\t" << num_keys << "\n# Groups\t" << num_groups
+            << "\n# Overflow Groups\t" << num_overflows << "\nLoad Factor\t"
+            << num_keys * 1. / ((num_groups + num_overflows)
+                                * LHASH_GROUP_SIZE)
+            << "\nIndex Size\t" << index_size())
+}
+
+template<typename KT, typename VT>
+uint32_t LHashPara<KT, VT>::locate(KT key) {
+  double x = static_cast<double>(key) - min_key;
+  int64_t l = std::min(std::max(root.predict(x), 0L),
+                       static_cast<int64_t>(num_leaves - 1));
+  int64_t g = static_cast<int64_t>(leaves[l].predict_double(x)
+                                   * groups_per_key);
+  return std::min(std::max(g, 0L), static_cast<int64_t>(num_groups - 1));
+}
+
+template<typename KT, typename VT>
+uint8_t LHashPara<KT, VT>::tag(KT key) {
+  uint64_t bits = 0;
+  memcpy(&bits, &key, std::min(sizeof(KT), sizeof(uint64_t)));
+  return static_cast<uint8_t>((bits * 0x9E3779B97F4A7C15ULL) >> 57) | 0x80;
+}
+
+template<typename KT, typename VT>
+uint32_t LHashPara<KT, VT>::match(const LHashGroup<KT, VT>* group,
+                                  uint8_t t) {
+  __m128i tags = _mm_load_si128((const __m128i*)group->tags);
+  __m128i cmp = _mm_cmpeq_epi8(tags, _mm_set1_epi8(static_cast<char>(t)));
+  return static_cast<uint32_t>(_mm_movemask_epi8(cmp));
+}
+
+template<typename KT, typename VT>
+void LHashPara<KT, VT>::lock_group(uint32_t idx) {
+  uint8_t unlocked = 0, locked = 1;
+  while (unlikely(cmpxchgb((uint8_t *)&groups[idx].group_lock, unlocked,
+                           locked) != unlocked)) { }
+}
+
+template<typename KT, typename VT>
+void LHashPara<KT, VT>::unlock_group(uint32_t idx) {
+  groups[idx].group_lock = 0;
+}
+
+template<typename KT, typename VT>
+inline void LHashPara<KT, VT>::begin_write(uint32_t idx) {
+  groups[idx].version = groups[idx].version + 1;
+  fence();
+}
+
+template<typename KT, typename VT>
+inline void LHashPara<KT, VT>::end_write(uint32_t idx) {
+  fence();
+  groups[idx].version = groups[idx].version + 1;
+}
+
+template<typename KT, typename VT>
+void LHashPara<KT, VT>::build_models(const KVT* kvs, uint32_t size) {
+  // The root model partitions the keys into the leaf models evenly, and each
+  // leaf model predicts the rank of keys
+  min_key = static_cast<double>(kvs[0].first);
+  num_leaves = std::max(size / kKeysPerLeaf, 1U);
+  leaves = new LinearModel[num_leaves];
+  LinearModelBuilder root_builder;
+  for (uint32_t i = 0; i < size; ++ i) {
+    double x = static_cast<double>(kvs[i].first) - min_key;
+    root_builder.add(x, i * 1. * num_leaves / size);
+  }
+  root_builder.build(&root);
+  for (uint32_t i = 0, l = 0; l < num_leaves; ++ l) {
+    LinearModelBuilder leaf_builder;
+    for (; i < size; ++ i) {
+      double x = static_cast<double>(kvs[i].first) - min_key;
+      int64_t p = std::min(std::max(root.predict(x), 0L),
+                           static_cast<int64_t>(num_leaves - 1));
+      if (p != l) {
+        break;
+      }
+      leaf_builder.add(x, i);
+    }
+    if (leaf_builder.count > 0) {
+      leaf_builder.build(leaves + l);
+    } else {
+      leaves[l].slope = 0;
+      leaves[l].intercept = i;
+    }
+  }
+}
+
+template<typename KT, typename VT>
+std::pair<KT, VT>* LHashPara<KT, VT>::find_slot(uint32_t idx, KT key) {
+  uint8_t t = tag(key);
+  for (LHashGroup<KT, VT>* group = groups + idx; group != nullptr;
+       group = group->next) {
+    for (uint32_t mask = match(group, t); mask != 0; mask &= mask - 1) {
+      uint32_t i = __builtin_ctz(mask);
+      if (equal(group->slots[i].first, key)) {
+        return group->slots + i;
+      }
+    }
+  }
+  return nullptr;
+}
+
+template<typename KT, typename VT>
+void LHashPara<KT, VT>::place(uint32_t idx, KVT kv) {
+  LHashGroup<KT, VT>* group = groups + idx;
+  while (true) {
+    uint32_t empty = match(group, 0);
+    if (empty != 0) {
+      uint32_t i = __builtin_ctz(empty);
+      group->slots[i] = kv;
+      group->tags[i] = tag(kv.first);
+      return;
+    }
+    if (group->next == nullptr) {
+      group->next = new LHashGroup<KT, VT>();
+      num_overflows ++;
+    }
+    group = group->next;
+  }
+}
+
+}
+
+#endif
@@ -3,26 +3,61 @@
 
 #include "core/afli_para_impl.h"
 #include "core/numerical_flow.h"
+#include "core/sharded_buffer_impl.h"
+#include "core/run_set_impl.h"
+#include "core/bloom_filter.h"
 #include "core/conflicts.h"
 #include "core/common.h"
 
 namespace aflipara {
 
+// Counters of the flush pipeline of NFLPara
+struct IngestStats {
+  uint64_t num_batches;     // The sealed tables flushed into the index
+  uint64_t num_stalls;      // The writes waiting for full queues or flushes
+  uint64_t stall_time;      // The nanoseconds of the waits
+  uint64_t num_in_flight;   // The sealed tables not flushed yet
+  uint64_t num_runs;        // The sorted runs not compacted yet
+  uint64_t num_compactions;
+};
+
+// How flushed tables reach the index. The tree engine upserts them into the
+// index directly, and the run engine keeps them as sorted runs, which are
+// merged into the index by background compactions. Runs trade the reads of
+// a few more runs for fewer rebuilds of buckets under insert-heavy loads.
+enum IngestEngine {
+  kTreeEngine = 0,
+  kRunEngine = 1,
+};
+
 template<typename KT, typename VT>
 class NFLPara {
 typedef std::pair<KT, VT> KVT;
 typedef std::pair<double, KVT> KKVT;
 public:
   uint32_t num_bg;
-  // A global buffer 
+  // The write buffer, sharded by keys and searched without locks
   uint32_t max_buffer_size;
-  uint32_t buffer_size;
-  KVT* buffer;
-  KVT* imm_buffer;
-  // Thread pool
-  volatile uint8_t buffer_lock;
-  volatile uint8_t imm_buffer_lock;
+  uint32_t num_shards;
+  uint32_t queue_depth;     // The sealed tables of a shard waiting to flush
+  ShardedBuffer<KT, VT>* buffer;
+  // Thread pools of the flush pipeline. Sealed tables are transformed by the 
+  // flow in 'tran_pool', then upserted into the index in 'pool'. The indexes 
+  // rebuild nodes in their own pools, since flushes wait for the rebuilds 
+  // holding entry locks.
+  boost::asio::thread_pool* tran_pool;
   boost::asio::thread_pool* pool;
+  std::atomic<uint64_t> num_batches;
+  std::atomic<uint64_t> num_stalls;
+  std::atomic<uint64_t> stall_time;
+
+  // The sorted runs of the run engine, compacted in 'compact_pool' once 
+  // 'max_runs' runs are made. Set the engine before the bulk load.
+  IngestEngine engine;
+  uint32_t max_runs;
+  RunSet<KT, VT>* runs;
+  boost::asio::thread_pool* compact_pool;
+  std::atomic<uint64_t> num_compactions;
 
   // The learned index
   AFLIPara<KT, VT>* index;
@@ -31,32 +66,108 @@ public:
   NumericalFlow<KT, VT>* flow;
   AFLIPara<double, KVT>* tran_index;
 
+  // The read-only layouts replacing the indexes once frozen
+  bool is_frozen;
+  FrozenAFLIPara<KT, VT>* frozen_index;
+  FrozenAFLIPara<double, KVT>* frozen_tran_index;
+
+  // The global filter lets lookups of absent keys skip the flow transform
+  uint32_t filter_bits_per_key;
+  BlockedBloomFilter* filter;
+  // The number of slots per rank counter of the index, '0' means no counters
+  uint32_t rank_stride;
+  // The precision of the hidden layers of the flow, tried at bulk loads
+  FlowPrecision flow_precision;
+  // The threads transforming the keys of bulk loads, the calling one included
+  uint32_t num_load_threads;
+
   const float kConflictsDecay = 0.1;
-  const uint32_t kMaxBatchSize = 4196;
+  const float kPrecisionLoss = 0.1;  // Of tail conflicts, by reduced precision
+  static constexpr uint32_t kMaxBatchSize = 4196;
   const float kSizeAmplification = 1.5;
   const float kTailPercent = 0.99;
+  const uint32_t kMaxRuns = 8;
+  const uint32_t kRunsStallFactor = 2;  // Flushes wait for compactions beyond
 public:
-  NFLPara(std::string weight_path, uint32_t mbs, uint32_t nb=1);
+  // The buffer has a shard per hardware thread by default
+  NFLPara(std::string weight_path, uint32_t mbs, uint32_t nb=1, 
+          uint32_t ns=0, uint32_t qd=ShardedBuffer<KT, VT>::kQueueDepth);
+  // Indexes may share the weights of a loaded flow, 'nullptr' means no flow
+  NFLPara(std::shared_ptr<const BNAF_Infer<KT, VT>> model, uint32_t mbs, 
+          uint32_t nb=1, uint32_t ns=0, 
+          uint32_t qd=ShardedBuffer<KT, VT>::kQueueDepth);
   ~NFLPara();
 
-  bool buffer_locked();
-  void lock_buffer();
-  void unlock_buffer();
-
-  bool imm_buffer_locked();
-  void lock_imm_buffer();
-  void unlock_imm_buffer();
-
+  // Reset the buffer before any write
   inline void set_max_buffer_size(uint32_t max_buffer_size);
   void bulk_load(const KVT* kvs, uint32_t size, bool enable_flow=true);
   bool find(KT key, VT& value);
   bool remove(KT key);
   bool update(KVT kv);
   void insert(KVT kv);
+  // Read-modify-write operations, see AFLIPara
+  template<typename Fn>
+  bool modify(KT key, Fn fn);
+  bool upsert(KVT kv);
+  bool fetch_add(KT key, VT delta, VT& old);
+  bool compare_exchange(KT key, VT& expected, VT desired);
+  uint32_t scan(KT begin, KT end, std::vector<KVT>& res);
+  bool lower_bound(KT key, KVT& res);
+  bool predecessor(KT key, KVT& res);
+  bool successor(KT key, KVT& res);
+  bool neighbor(KT key, bool forward, bool inclusive, KVT& res);
+  // Keys rewritten since the last compaction are counted in both the runs 
+  // and the index, so the errors are bounded after compactions only
+  double approx_rank(KT key, double max_error=0);
+  double estimate_count(KT begin, KT end, double max_error=0);
+  // Merge the sorted runs into the index now, writes may go on
+  void compact();
+  // Merge the buffer into the index and replace the index by a read-only 
+  // layout. Writes must be stopped, and only finds are served afterwards. 
+  // The index of original keys is delta encoded if 'compress', see AFLIPara.
+  void freeze(bool compress=false);
   uint64_t model_size();
   uint64_t index_size();
+  IngestStats ingest_stats();
+
+private:
+  struct FlushBatch {
+    uint32_t                  shard;
+    std::vector<KVT>          kvs;
+    std::vector<KKVT>         tran_kvs;
+  };
+
+  // The stages of flushes. The pairs of the oldest sealed table of the shard 
+  // are transformed, then upserted into the index, and the next sealed table 
+  // of the shard is flushed after, so newer pairs of a key win.
+  static void bg_transform(NFLPara<KT, VT>* nfl, uint32_t shard);
+  static void bg_insert(NFLPara<KT, VT>* nfl, FlushBatch* batch);
+  static void bg_compact(NFLPara<KT, VT>* nfl);
+  // Move the pairs of the runs of now into the index, and remove the keys 
+  // removed in the runs
+  void merge_runs();
+  // Take the flow in 'flow_precision' if it keeps the sample strictly 
+  // increasing, with at most 'kPrecisionLoss' more tail conflicts than 
+  // 'tran_tail_conflicts'. The transformed sample is replaced if taken.
+  void reduce_flow(const KVT* kvs, uint32_t size, KKVT* tran_kvs, 
+                   uint32_t tran_tail_conflicts);
 
-  static void bg_insert(void* args);
+  // Lock the shard of the key after the key leaves the sealed tables. Full 
+  // active tables are sealed first if 'writable', and writes wait while the 
+  // queue of the shard is full.
+  uint32_t lock_shard(const KT& key, bool writable);
+  void flush(uint32_t shard);
+  template<typename Fn>
+  bool modify_index(KT key, Fn& fn);
+  // Copy the newest pair of the key in the runs up to the active table of 
+  // the locked shard with the modified value. Returns the state of the key 
+  // in the runs.
+  template<typename Fn>
+  typename RunSet<KT, VT>::State modify_run(uint32_t s, const KT& key, 
+                                            Fn& fn);
+  bool remove_index(KT key);
+  bool neighbor_index(KT key, bool forward, bool inclusive, KVT& res);
+  bool find_frozen(KT key, VT& value);
 };
 
 }
@@ -6,30 +6,73 @@
 namespace aflipara {
 
 template<typename KT, typename VT>
-NFLPara<KT, VT>::NFLPara(std::string weight_path, uint32_t mbs, uint32_t nb) 
+NFLPara<KT, VT>::NFLPara(std::string weight_path, uint32_t mbs, uint32_t nb, 
+                         uint32_t ns, uint32_t qd) 
+                         : NFLPara(weight_path != "" 
+                                   ? BNAF_Infer<KT, VT>::load(weight_path) 
+                                   : nullptr, mbs, nb, ns, qd) { }
+
+template<typename KT, typename VT>
+NFLPara<KT, VT>::NFLPara(std::shared_ptr<const BNAF_Infer<KT, VT>> model, 
+                         uint32_t mbs, uint32_t nb, uint32_t ns, uint32_t qd) 
                          : max_buffer_size(mbs), num_bg(nb) { 
-  this->enable_flow = weight_path != "";
-  if (weight_path != "") {
-    this->flow = new NumericalFlow<KT, VT>(weight_path, kMaxBatchSize);
+  this->enable_flow = model != nullptr;
+  if (model != nullptr) {
+    this->flow = new NumericalFlow<KT, VT>(model, kMaxBatchSize);
   } else {
     this->flow = nullptr;
   }
   this->index = nullptr;
   this->tran_index = nullptr;
-  this->buffer_size = 0;
-  this->buffer = new KVT[mbs];
-  this->imm_buffer = nullptr;
-  this->buffer_lock = 0;
-  this->imm_buffer_lock = 0;
+  this->is_frozen = false;
+  this->frozen_index = nullptr;
+  this->frozen_tran_index = nullptr;
+  this->num_shards = ns > 0 ? ns : std::thread::hardware_concurrency();
+  this->queue_depth = qd;
+  this->buffer = new ShardedBuffer<KT, VT>(mbs, num_shards, qd);
+  this->num_batches = 0;
+  this->num_stalls = 0;
+  this->stall_time = 0;
+  this->filter_bits_per_key = 0;
+  this->filter = nullptr;
+  this->rank_stride = 0;
+  this->flow_precision = kDoublePrecision;
+  this->num_load_threads = std::max(std::thread::hardware_concurrency(), 1U);
+  this->engine = kTreeEngine;
+  this->max_runs = kMaxRuns;
+  this->runs = nullptr;
+  this->compact_pool = nullptr;
+  this->num_compactions = 0;
   if (nb > 0) {
+    this->tran_pool = new boost::asio::thread_pool(1);
     this->pool = new boost::asio::thread_pool(nb);
   } else {
+    this->tran_pool = nullptr;
     this->pool = nullptr;
   }
 }
 
 template<typename KT, typename VT>
 NFLPara<KT, VT>::~NFLPara() {
+  if (pool != nullptr) {
+    // Flushes of the buffer are finished before the indexes are released
+    for (uint32_t s = 0; buffer != nullptr && s < buffer->num_shards; ++ s) {
+      while (buffer->num_sealed(s) > 0) { 
+        std::this_thread::yield();
+      }
+    }
+    tran_pool->join();
+    pool->join();
+    if (compact_pool != nullptr) {
+      compact_pool->join();
+    }
+  }
+  if (runs != nullptr) {
+    delete runs;
+  }
+  if (compact_pool != nullptr) {
+    delete compact_pool;
+  }
   if (index != nullptr) {
     delete index;
   }
@@ -39,57 +82,29 @@ NFLPara<KT, VT>::~NFLPara() {
   if (tran_index != nullptr) {
     delete tran_index;
   }
+  if (frozen_index != nullptr) {
+    delete frozen_index;
+  }
+  if (frozen_tran_index != nullptr) {
+    delete frozen_tran_index;
+  }
   if (buffer != nullptr) {
-    delete[] buffer;
+    delete buffer;
   }
-  if (imm_buffer != nullptr) {
-    delete[] imm_buffer;
+  if (filter != nullptr) {
+    delete filter;
   }
   if (pool != nullptr) {
+    delete tran_pool;
     delete pool;
   }
 }
 
-template<typename KT, typename VT>
-bool NFLPara<KT, VT>::buffer_locked() {
-  return this->buffer_lock;
-}
-
-template<typename KT, typename VT>
-void NFLPara<KT, VT>::lock_buffer() {
-  uint8_t unlocked = 0, locked = 1;
-  while (unlikely(cmpxchgb((uint8_t *)&this->buffer_lock, unlocked, locked) !=
-                  unlocked))
-    ;
-}
-
-template<typename KT, typename VT>
-void NFLPara<KT, VT>::unlock_buffer() {
-  buffer_lock = 0;
-}
-
-template<typename KT, typename VT>
-bool NFLPara<KT, VT>::imm_buffer_locked() {
-  return this->imm_buffer_lock;
-}
-
-template<typename KT, typename VT>
-void NFLPara<KT, VT>::lock_imm_buffer() {
-  uint8_t unlocked = 0, locked = 1;
-  while (unlikely(cmpxchgb((uint8_t *)&this->imm_buffer_lock, unlocked, locked) !=
-                  unlocked))
-    ;
-}
-
-template<typename KT, typename VT>
-void NFLPara<KT, VT>::unlock_imm_buffer() {
-  imm_buffer_lock = 0;
-}
-
 template<typename KT, typename VT>
 void NFLPara<KT, VT>::set_max_buffer_size(uint32_t mbs) {
   this->max_buffer_size = mbs;
-  this->buffer.reserve(mbs);
+  delete buffer;
+  buffer = new ShardedBuffer<KT, VT>(mbs, num_shards, queue_depth);
 }
 
 template<typename KT, typename VT>
@@ -97,9 +112,23 @@ void NFLPara<KT, VT>::bulk_load(const KVT* kvs, uint32_t size, bool ef) {
   for (uint32_t i = 1; i < size; ++ i) {
     ASSERT_WITH_MSG(kvs[i].first > kvs[i - 1].first, "Unordered bulk-loading data");
   }
-  enable_flow = ef;
+  enable_flow = ef && flow != nullptr;
+  if (engine == kRunEngine) {
+    runs = new RunSet<KT, VT>(max_runs);
+    if (num_bg > 0) {
+      compact_pool = new boost::asio::thread_pool(1);
+    }
+  }
+  if (filter_bits_per_key > 0) {
+    // Leave room for the keys inserted later
+    filter = new BlockedBloomFilter(size * 2, filter_bits_per_key);
+    for (uint32_t i = 0; i < size; ++ i) {
+      filter->add(hash_key(kvs[i].first));
+    }
+  }
   if (!enable_flow) {
-    index = new AFLIPara<KT, VT>(num_bg, pool);
+    index = new AFLIPara<KT, VT>(num_bg);
+    index->hyper_para.rank_stride = rank_stride;
     index->bulk_load(kvs, size);
   } else {
     KKVT* tran_kvs = new KKVT[size];
@@ -108,25 +137,50 @@ void NFLPara<KT, VT>::bulk_load(const KVT* kvs, uint32_t size, bool ef) {
                                                             kTailPercent);
     COUT_INFO("Original tail conflicts " << origin_tail_conflicts);
     flow->set_batch_size(kMaxBatchSize);
-    flow->transform(kvs, size, tran_kvs);
-    std::sort(tran_kvs, tran_kvs + size, 
-      [](auto const& a, auto const& b) {
-        return a.first < b.first;
-    });
-    uint32_t tran_tail_conflicts = compute_tail_conflicts(tran_kvs, size, 
-                                                          kSizeAmplification, 
-                                                          kTailPercent);
-    COUT_INFO("Transformed tail conflicts " << tran_tail_conflicts);
-    exit(-1);
-    if (static_cast<int64_t>(origin_tail_conflicts) - tran_tail_conflicts 
+    auto start = TIME_LOG;
+    flow->transform(kvs, size, tran_kvs, num_load_threads);
+    COUT_INFO("Transform " << size << " keys by " << num_load_threads 
+              << " threads in " << TIME_IN_SECOND(start, TIME_LOG) << " s");
+    // Ordered queries in the original key space require an order-preserving 
+    // flow, so the transformed keys of the sample must be strictly monotone. 
+    // The outputs of a decreasing flow are negated.
+    bool monotone = true;
+    bool decreasing = size > 1 && tran_kvs[1].first < tran_kvs[0].first;
+    for (uint32_t i = 1; i < size && monotone; ++ i) {
+      monotone = decreasing ? tran_kvs[i].first < tran_kvs[i - 1].first
+                            : tran_kvs[i - 1].first < tran_kvs[i].first;
+    }
+    if (monotone && decreasing) {
+      flow->sign = -1;
+      for (uint32_t i = 0; i < size; ++ i) {
+        tran_kvs[i].first = -tran_kvs[i].first;
+      }
+    }
+    uint32_t tran_tail_conflicts = origin_tail_conflicts;
+    if (monotone) {
+      tran_tail_conflicts = compute_tail_conflicts(tran_kvs, size, 
+                                                   kSizeAmplification, 
+                                                   kTailPercent);
+      COUT_INFO("Transformed tail conflicts " << tran_tail_conflicts);
+    } else {
+      COUT_INFO("The flow is not order-preserving");
+    }
+    if (!monotone || static_cast<int64_t>(origin_tail_conflicts) 
+        - tran_tail_conflicts 
         < static_cast<int64_t>(origin_tail_conflicts * kConflictsDecay)) {
       enable_flow = false;
-      index = new AFLIPara<KT, VT>(num_bg, pool);
+      index = new AFLIPara<KT, VT>(num_bg);
+      index->hyper_para.rank_stride = rank_stride;
       index->bulk_load(kvs, size);
     } else {
-      tran_index = new AFLIPara<double, KVT>(num_bg, pool);
+      if (flow_precision != kDoublePrecision) {
+        reduce_flow(kvs, size, tran_kvs, tran_tail_conflicts);
+      }
+      tran_index = new AFLIPara<double, KVT>(num_bg);
+      tran_index->hyper_para.rank_stride = rank_stride;
       tran_index->bulk_load(tran_kvs, size);
-      flow->set_batch_size(max_buffer_size);
+      // Sealed tables of the buffer are transformed in one batch
+      flow->set_batch_size(buffer->shard_size);
     }
     delete[] tran_kvs;
   }
@@ -134,19 +188,78 @@ void NFLPara<KT, VT>::bulk_load(const KVT* kvs, uint32_t size, bool ef) {
 }
 
 template<typename KT, typename VT>
-bool NFLPara<KT, VT>::find(KT key, VT& value) {
-  bool in_buffer = false;
-  lock_buffer();
-  for (uint32_t i = 0; i < buffer_size; ++ i) {
-    if (equal(key, buffer[i].first)) {
-      value = buffer[i].second;
-      in_buffer = true;
+void NFLPara<KT, VT>::reduce_flow(const KVT* kvs, uint32_t size, 
+                                  KKVT* tran_kvs, 
+                                  uint32_t tran_tail_conflicts) {
+  const char* name = precision_name(flow_precision);
+  NumericalFlow<KT, VT> reduced(flow->model->reduce(flow_precision), 
+                                kMaxBatchSize);
+  reduced.sign = flow->sign;
+  // New keys land right after the loaded ones, so integral keys are ordered
+  // with their successors as well
+  std::vector<KVT> probes;
+  std::vector<uint32_t> pos(size);
+  probes.reserve(size * 2);
+  for (uint32_t i = 0; i < size; ++ i) {
+    pos[i] = probes.size();
+    probes.push_back(kvs[i]);
+    if constexpr (std::is_integral<KT>::value) {
+      KT next = kvs[i].first + 1;
+      if (kvs[i].first < next && (i + 1 == size || next < kvs[i + 1].first)) {
+        probes.push_back({next, kvs[i].second});
+      }
     }
   }
-  unlock_buffer();
-  if (in_buffer) {
+  KKVT* tran_probes = new KKVT[probes.size()];
+  reduced.transform(probes.data(), probes.size(), tran_probes, 
+                    num_load_threads);
+  // Ties break the order as well, as keys of the index are distinct
+  uint32_t num_disorders = 0;
+  for (uint32_t i = 1; i < probes.size(); ++ i) {
+    num_disorders += !(tran_probes[i - 1].first < tran_probes[i].first);
+  }
+  KKVT* reduced_kvs = new KKVT[size];
+  for (uint32_t i = 0; i < size; ++ i) {
+    reduced_kvs[i] = tran_probes[pos[i]];
+  }
+  delete[] tran_probes;
+  bool taken = num_disorders == 0;
+  if (taken) {
+    uint32_t tail_conflicts = compute_tail_conflicts(reduced_kvs, size, 
+                                                     kSizeAmplification, 
+                                                     kTailPercent);
+    COUT_INFO("Transformed tail conflicts in " << name << " " 
+              << tail_conflicts);
+    taken = tail_conflicts <= tran_tail_conflicts * (1 + kPrecisionLoss);
+  } else {
+    COUT_INFO("The flow in " << name << " misorders " << num_disorders 
+              << " keys");
+  }
+  if (taken) {
+    flow->model = reduced.model;
+    std::copy(reduced_kvs, reduced_kvs + size, tran_kvs);
+  }
+  COUT_INFO((taken ? "Take " : "Refuse ") << name << " flow");
+  delete[] reduced_kvs;
+}
+
+template<typename KT, typename VT>
+bool NFLPara<KT, VT>::find(KT key, VT& value) {
+  if (filter != nullptr && !filter->may_contain(hash_key(key))) {
+    return false;
+  }
+  if (is_frozen) {
+    return find_frozen(key, value);
+  }
+  if (buffer->find(key, value)) {
     return true;
   } else {
+    if (runs != nullptr) {
+      typename RunSet<KT, VT>::State state = runs->find(key, value);
+      if (state != RunSet<KT, VT>::kAbsent) {
+        return state == RunSet<KT, VT>::kLive;
+      }
+    }
     if (enable_flow) {
       KVT kv = {key, 0};
       KKVT tran_kv = flow->transform(kv);
@@ -162,44 +275,51 @@ bool NFLPara<KT, VT>::find(KT key, VT& value) {
 
 template<typename KT, typename VT>
 bool NFLPara<KT, VT>::remove(KT key) {
-  bool in_buffer = false;
-  lock_buffer();
-  for (uint32_t i = 0; i < buffer_size; ++ i) {
-    if (equal(key, buffer[i].first)) {
-      in_buffer = true;
-    }
-    if (in_buffer) {
-      if (i < buffer_size - 1) {
-        buffer[i] = buffer[i + 1];
-      } else {
-        buffer_size --;
-      }
-    }
+  ASSERT_WITH_MSG(!is_frozen, "The index is frozen")
+  if (filter != nullptr && !filter->may_contain(hash_key(key))) {
+    return false;
   }
-  unlock_buffer();
-  if (in_buffer) {
-    return true;
-  } else {
-    if (enable_flow) {
-      KKVT tran_kv = flow->transform({key, 0});
-      return tran_index->remove(tran_kv.first);
-    } else {
-      return index->remove(key);
+  uint32_t s = lock_shard(key, false);
+  bool in_buffer = buffer->erase(s, key);
+  if (runs != nullptr) {
+    // Older pairs of the key are removed as well. The runs are not merged 
+    // meanwhile, so the pair in the runs is either marked or in the index.
+    runs->lock_compact();
+    typename RunSet<KT, VT>::State state = runs->remove(key);
+    bool res = state == RunSet<KT, VT>::kLive;
+    if (state == RunSet<KT, VT>::kAbsent) {
+      res = remove_index(key);
     }
+    runs->unlock_compact();
+    buffer->unlock(s);
+    return in_buffer || res;
   }
+  buffer->unlock(s);
+  // A reinserted key is both buffered and indexed, so both are removed
+  bool res = remove_index(key);
+  return in_buffer || res;
 }
 
 template<typename KT, typename VT>
 bool NFLPara<KT, VT>::update(KVT kv) {
-  bool in_buffer = false;
-  lock_buffer();
-  for (uint32_t i = 0; i < buffer_size; ++ i) {
-    if (equal(kv.first, buffer[i].first)) {
-      buffer[i] = kv;
-      in_buffer = true;
+  ASSERT_WITH_MSG(!is_frozen, "The index is frozen")
+  if (filter != nullptr && !filter->may_contain(hash_key(kv.first))) {
+    return false;
+  }
+  auto assign = [&](VT& value) {
+    value = kv.second;
+    return true;
+  };
+  uint32_t s = lock_shard(kv.first, runs != nullptr);
+  bool in_buffer = buffer->modify(s, kv.first, assign);
+  if (!in_buffer && runs != nullptr) {
+    typename RunSet<KT, VT>::State state = modify_run(s, kv.first, assign);
+    if (state != RunSet<KT, VT>::kAbsent) {
+      buffer->unlock(s);
+      return state == RunSet<KT, VT>::kLive;
     }
   }
-  unlock_buffer();
+  buffer->unlock(s);
   if (in_buffer) {
     return true;
   } else {
@@ -214,62 +334,552 @@ bool NFLPara<KT, VT>::update(KVT kv) {
 
 template<typename KT, typename VT>
 void NFLPara<KT, VT>::insert(KVT kv) {
-  lock_buffer();
-  buffer[buffer_size] = kv;
-  buffer_size ++;
-  if (buffer_size == max_buffer_size) {
-    while (imm_buffer_locked()) { }
-    lock_imm_buffer();
-    imm_buffer = buffer;
-    buffer = new KVT[max_buffer_size];
-    buffer_size = 0;
-    if (pool != nullptr) {
-      boost::asio::post(*pool, boost::bind(NFLPara<KT, VT>::bg_insert, this));
+  ASSERT_WITH_MSG(!is_frozen, "The index is frozen")
+  if (filter != nullptr) {
+    filter->add(hash_key(kv.first));
+  }
+  uint32_t s = lock_shard(kv.first, true);
+  buffer->put(s, kv);
+  buffer->unlock(s);
+}
+
+template<typename KT, typename VT>
+template<typename Fn>
+bool NFLPara<KT, VT>::modify(KT key, Fn fn) {
+  ASSERT_WITH_MSG(!is_frozen, "The index is frozen")
+  if (filter != nullptr && !filter->may_contain(hash_key(key))) {
+    return false;
+  }
+  uint32_t s = lock_shard(key, runs != nullptr);
+  bool in_buffer = buffer->modify(s, key, fn);
+  if (!in_buffer && runs != nullptr) {
+    typename RunSet<KT, VT>::State state = modify_run(s, key, fn);
+    if (state != RunSet<KT, VT>::kAbsent) {
+      buffer->unlock(s);
+      return state == RunSet<KT, VT>::kLive;
+    }
+  }
+  buffer->unlock(s);
+  return in_buffer || modify_index(key, fn);
+}
+
+template<typename KT, typename VT>
+bool NFLPara<KT, VT>::upsert(KVT kv) {
+  ASSERT_WITH_MSG(!is_frozen, "The index is frozen")
+  if (filter != nullptr) {
+    filter->add(hash_key(kv.first));
+  }
+  auto assign = [&](VT& value) {
+    value = kv.second;
+    return true;
+  };
+  // The shard lock is held until the pair is put, so the key cannot be 
+  // inserted by others meanwhile
+  uint32_t s = lock_shard(kv.first, true);
+  if (buffer->modify(s, kv.first, assign)) {
+    buffer->unlock(s);
+    return false;
+  }
+  if (runs != nullptr) {
+    // The pair of a removed key in the runs is replaced by the new one
+    typename RunSet<KT, VT>::State state = modify_run(s, kv.first, assign);
+    if (state != RunSet<KT, VT>::kAbsent) {
+      if (state == RunSet<KT, VT>::kRemoved) {
+        buffer->put(s, kv);
+      }
+      buffer->unlock(s);
+      return state == RunSet<KT, VT>::kRemoved;
+    }
+  }
+  bool found = modify_index(kv.first, assign);
+  if (!found) {
+    buffer->put(s, kv);
+  }
+  buffer->unlock(s);
+  return !found;
+}
+
+template<typename KT, typename VT>
+bool NFLPara<KT, VT>::fetch_add(KT key, VT delta, VT& old) {
+  return modify(key, [&](VT& value) {
+    old = value;
+    value += delta;
+    return true;
+  });
+}
+
+template<typename KT, typename VT>
+bool NFLPara<KT, VT>::compare_exchange(KT key, VT& expected, VT desired) {
+  VT target = expected;
+  bool res = false;
+  bool found = modify(key, [&](VT& value) {
+    res = value == target;
+    if (res) {
+      value = desired;
     } else {
-      NFLPara<KT, VT>::bg_insert(this);
+      expected = value;
     }
+    return res;
+  });
+  return found && res;
+}
+
+template<typename KT, typename VT>
+uint32_t NFLPara<KT, VT>::scan(KT begin, KT end, std::vector<KVT>& res) {
+  ASSERT_WITH_MSG(!is_frozen, "The index is frozen")
+  // Merge the pairs in range [begin, end] from the buffer and the index
+  std::vector<KVT> buffered;
+  buffer->collect([&](const KVT& kv) {
+    return !(kv.first < begin) && !(end < kv.first);
+  }, buffered);
+  auto less = [](auto const& a, auto const& b) { return a.first < b.first; };
+  std::sort(buffered.begin(), buffered.end(), less);
+  // Pairs of the runs are newer than the index, and keys removed in the 
+  // runs are dropped from the index
+  std::vector<KVT> in_runs;
+  std::vector<KT> removed;
+  if (runs != nullptr) {
+    runs->collect(begin, end, in_runs, &removed);
+    std::vector<KVT> newer;
+    newer.reserve(buffered.size() + in_runs.size());
+    std::merge(buffered.begin(), buffered.end(), in_runs.begin(), 
+               in_runs.end(), std::back_inserter(newer), less);
+    buffered.swap(newer);
+  }
+  std::vector<KVT> indexed;
+  if (enable_flow) {
+    // The flow is order-preserving, so the transformed bounds cover the 
+    // transformed keys in range
+    KKVT tran_begin = flow->transform({begin, VT()});
+    KKVT tran_end = flow->transform({end, VT()});
+    std::vector<KKVT> tran_res;
+    tran_index->scan(tran_begin.first, tran_end.first, tran_res);
+    indexed.reserve(tran_res.size());
+    for (uint32_t i = 0; i < tran_res.size(); ++ i) {
+      const KVT& kv = tran_res[i].second;
+      if (!(kv.first < begin) && !(end < kv.first)) {
+        indexed.push_back(kv);
+      }
+    }
+  } else {
+    index->scan(begin, end, indexed);
   }
-  unlock_buffer();
+  if (!removed.empty()) {
+    indexed.erase(std::remove_if(indexed.begin(), indexed.end(), 
+                                 [&](const KVT& kv) {
+                                   return std::binary_search(removed.begin(), 
+                                                             removed.end(), 
+                                                             kv.first);
+                                 }), indexed.end());
+  }
+  // Pairs of sealed tables may be flushed into the index meanwhile, so the 
+  // buffered one of equal keys is kept, which is merged first
+  uint32_t num = res.size();
+  std::merge(buffered.begin(), buffered.end(), indexed.begin(), indexed.end(), 
+             std::back_inserter(res), less);
+  res.erase(std::unique(res.begin() + num, res.end(), 
+                        [](const KVT& a, const KVT& b) { 
+                          return equal(a.first, b.first); 
+                        }), res.end());
+  return res.size() - num;
 }
 
 template<typename KT, typename VT>
-void NFLPara<KT, VT>::bg_insert(void* args) {
-  NFLPara<KT, VT>* nfl = (NFLPara<KT, VT>*)(args);
-  KVT* kvs = nfl->imm_buffer;
-  uint32_t size = nfl->max_buffer_size;
-  if (nfl->enable_flow) {
-    KKVT* tran_kvs = new KKVT[size];
-    nfl->flow->transform(kvs, size, tran_kvs);
-    for (uint32_t i = 0; i < size; ++ i) {
-      nfl->tran_index->insert(tran_kvs[i]);
+bool NFLPara<KT, VT>::lower_bound(KT key, KVT& res) {
+  return neighbor(key, true, true, res);
+}
+
+template<typename KT, typename VT>
+bool NFLPara<KT, VT>::predecessor(KT key, KVT& res) {
+  return neighbor(key, false, true, res);
+}
+
+template<typename KT, typename VT>
+bool NFLPara<KT, VT>::successor(KT key, KVT& res) {
+  return neighbor(key, true, false, res);
+}
+
+template<typename KT, typename VT>
+bool NFLPara<KT, VT>::neighbor(KT key, bool forward, bool inclusive, 
+                               KVT& res) {
+  ASSERT_WITH_MSG(!is_frozen, "The index is frozen")
+  // Take the nearer one of the candidates from the buffer and the index. The 
+  // flow is monotone, so the neighbor of the transformed key is the neighbor 
+  // of the original key.
+  auto nearer = [&](const KT& a, const KT& b) {
+    return forward ? a < b : b < a;
+  };
+  bool found = false;
+  std::vector<KVT> buffered;
+  buffer->collect([&](const KVT& kv) {
+    return inclusive ? !nearer(kv.first, key) : nearer(key, kv.first);
+  }, buffered);
+  for (const KVT& kv : buffered) {
+    if (!found || nearer(kv.first, res.first)) {
+      res = kv;
+      found = true;
     }
-    delete[] tran_kvs;
+  }
+  KVT kv;
+  if (runs != nullptr && runs->neighbor(key, forward, inclusive, kv) 
+      && (!found || nearer(kv.first, res.first))) {
+    res = kv;
+    found = true;
+  }
+  bool in_index = neighbor_index(key, forward, inclusive, kv);
+  // Skip the keys removed in the runs
+  VT value;
+  while (in_index && runs != nullptr 
+         && runs->find(kv.first, value) == RunSet<KT, VT>::kRemoved) {
+    in_index = neighbor_index(kv.first, forward, false, kv);
+  }
+  if (in_index && (!found || nearer(kv.first, res.first))) {
+    res = kv;
+    found = true;
+  }
+  return found;
+}
+
+template<typename KT, typename VT>
+double NFLPara<KT, VT>::approx_rank(KT key, double max_error) {
+  ASSERT_WITH_MSG(!is_frozen, "The index is frozen")
+  // Buffered keys are counted exactly
+  std::vector<KVT> buffered;
+  buffer->collect([&](const KVT& kv) { return kv.first < key; }, buffered);
+  uint64_t num_buffered = buffered.size();
+  if (runs != nullptr) {
+    num_buffered += runs->count(nullptr, key, false);
+  }
+  if (enable_flow) {
+    KKVT tran_kv = flow->transform({key, VT()});
+    return num_buffered + tran_index->approx_rank(tran_kv.first, max_error);
   } else {
-    for (uint32_t i = 0; i < size; ++ i) {
-      nfl->index->insert(kvs[i]);
+    return num_buffered + index->approx_rank(key, max_error);
+  }
+}
+
+template<typename KT, typename VT>
+double NFLPara<KT, VT>::estimate_count(KT begin, KT end, double max_error) {
+  ASSERT_WITH_MSG(!is_frozen, "The index is frozen")
+  std::vector<KVT> buffered;
+  buffer->collect([&](const KVT& kv) {
+    return !(kv.first < begin) && !(end < kv.first);
+  }, buffered);
+  uint64_t num_buffered = buffered.size();
+  if (runs != nullptr) {
+    num_buffered += runs->count(&begin, end, true);
+  }
+  if (enable_flow) {
+    KKVT tran_begin = flow->transform({begin, VT()});
+    KKVT tran_end = flow->transform({end, VT()});
+    return num_buffered + tran_index->estimate_count(tran_begin.first, 
+                                                     tran_end.first, 
+                                                     max_error);
+  } else {
+    return num_buffered + index->estimate_count(begin, end, max_error);
+  }
+}
+
+template<typename KT, typename VT>
+IngestStats NFLPara<KT, VT>::ingest_stats() {
+  IngestStats stats;
+  stats.num_batches = num_batches;
+  stats.num_stalls = num_stalls;
+  stats.stall_time = stall_time;
+  stats.num_in_flight = 0;
+  if (buffer != nullptr) {
+    for (uint32_t s = 0; s < buffer->num_shards; ++ s) {
+      stats.num_in_flight += buffer->num_sealed(s);
+    }
+  }
+  stats.num_runs = runs != nullptr ? runs->num_runs : 0;
+  stats.num_compactions = num_compactions;
+  return stats;
+}
+
+template<typename KT, typename VT>
+void NFLPara<KT, VT>::bg_transform(NFLPara<KT, VT>* nfl, uint32_t shard) {
+  // The sealed table stays searchable until its pairs are in the index
+  FlushBatch* batch = new FlushBatch();
+  batch->shard = shard;
+  nfl->buffer->sealed_pairs(shard, batch->kvs);
+  // Runs keep the original keys, which are transformed once compacted
+  if (nfl->enable_flow && nfl->runs == nullptr) {
+    batch->tran_kvs.resize(batch->kvs.size());
+    nfl->flow->transform(batch->kvs.data(), batch->kvs.size(), 
+                         batch->tran_kvs.data());
+  }
+  if (nfl->pool != nullptr) {
+    boost::asio::post(*nfl->pool, boost::bind(NFLPara<KT, VT>::bg_insert, 
+                                              nfl, batch));
+  } else {
+    NFLPara<KT, VT>::bg_insert(nfl, batch);
+  }
+}
+
+template<typename KT, typename VT>
+void NFLPara<KT, VT>::bg_insert(NFLPara<KT, VT>* nfl, FlushBatch* batch) {
+  if (nfl->runs != nullptr) {
+    std::sort(batch->kvs.begin(), batch->kvs.end(), 
+      [](auto const& a, auto const& b) {
+        return a.first < b.first;
+    });
+    // Back pressure, wait for compactions once runs pile up
+    while (nfl->compact_pool != nullptr && nfl->runs->num_runs 
+           >= nfl->kRunsStallFactor * nfl->max_runs) {
+      std::this_thread::yield();
+    }
+    nfl->runs->add(batch->kvs.data(), batch->kvs.size());
+    if (nfl->runs->need_compact() && nfl->runs->start_compact()) {
+      if (nfl->compact_pool != nullptr) {
+        boost::asio::post(*nfl->compact_pool, 
+                          boost::bind(NFLPara<KT, VT>::bg_compact, nfl));
+      } else {
+        NFLPara<KT, VT>::bg_compact(nfl);
+      }
+    }
+  } else if (nfl->enable_flow) {
+    // Keys may be in the index already, so the buffered values are upserted
+    nfl->tran_index->upsert_batch(batch->tran_kvs.data(), 
+                                  batch->tran_kvs.size());
+  } else {
+    nfl->index->upsert_batch(batch->kvs.data(), batch->kvs.size());
+  }
+  uint32_t shard = batch->shard;
+  delete batch;
+  nfl->num_batches ++;
+  if (nfl->buffer->release(shard)) {
+    nfl->flush(shard);
+  }
+}
+
+template<typename KT, typename VT>
+void NFLPara<KT, VT>::bg_compact(NFLPara<KT, VT>* nfl) {
+  // Runs made meanwhile may call for another compaction
+  do {
+    nfl->merge_runs();
+    nfl->runs->finish_compact();
+  } while (nfl->runs->need_compact() && nfl->runs->start_compact());
+}
+
+template<typename KT, typename VT>
+void NFLPara<KT, VT>::compact() {
+  ASSERT_WITH_MSG(!is_frozen, "The index is frozen")
+  if (runs == nullptr) {
+    return;
+  }
+  while (!runs->start_compact()) {
+    std::this_thread::yield();
+  }
+  merge_runs();
+  runs->finish_compact();
+}
+
+template<typename KT, typename VT>
+void NFLPara<KT, VT>::merge_runs() {
+  // The merged runs stay searchable until their pairs are in the index. 
+  // Overflowing buckets are rebuilt once by the batch.
+  typename RunSet<KT, VT>::Merged merged;
+  runs->lock_compact();
+  uint32_t num = runs->merge(merged);
+  if (enable_flow) {
+    std::vector<KKVT> tran_kvs(merged.kvs.size());
+    flow->transform(merged.kvs.data(), merged.kvs.size(), tran_kvs.data());
+    tran_index->upsert_batch(tran_kvs.data(), tran_kvs.size());
+  } else {
+    index->upsert_batch(merged.kvs.data(), merged.kvs.size());
+  }
+  for (const KT& key : merged.removed) {
+    remove_index(key);
+  }
+  runs->drop(num);
+  runs->unlock_compact();
+  num_compactions ++;
+}
+
+template<typename KT, typename VT>
+uint32_t NFLPara<KT, VT>::lock_shard(const KT& key, bool writable) {
+  uint32_t s = buffer->shard_of(key);
+  bool stalled = false;
+  std::chrono::high_resolution_clock::time_point stall_start;
+  while (true) {
+    buffer->lock(s);
+    bool sealed = false;
+    bool drain = false;
+    if (!buffer->in_sealed(s, key)) {
+      if (!writable || !buffer->full(s)) {
+        break;
+      }
+      sealed = buffer->seal(s, drain);
+    }
+    uint32_t num_sealed = buffer->num_sealed(s);
+    buffer->unlock(s);
+    if (drain) {
+      flush(s);
+    } else if (!sealed) {
+      // Back pressure, wait for a flush of the shard
+      if (!stalled) {
+        stalled = true;
+        stall_start = TIME_LOG;
+      }
+      while (buffer->num_sealed(s) == num_sealed) { 
+        std::this_thread::yield();
+      }
+    }
+  }
+  if (stalled) {
+    num_stalls ++;
+    stall_time += TIME_IN_NANO_SECOND(stall_start, TIME_LOG);
+  }
+  return s;
+}
+
+template<typename KT, typename VT>
+void NFLPara<KT, VT>::flush(uint32_t shard) {
+  if (tran_pool != nullptr) {
+    boost::asio::post(*tran_pool, boost::bind(NFLPara<KT, VT>::bg_transform, 
+                                              this, shard));
+  } else {
+    NFLPara<KT, VT>::bg_transform(this, shard);
+  }
+}
+
+template<typename KT, typename VT>
+template<typename Fn>
+bool NFLPara<KT, VT>::modify_index(KT key, Fn& fn) {
+  if (enable_flow) {
+    // The values of the transformed index are the original pairs
+    auto tran_fn = [&](KVT& kv) {
+      return fn(kv.second);
+    };
+    KKVT tran_kv = flow->transform({key, VT()});
+    return tran_index->modify(tran_kv.first, tran_fn);
+  } else {
+    return index->modify(key, fn);
+  }
+}
+
+template<typename KT, typename VT>
+template<typename Fn>
+typename RunSet<KT, VT>::State NFLPara<KT, VT>::modify_run(uint32_t s, 
+                                                          const KT& key, 
+                                                          Fn& fn) {
+  VT value;
+  typename RunSet<KT, VT>::State state = runs->find(key, value);
+  if (state == RunSet<KT, VT>::kLive && fn(value)) {
+    buffer->put(s, {key, value});
+  }
+  return state;
+}
+
+template<typename KT, typename VT>
+bool NFLPara<KT, VT>::remove_index(KT key) {
+  if (enable_flow) {
+    KKVT tran_kv = flow->transform({key, VT()});
+    return tran_index->remove(tran_kv.first);
+  } else {
+    return index->remove(key);
+  }
+}
+
+template<typename KT, typename VT>
+bool NFLPara<KT, VT>::neighbor_index(KT key, bool forward, bool inclusive, 
+                                     KVT& res) {
+  if (enable_flow) {
+    KKVT tran_kv = flow->transform({key, VT()});
+    bool found = tran_index->neighbor(tran_kv.first, forward, inclusive, 
+                                      tran_kv);
+    res = tran_kv.second;
+    return found;
+  } else {
+    return index->neighbor(key, forward, inclusive, res);
+  }
+}
+
+template<typename KT, typename VT>
+bool NFLPara<KT, VT>::find_frozen(KT key, VT& value) {
+  // No locks, the buffer is merged into the frozen index
+  if (enable_flow) {
+    KKVT tran_kv = flow->transform({key, VT()});
+    KVT kv;
+    bool res = frozen_tran_index->find(tran_kv.first, kv);
+    value = kv.second;
+    return res;
+  } else {
+    return frozen_index->find(key, value);
+  }
+}
+
+template<typename KT, typename VT>
+void NFLPara<KT, VT>::freeze(bool compress) {
+  ASSERT_WITH_MSG(!is_frozen, "The index is already frozen")
+  // Wait for the flushes of sealed tables
+  for (uint32_t s = 0; s < buffer->num_shards; ++ s) {
+    while (buffer->num_sealed(s) > 0) { 
+      std::this_thread::yield();
+    }
+  }
+  if (runs != nullptr) {
+    compact();
+    if (compact_pool != nullptr) {
+      compact_pool->join();
+    }
+    delete runs;
+    runs = nullptr;
+  }
+  std::vector<KVT> buffered;
+  buffer->collect([](const KVT&) { return true; }, buffered);
+  for (const KVT& kv : buffered) {
+    if (enable_flow) {
+      tran_index->upsert(flow->transform(kv));
+    } else {
+      index->upsert(kv);
     }
   }
-  delete[] nfl->imm_buffer;
-  nfl->imm_buffer = nullptr;
-  nfl->unlock_imm_buffer();
+  delete buffer;
+  buffer = nullptr;
+  if (enable_flow) {
+    frozen_tran_index = tran_index->freeze(compress);
+    delete tran_index;
+    tran_index = nullptr;
+  } else {
+    frozen_index = index->freeze(compress);
+    delete index;
+    index = nullptr;
+  }
+  is_frozen = true;
 }
 
 template<typename KT, typename VT>
 uint64_t NFLPara<KT, VT>::model_size() {
+  if (is_frozen) {
+    return enable_flow ? frozen_tran_index->model_size() + flow->size()
+                       : frozen_index->model_size();
+  }
+  uint64_t runs_size = runs != nullptr ? runs->model_size() : 0;
   if (enable_flow) {
-    return tran_index->model_size() + flow->size();
+    return tran_index->model_size() + flow->size() + runs_size;
   } else {
-    return index->model_size();
+    return index->model_size() + runs_size;
   }
 }
 
 template<typename KT, typename VT>
 uint64_t NFLPara<KT, VT>::index_size() {
+  uint64_t filter_size = filter != nullptr ? filter->size() : 0;
+  if (is_frozen) {
+    return (enable_flow ? frozen_tran_index->index_size() + flow->size()
+                        : frozen_index->index_size())
+           + sizeof(NFLPara<KT, VT>) + filter_size;
+  }
+  uint64_t buffer_size = buffer->size() 
+                         + (runs != nullptr ? runs->size() : 0);
   if (enable_flow) {
     return tran_index->index_size() + flow->size() 
-          + sizeof(NFLPara<KT, VT>);
+          + sizeof(NFLPara<KT, VT>) + filter_size + buffer_size;
   } else {
-    return index->index_size() + sizeof(NFLPara<KT, VT>);
+    return index->index_size() + sizeof(NFLPara<KT, VT>) + filter_size 
+           + buffer_size;
   }
 }
 
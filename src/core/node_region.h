@@ -0,0 +1,126 @@
+#ifndef NODE_REGION_PARA_H
+#define NODE_REGION_PARA_H
+
+#include <sys/mman.h>
+
+#include "core/common.h"
+
+namespace aflipara {
+
+// A contiguous home for nodes built by bulk loads, filled in the order of the
+// node layout. Memory is mapped in chunks aligned to and advised for huge
+// pages, and is only released with the region. The heads of nodes (nodes and
+// their models) and the arrays of nodes are bumped in two areas, so the heads
+// of the upper levels share a few pages whatever the sizes of the arrays.
+class NodeRegion {
+public:
+  static const uint64_t kHugePage = 1 << 21;
+  static const uint64_t kHeadChunk = kHugePage;
+  static const uint64_t kArrayChunk = 1 << 26;
+  static const uint64_t kAlign = 64;
+
+  struct Area {
+    std::vector<std::pair<char*, uint64_t>> chunks;  // Mapped chunks and their sizes
+    uint64_t                  chunk_size;
+    char*                     cur;
+    uint64_t                  left;
+    uint64_t                  used;
+  };
+
+  Area                        heads;
+  Area                        arrays;
+  volatile uint8_t            region_lock;
+
+public:
+  NodeRegion() : region_lock(0) {
+    init(heads, kHeadChunk);
+    init(arrays, kArrayChunk);
+  }
+
+  ~NodeRegion() {
+    release(heads);
+    release(arrays);
+  }
+
+  template<typename T, typename... Args>
+  T* create_head(Args&&... args) {
+    return new (alloc(heads, sizeof(T), alignof(T))) T(
+                 std::forward<Args>(args)...);
+  }
+
+  inline void* alloc_array(uint64_t bytes) {
+    return alloc(arrays, bytes, kAlign);
+  }
+
+  // The bytes taken by nodes
+  inline uint64_t size() const { return heads.used + arrays.used; }
+
+private:
+  static void init(Area& area, uint64_t chunk_size) {
+    area.chunk_size = chunk_size;
+    area.cur = nullptr;
+    area.left = 0;
+    area.used = 0;
+  }
+
+  static void release(Area& area) {
+    for (auto& chunk : area.chunks) {
+      munmap(chunk.first, chunk.second);
+    }
+    area.chunks.clear();
+    init(area, area.chunk_size);
+  }
+
+  void* alloc(Area& area, uint64_t bytes, uint64_t align) {
+    lock();
+    uint64_t pad = (align - reinterpret_cast<uint64_t>(area.cur) % align)
+                   % align;
+    if (area.cur == nullptr || pad + bytes > area.left) {
+      // Arrays larger than a chunk take their own chunks
+      uint64_t size = std::max(area.chunk_size, (bytes + kHugePage - 1)
+                                                / kHugePage * kHugePage);
+      area.cur = map_chunk(size);
+      area.left = size;
+      area.chunks.push_back({area.cur, size});
+      pad = 0;
+    }
+    char* res = area.cur + pad;
+    area.cur = res + bytes;
+    area.left -= pad + bytes;
+    area.used += pad + bytes;
+    unlock();
+    return res;
+  }
+
+  static char* map_chunk(uint64_t size) {
+    // Over-map by a huge page and trim both ends to align the chunk
+    char* raw = (char*)mmap(nullptr, size + kHugePage, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ASSERT_WITH_MSG(raw != MAP_FAILED, "Cannot map a node chunk of " << size
+                    << " bytes")
+    uint64_t head = (kHugePage - reinterpret_cast<uint64_t>(raw) % kHugePage)
+                    % kHugePage;
+    if (head > 0) {
+      munmap(raw, head);
+    }
+    munmap(raw + head + size, kHugePage - head);
+#ifdef MADV_HUGEPAGE
+    madvise(raw + head, size, MADV_HUGEPAGE);
+#endif
+    return raw + head;
+  }
+
+  void lock() {
+    uint8_t unlocked = 0, locked = 1;
+    while (unlikely(cmpxchgb((uint8_t *)&region_lock, unlocked, locked)
+                    != unlocked)) { }
+  }
+
+  void unlock() {
+    region_lock = 0;
+  }
+};
+
+}
+
+#endif
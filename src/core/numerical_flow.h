@@ -11,66 +11,79 @@ class NumericalFlow {
 typedef std::pair<KT, VT> KVT;
 typedef std::pair<double, KVT> KKVT;
 public:
-  double mean;
-  double var;
-  MKL_INT batch_size;
-  BNAF_Infer<KT, VT> model;
+  double sign;      // '-1' reverses the outputs of an order-reversing flow
+  uint32_t batch_size;
+  // The weights may be shared with other flows, and transforms use the 
+  // workspaces of their threads, so they run concurrently
+  std::shared_ptr<const BNAF_Infer<KT, VT>> model;
 
 public:
   explicit NumericalFlow(std::string weight_path, uint32_t bs) 
-    : batch_size(bs) {
-    load(weight_path);
-    model.set_batch_size(bs);
-  }
+    : NumericalFlow(BNAF_Infer<KT, VT>::load(weight_path), bs) { }
+
+  explicit NumericalFlow(std::shared_ptr<const BNAF_Infer<KT, VT>> m, 
+                         uint32_t bs) 
+    : sign(1), batch_size(bs), model(m) { }
 
   uint64_t size() {
-    return sizeof(NumericalFlow<KT, VT>) - sizeof(BNAF_Infer<KT, VT>) + model.size();
+    return sizeof(NumericalFlow<KT, VT>) + model->size();
   }
 
   void set_batch_size(uint32_t bs) {
     batch_size = bs;
-    model.set_batch_size(batch_size);
   }
 
   void transform(const KVT* kvs, uint32_t size, KKVT* tran_kvs) {
     for (uint32_t i = 0; i < size; ++ i) {
-      tran_kvs[i] = {(kvs[i].first - mean) / var, kvs[i]};
+      tran_kvs[i] = {(kvs[i].first - model->mean) / model->var, kvs[i]};
     }
+    typename BNAF_Infer<KT, VT>::Workspace& ws 
+      = BNAF_Infer<KT, VT>::local_workspace();
     uint32_t num_batches = static_cast<uint32_t>(std::ceil(size * 1. / batch_size));
     for (uint32_t i = 0; i < num_batches; ++ i) {
       uint32_t l = i * batch_size;
       uint32_t r = std::min((i + 1) * batch_size, size);
-      model.transform(tran_kvs + l, r - l);
+      model->transform(tran_kvs + l, r - l, ws);
+    }
+    if (sign < 0) {
+      for (uint32_t i = 0; i < size; ++ i) {
+        tran_kvs[i].first = -tran_kvs[i].first;
+      }
     }
   }
 
-  KKVT transform(const KVT& kv) {
-    KKVT t_kv = {(kv.first - mean) / var, kv};
-    model.transform(&t_kv, 1);
-    return t_kv;
-  }
-
-private:
-  void load(std::string path) {
-    std::fstream in(path, std::ios::in);
-    if (!in.is_open()) {
-      std::cout << "File:" << path << " doesn't exist" << std::endl;
-      exit(-1);
+  // Split the pairs into chunks of whole batches, transformed by 'num_threads'
+  // threads (the calling one included) into their parts of 'tran_kvs'. Each 
+  // thread infers in its own workspace, so the outputs are the same as of a
+  // single thread.
+  void transform(const KVT* kvs, uint32_t size, KKVT* tran_kvs, 
+                 uint32_t num_threads) {
+    uint64_t num_batches = (static_cast<uint64_t>(size) + batch_size - 1) 
+                           / batch_size;
+    num_threads = std::min<uint64_t>(std::max(num_threads, 1U), num_batches);
+    if (num_threads <= 1) {
+      transform(kvs, size, tran_kvs);
+      return;
     }
-    in >> model.in_dim >> model.hidden_dim >> model.num_layers;
-    in >> mean >> var;
-    model.weights = new double*[model.num_layers];
-    for (uint32_t w = 0; w < model.num_layers; ++ w) {
-      uint32_t n, m;
-      in >> n >> m;
-      model.weights[w] = (double*)mkl_calloc(n * m, sizeof(double), 64);
-      for (uint32_t i = 0; i < n; ++ i) {
-        for (uint32_t j = 0; j < m; ++ j) {
-          in >> model.weights[w][i * m + j];
-        }
-      }
+    uint64_t chunk_size = (num_batches + num_threads - 1) / num_threads 
+                          * batch_size;
+    boost::asio::thread_pool workers(num_threads - 1);
+    for (uint32_t t = 1; t < num_threads; ++ t) {
+      uint64_t l = std::min<uint64_t>(t * chunk_size, size);
+      uint64_t r = std::min<uint64_t>(l + chunk_size, size);
+      boost::asio::post(workers, [this, kvs, tran_kvs, l, r]() {
+        transform(kvs + l, r - l, tran_kvs + l);
+      });
     }
-    in.close();
+    transform(kvs, std::min<uint64_t>(chunk_size, size), tran_kvs);
+    workers.join();
+  }
+
+  KKVT transform(const KVT& kv) {
+    KKVT t_kv = {(kv.first - model->mean) / model->var, kv};
+    model->transform(&t_kv, 1, BNAF_Infer<KT, VT>::local_workspace());
+    t_kv.first = t_kv.first * sign;
+    return t_kv;
   }
 
 };
@@ -0,0 +1,123 @@
+#ifndef REF_ARENA_PARA_H
+#define REF_ARENA_PARA_H
+
+#include "core/common.h"
+
+namespace aflipara {
+
+// Objects referred by 32-bit offsets instead of pointers. Objects are placed
+// in chunks that are never moved or released, so a reference is resolved by
+// one lookup of the chunk table without locks. Freed references are reused.
+// Objects must have a 'ref' member, and '0' is the null reference.
+//
+// The chunk table starts empty and doubles when it is full. Replaced tables 
+// are kept until the arena is released, as readers may still hold them.
+template<typename T>
+class RefArena {
+public:
+  static const uint32_t kChunkBits = 12;
+  static const uint32_t kChunkSize = 1 << kChunkBits;
+  static const uint32_t kMaxChunks = 1 << (32 - kChunkBits);
+  static const uint32_t kMinTableSize = 16;
+
+  T** volatile                chunks;
+  uint32_t                    table_size;
+  uint32_t                    num_chunks;
+  uint32_t                    num_refs;
+  std::vector<uint32_t>       free_refs;
+  std::vector<T**>            old_tables;
+  volatile uint8_t            arena_lock;
+
+public:
+  RefArena() : chunks(nullptr), table_size(0), num_chunks(0), num_refs(1), 
+               arena_lock(0) { }
+
+  ~RefArena() {
+    for (uint32_t i = 0; i < num_chunks; ++ i) {
+      free(chunks[i]);
+    }
+    delete[] (T**)chunks;
+    for (T** table : old_tables) {
+      delete[] table;
+    }
+  }
+
+  RefArena(const RefArena&) = delete;
+  RefArena& operator=(const RefArena&) = delete;
+
+  template<typename... Args>
+  T* create(Args&&... args) {
+    uint32_t ref = alloc();
+    T* obj = new (get(ref)) T(std::forward<Args>(args)...);
+    obj->ref = ref;
+    return obj;
+  }
+
+  void destroy(T* obj) {
+    uint32_t ref = obj->ref;
+    obj->~T();
+    lock();
+    free_refs.push_back(ref);
+    unlock();
+  }
+
+  inline T* get(uint32_t ref) {
+    return chunks[ref >> kChunkBits] + (ref & (kChunkSize - 1));
+  }
+
+private:
+  uint32_t alloc() {
+    lock();
+    uint32_t ref = 0;
+    if (!free_refs.empty()) {
+      ref = free_refs.back();
+      free_refs.pop_back();
+    } else {
+      ref = num_refs ++;
+      if ((ref >> kChunkBits) == num_chunks) {
+        ASSERT_WITH_MSG(num_chunks < kMaxChunks, "The arena is full")
+        if (num_chunks == table_size) {
+          grow_table();
+        }
+        // The chunk is published before any reference to it
+        chunks[num_chunks] = (T*)aligned_alloc(alignof(T) < 64 ? 64
+                                               : alignof(T),
+                                               sizeof(T) * kChunkSize);
+        num_chunks ++;
+      }
+    }
+    unlock();
+    return ref;
+  }
+
+  // The new table is filled before it is published
+  void grow_table() {
+    uint32_t new_size = table_size == 0 ? kMinTableSize 
+                        : std::min(table_size * 2, kMaxChunks);
+    T** table = new T*[new_size];
+    memset(table, 0, sizeof(T*) * new_size);
+    if (num_chunks > 0) {
+      memcpy(table, (T**)chunks, sizeof(T*) * num_chunks);
+    }
+    fence();
+    if (chunks != nullptr) {
+      old_tables.push_back((T**)chunks);
+    }
+    chunks = table;
+    table_size = new_size;
+  }
+
+  void lock() {
+    uint8_t unlocked = 0, locked = 1;
+    while (unlikely(cmpxchgb((uint8_t *)&arena_lock, unlocked, locked)
+                    != unlocked)) { }
+  }
+
+  void unlock() {
+    arena_lock = 0;
+  }
+};
+
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef RUN_SET_PARA_H
+#define RUN_SET_PARA_H
+
+#include "core/bloom_filter.h"
+#include "core/key_codec.h"
+#include "core/linear_model.h"
+#include "core/common.h"
+
+namespace aflipara {
+
+// The sorted runs of the tiered write path of NFLPara. Flushed tables become
+// immutable runs of pairs sorted by keys, each with a linear model bounded by
+// its maximum error and a Bloom filter. Keys are searched in the runs newest
+// first, and the newest pair of a key decides, so removed keys are marked in
+// the run of their newest pairs as tombstones. The list of runs is replaced
+// as a whole on changes, and readers enter one of two epochs, so replaced
+// lists and merged runs are released after the readers of the past epoch.
+template<typename KT, typename VT>
+class RunSet {
+typedef std::pair<KT, VT> KVT;
+public:
+  static const uint32_t kBitsPerKey = 10;
+
+  enum State {
+    kAbsent = 0,
+    kLive = 1,
+    kRemoved = 2,
+  };
+
+  struct Run {
+    KVT*                      kvs;
+    uint32_t                  size;
+    LinearModel               model;
+    typename KeyCodec<KT>::Prefix prefix;
+    uint32_t                  max_error;  // The maximum distance of predicted positions
+    BlockedBloomFilter        filter;
+    uint64_t*                 removed;    // Tombstones, a bit per pair
+
+    Run(const KVT* kvs, uint32_t size);
+    ~Run();
+
+    // The position of the key, '-1' if absent
+    int64_t search(const KT& key, uint64_t h) const;
+    // The first position not less than the key
+    uint32_t lower_bound(const KT& key) const;
+    inline bool is_removed(uint32_t pos) const {
+      return (__atomic_load_n(&removed[pos >> 6], __ATOMIC_ACQUIRE)
+              >> (pos & 63)) & 1;
+    }
+  };
+
+  // Pairs of the merged runs, the newest of each key
+  struct Merged {
+    std::vector<KVT>          kvs;        // Live pairs sorted by keys
+    std::vector<KT>           removed;    // Keys removed since the runs were made
+  };
+
+  uint32_t                    max_runs;   // Compact once reached
+  std::vector<Run*>* volatile runs;       // Newest first
+  volatile uint32_t           num_runs;
+  volatile uint32_t           epoch;
+  std::atomic<uint64_t>       readers[2];
+  volatile uint8_t            set_lock;   // Serializes the replacements of the list
+  volatile uint8_t            compact_lock;  // Tombstones and compactions wait for each other
+  volatile uint8_t            compacting;
+
+public:
+  RunSet() = delete;
+  explicit RunSet(uint32_t max_runs);
+  ~RunSet();
+
+  inline bool need_compact() const {
+    return !compacting && num_runs >= max_runs;
+  }
+  // Only one compaction runs at a time
+  bool start_compact();
+  inline void finish_compact() { compacting = 0; }
+
+  // Reads without locks
+  State find(const KT& key, VT& value);
+  // Copy the newest pairs of keys in [begin, end]. Removed keys are copied
+  // to 'removed' if it is not 'nullptr'.
+  void collect(const KT& begin, const KT& end, std::vector<KVT>& res,
+               std::vector<KT>* removed);
+  // The nearest live pair following (or preceding) the key
+  bool neighbor(const KT& key, bool forward, bool inclusive, KVT& res);
+  // The number of live keys in [begin, end], or less than 'end' if 'begin'
+  // is 'nullptr'
+  uint64_t count(const KT* begin, const KT& end, bool inclusive);
+
+  // Publish a run of pairs sorted by distinct keys as the newest one
+  void add(const KVT* kvs, uint32_t size);
+  // Mark the newest pair of the key removed under the compaction lock,
+  // returns the state of the key before
+  State remove(const KT& key);
+  void lock_compact();
+  void unlock_compact();
+  // Merge the runs of now into the newest pairs of keys, then drop these
+  // runs once the pairs are in the index. Both are under the compaction lock.
+  uint32_t merge(Merged& merged);
+  void drop(uint32_t num);
+
+  uint64_t model_size();
+  uint64_t size();
+
+private:
+  inline uint32_t enter();
+  inline void leave(uint32_t e);
+  // Wait for the readers of the past epoch, under the set lock
+  void synchronize();
+  // Replace the list and release the old one, under the set lock
+  void publish(std::vector<Run*>* list);
+  void lock_set();
+  void unlock_set();
+  // The newest run holding the key and the position in it, '-1' if absent
+  static int64_t newest(const std::vector<Run*>& list, const KT& key,
+                        int64_t& pos);
+  static State state_of(const Run* run, int64_t pos, VT* value);
+};
+
+}
+
+#endif
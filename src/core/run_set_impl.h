@@ -0,0 +1,383 @@
+#ifndef RUN_SET_PARA_IMPL_H
+#define RUN_SET_PARA_IMPL_H
+
+#include "core/run_set.h"
+
+namespace aflipara {
+
+template<typename KT, typename VT>
+RunSet<KT, VT>::Run::Run(const KVT* pairs, uint32_t s)
+                         : size(s), filter(s, kBitsPerKey) {
+  kvs = new KVT[size];
+  std::copy(pairs, pairs + size, kvs);
+  removed = new uint64_t[(size + 63) / 64]();
+  prefix = KeyCodec<KT>::make_prefix(kvs[0].first, kvs[size - 1].first);
+  LinearModelBuilder builder;
+  for (uint32_t i = 0; i < size; ++ i) {
+    builder.add(KeyCodec<KT>::encode(kvs[i].first, prefix), i);
+    filter.add(hash_key(kvs[i].first));
+  }
+  builder.build(&model);
+  max_error = 0;
+  for (uint32_t i = 0; i < size; ++ i) {
+    int64_t p = model.predict(KeyCodec<KT>::encode(kvs[i].first, prefix));
+    max_error = std::max<int64_t>(max_error, std::abs(p - i));
+  }
+}
+
+template<typename KT, typename VT>
+RunSet<KT, VT>::Run::~Run() {
+  delete[] kvs;
+  delete[] removed;
+}
+
+template<typename KT, typename VT>
+int64_t RunSet<KT, VT>::Run::search(const KT& key, uint64_t h) const {
+  if (!filter.may_contain(h)) {
+    return -1;
+  }
+  int64_t p = model.predict(KeyCodec<KT>::encode(key, prefix));
+  int64_t lo = std::max(p - max_error, 0L);
+  int64_t hi = std::min(p + max_error + 1, static_cast<int64_t>(size));
+  if (lo >= hi) {
+    return -1;
+  }
+  KVT* it = std::lower_bound(kvs + lo, kvs + hi, key,
+    [](const KVT& kv, const KT& k) {
+      return kv.first < k;
+  });
+  if (it != kvs + hi && equal(it->first, key)) {
+    return it - kvs;
+  }
+  return -1;
+}
+
+template<typename KT, typename VT>
+uint32_t RunSet<KT, VT>::Run::lower_bound(const KT& key) const {
+  return std::lower_bound(kvs, kvs + size, key,
+    [](const KVT& kv, const KT& k) {
+      return kv.first < k;
+  }) - kvs;
+}
+
+template<typename KT, typename VT>
+RunSet<KT, VT>::RunSet(uint32_t mr) : max_runs(std::max(mr, 1U)) {
+  runs = new std::vector<Run*>();
+  num_runs = 0;
+  epoch = 0;
+  readers[0] = 0;
+  readers[1] = 0;
+  set_lock = 0;
+  compact_lock = 0;
+  compacting = 0;
+}
+
+template<typename KT, typename VT>
+RunSet<KT, VT>::~RunSet() {
+  for (Run* run : *runs) {
+    delete run;
+  }
+  delete runs;
+}
+
+template<typename KT, typename VT>
+bool RunSet<KT, VT>::start_compact() {
+  uint8_t idle = 0, busy = 1;
+  return cmpxchgb((uint8_t *)&compacting, idle, busy) == idle;
+}
+
+template<typename KT, typename VT>
+typename RunSet<KT, VT>::State RunSet<KT, VT>::find(const KT& key,
+                                                    VT& value) {
+  uint32_t e = enter();
+  int64_t pos = -1;
+  int64_t i = newest(*runs, key, pos);
+  State res = i < 0 ? kAbsent : state_of((*runs)[i], pos, &value);
+  leave(e);
+  return res;
+}
+
+template<typename KT, typename VT>
+void RunSet<KT, VT>::collect(const KT& begin, const KT& end,
+                             std::vector<KVT>& res,
+                             std::vector<KT>* removed) {
+  uint32_t e = enter();
+  const std::vector<Run*>& list = *runs;
+  uint32_t num = res.size();
+  for (uint32_t i = 0; i < list.size(); ++ i) {
+    const Run* run = list[i];
+    for (uint32_t p = run->lower_bound(begin);
+         p < run->size && !(end < run->kvs[p].first); ++ p) {
+      const KT& key = run->kvs[p].first;
+      int64_t pos = -1;
+      // Pairs shadowed by newer runs are taken there
+      if (newest(list, key, pos) != static_cast<int64_t>(i)) {
+        continue;
+      }
+      if (!run->is_removed(p)) {
+        res.push_back(run->kvs[p]);
+      } else if (removed != nullptr) {
+        removed->push_back(key);
+      }
+    }
+  }
+  leave(e);
+  std::sort(res.begin() + num, res.end(),
+    [](auto const& a, auto const& b) {
+      return a.first < b.first;
+  });
+  if (removed != nullptr) {
+    std::sort(removed->begin(), removed->end());
+  }
+}
+
+template<typename KT, typename VT>
+bool RunSet<KT, VT>::neighbor(const KT& key, bool forward, bool inclusive,
+                              KVT& res) {
+  auto nearer = [&](const KT& a, const KT& b) {
+    return forward ? a < b : b < a;
+  };
+  bool found = false;
+  uint32_t e = enter();
+  const std::vector<Run*>& list = *runs;
+  for (uint32_t i = 0; i < list.size(); ++ i) {
+    const Run* run = list[i];
+    int64_t p = run->lower_bound(key);
+    bool at_key = p < run->size && equal(run->kvs[p].first, key);
+    if (forward) {
+      p += at_key && !inclusive;
+    } else {
+      p -= !(at_key && inclusive);
+    }
+    // Skip the pairs removed or shadowed by removals of newer runs
+    for (; p >= 0 && p < run->size; p += forward ? 1 : -1) {
+      const KT& k = run->kvs[p].first;
+      if (found && !nearer(k, res.first)) {
+        break;
+      }
+      int64_t pos = -1;
+      int64_t j = newest(list, k, pos);
+      VT value;
+      if (state_of(list[j], pos, &value) == kLive) {
+        res = {k, value};
+        found = true;
+        break;
+      }
+    }
+  }
+  leave(e);
+  return found;
+}
+
+template<typename KT, typename VT>
+uint64_t RunSet<KT, VT>::count(const KT* begin, const KT& end,
+                               bool inclusive) {
+  uint64_t res = 0;
+  uint32_t e = enter();
+  const std::vector<Run*>& list = *runs;
+  for (uint32_t i = 0; i < list.size(); ++ i) {
+    const Run* run = list[i];
+    uint32_t p = begin == nullptr ? 0 : run->lower_bound(*begin);
+    for (; p < run->size; ++ p) {
+      const KT& k = run->kvs[p].first;
+      if (inclusive ? end < k : !(k < end)) {
+        break;
+      }
+      int64_t pos = -1;
+      res += newest(list, k, pos) == static_cast<int64_t>(i)
+             && !run->is_removed(p);
+    }
+  }
+  leave(e);
+  return res;
+}
+
+template<typename KT, typename VT>
+void RunSet<KT, VT>::add(const KVT* kvs, uint32_t size) {
+  if (size == 0) {
+    return;
+  }
+  Run* run = new Run(kvs, size);
+  lock_set();
+  std::vector<Run*>* list = new std::vector<Run*>();
+  list->reserve(runs->size() + 1);
+  list->push_back(run);
+  list->insert(list->end(), runs->begin(), runs->end());
+  publish(list);
+  unlock_set();
+}
+
+template<typename KT, typename VT>
+typename RunSet<KT, VT>::State RunSet<KT, VT>::remove(const KT& key) {
+  uint32_t e = enter();
+  int64_t pos = -1;
+  int64_t i = newest(*runs, key, pos);
+  State res = kAbsent;
+  if (i >= 0) {
+    Run* run = (*runs)[i];
+    res = state_of(run, pos, nullptr);
+    __atomic_fetch_or(&run->removed[pos >> 6], 1ULL << (pos & 63),
+                      __ATOMIC_RELEASE);
+  }
+  leave(e);
+  return res;
+}
+
+template<typename KT, typename VT>
+void RunSet<KT, VT>::lock_compact() {
+  // Held through compactions, so waiters yield
+  uint8_t unlocked = 0, locked = 1;
+  while (unlikely(cmpxchgb((uint8_t *)&compact_lock, unlocked, locked)
+                  != unlocked)) {
+    std::this_thread::yield();
+  }
+}
+
+template<typename KT, typename VT>
+void RunSet<KT, VT>::unlock_compact() {
+  compact_lock = 0;
+}
+
+template<typename KT, typename VT>
+uint32_t RunSet<KT, VT>::merge(Merged& merged) {
+  // Runs are only released under the compaction lock, and the list may be
+  // replaced by newer runs meanwhile
+  lock_set();
+  std::vector<Run*> list = *runs;
+  unlock_set();
+  std::vector<std::pair<KVT, bool>> pairs;
+  for (const Run* run : list) {
+    for (uint32_t p = 0; p < run->size; ++ p) {
+      pairs.push_back({run->kvs[p], run->is_removed(p)});
+    }
+  }
+  // Pairs of newer runs come first, and are kept by the stable sort
+  std::stable_sort(pairs.begin(), pairs.end(),
+    [](auto const& a, auto const& b) {
+      return a.first.first < b.first.first;
+  });
+  for (uint32_t i = 0; i < pairs.size(); ++ i) {
+    if (i > 0 && equal(pairs[i].first.first, pairs[i - 1].first.first)) {
+      continue;
+    }
+    if (pairs[i].second) {
+      merged.removed.push_back(pairs[i].first.first);
+    } else {
+      merged.kvs.push_back(pairs[i].first);
+    }
+  }
+  return list.size();
+}
+
+template<typename KT, typename VT>
+void RunSet<KT, VT>::drop(uint32_t num) {
+  lock_set();
+  // The merged runs are the oldest ones
+  std::vector<Run*> dropped(runs->end() - num, runs->end());
+  publish(new std::vector<Run*>(runs->begin(), runs->end() - num));
+  unlock_set();
+  for (Run* run : dropped) {
+    delete run;
+  }
+}
+
+template<typename KT, typename VT>
+uint64_t RunSet<KT, VT>::model_size() {
+  uint32_t e = enter();
+  uint64_t res = runs->size() * (sizeof(LinearModel)
+                                 + sizeof(typename KeyCodec<KT>::Prefix));
+  leave(e);
+  return res;
+}
+
+template<typename KT, typename VT>
+uint64_t RunSet<KT, VT>::size() {
+  uint32_t e = enter();
+  uint64_t res = sizeof(RunSet<KT, VT>);
+  for (Run* run : *runs) {
+    res += sizeof(Run) + sizeof(Run*) + run->size * sizeof(KVT)
+           + (run->size + 63) / 64 * sizeof(uint64_t) + run->filter.size();
+  }
+  leave(e);
+  return res;
+}
+
+template<typename KT, typename VT>
+inline uint32_t RunSet<KT, VT>::enter() {
+  while (true) {
+    uint32_t e = epoch;
+    readers[e & 1] ++;
+    // The epoch may be advanced before the reader is counted
+    if (epoch == e) {
+      return e;
+    }
+    readers[e & 1] --;
+  }
+}
+
+template<typename KT, typename VT>
+inline void RunSet<KT, VT>::leave(uint32_t e) {
+  readers[e & 1] --;
+}
+
+template<typename KT, typename VT>
+void RunSet<KT, VT>::synchronize() {
+  uint32_t e = epoch;
+  epoch = e + 1;
+  fence();
+  while (readers[e & 1] != 0) {
+    std::this_thread::yield();
+  }
+}
+
+template<typename KT, typename VT>
+void RunSet<KT, VT>::publish(std::vector<Run*>* list) {
+  std::vector<Run*>* old = runs;
+  runs = list;
+  num_runs = list->size();
+  fence();
+  synchronize();
+  delete old;
+}
+
+template<typename KT, typename VT>
+void RunSet<KT, VT>::lock_set() {
+  uint8_t unlocked = 0, locked = 1;
+  while (unlikely(cmpxchgb((uint8_t *)&set_lock, unlocked, locked)
+                  != unlocked)) { }
+}
+
+template<typename KT, typename VT>
+void RunSet<KT, VT>::unlock_set() {
+  set_lock = 0;
+}
+
+template<typename KT, typename VT>
+int64_t RunSet<KT, VT>::newest(const std::vector<Run*>& list, const KT& key,
+                               int64_t& pos) {
+  uint64_t h = hash_key(key);
+  for (uint32_t i = 0; i < list.size(); ++ i) {
+    pos = list[i]->search(key, h);
+    if (pos >= 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+template<typename KT, typename VT>
+typename RunSet<KT, VT>::State RunSet<KT, VT>::state_of(const Run* run,
+                                                        int64_t pos,
+                                                        VT* value) {
+  if (run->is_removed(pos)) {
+    return kRemoved;
+  }
+  if (value != nullptr) {
+    *value = run->kvs[pos].second;
+  }
+  return kLive;
+}
+
+}
+
+#endif
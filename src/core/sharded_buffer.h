@@ -0,0 +1,114 @@
+#ifndef SHARDED_BUFFER_PARA_H
+#define SHARDED_BUFFER_PARA_H
+
+#include "core/bloom_filter.h"
+#include "core/common.h"
+
+namespace aflipara {
+
+// The write buffer of NFLPara, sharded by the hashes of keys. Each shard has
+// a ring of tables, an active table taking writes and a bounded queue of
+// sealed tables waiting to be flushed into the index, oldest first. Tables
+// are open-addressing hash tables, whose tags are probed 16 at a time by
+// SIMD. Writers of a shard hold its lock and make the version odd while
+// writing, and readers take no locks and write nothing, they retry if the
+// version changes (a seqlock). Tables are allocated once and reused around
+// the ring, so readers never touch released memory.
+template<typename KT, typename VT>
+class ShardedBuffer {
+typedef std::pair<KT, VT> KVT;
+public:
+  static const uint32_t kGroupSize = 16;
+  static const uint8_t kEmpty = 0;
+  static const uint8_t kDeleted = 1;
+  static const uint32_t kMinShardSize = 16;
+  static const uint32_t kQueueDepth = 4;
+
+  struct Table {
+    uint8_t*                  tags;      // 'kEmpty', 'kDeleted' or the high bits of hashes
+    KVT*                      slots;
+    uint32_t                  num_used;  // The taken slots, including deleted ones
+  };
+
+  struct alignas(64) Shard {
+    volatile uint32_t         version;   // Odd while written
+    volatile uint8_t          shard_lock;
+    volatile bool             draining;  // Whether the oldest sealed table is being flushed
+    uint32_t                  active;    // The index of the active table in the ring
+    volatile uint32_t         num_sealed; // The sealed tables preceding the active one
+    Table*                    tables;
+  };
+
+  uint32_t                    num_shards;
+  uint32_t                    shard_size;  // The used slots of a full table
+  uint32_t                    num_groups;  // The groups of tags of a table
+  uint32_t                    num_tables;  // The tables of a ring
+  Shard*                      shards;
+
+public:
+  ShardedBuffer() = delete;
+  // 'num_shards' is rounded up to a power of two, and the size of the buffer
+  // is split among the shards. At most 'queue_depth' tables of a shard are
+  // sealed and not flushed yet.
+  explicit ShardedBuffer(uint32_t max_size, uint32_t num_shards, 
+                         uint32_t queue_depth=kQueueDepth);
+  ~ShardedBuffer();
+
+  inline uint32_t shard_of(const KT& key) const;
+
+  // Reads without locks
+  bool find(const KT& key, VT& value);
+  // Copy the pairs satisfying 'pred' of all tables of all shards, older 
+  // pairs of the keys in newer tables are skipped
+  template<typename Pred>
+  void collect(Pred pred, std::vector<KVT>& res);
+
+  // Writes under the lock of the shard
+  void lock(uint32_t s);
+  void unlock(uint32_t s);
+  inline bool full(uint32_t s) const;
+  inline uint32_t num_sealed(uint32_t s) const { 
+    return shards[s].num_sealed; 
+  }
+  inline bool queue_full(uint32_t s) const { 
+    return shards[s].num_sealed + 1 == num_tables; 
+  }
+  bool in_sealed(uint32_t s, const KT& key) const;
+  // Overwrite the value if the key is in the active table, otherwise insert
+  // the pair. The active table must not be full.
+  void put(uint32_t s, const KVT& kv);
+  // 'fn' takes a copy of the value in the active table and returns whether
+  // to write it back
+  template<typename Fn>
+  bool modify(uint32_t s, const KT& key, Fn& fn);
+  bool erase(uint32_t s, const KT& key);
+  // Queue the active table to be flushed, fails if the queue is full. 
+  // 'drain' tells whether the shard starts draining, otherwise the table is 
+  // flushed after the older ones.
+  bool seal(uint32_t s, bool& drain);
+  // Copy the pairs of the oldest sealed table, no lock is needed
+  void sealed_pairs(uint32_t s, std::vector<KVT>& res) const;
+  // Clear the flushed oldest table, the lock is taken inside. Returns 
+  // whether more sealed tables are left to flush.
+  bool release(uint32_t s);
+
+  uint64_t size() const;
+
+private:
+  inline void begin_write(Shard& shard);
+  inline void end_write(Shard& shard);
+  static inline uint8_t tag_of(uint64_t h);
+  // The 'k'-th newest table of the shard, the active one is the 0-th
+  inline const Table& table_at(const Shard& shard, uint32_t k) const {
+    return shard.tables[(shard.active + num_tables - k) % num_tables];
+  }
+  // The position of the key in the table, '-1' if absent
+  inline int64_t probe(const Table& table, const KT& key, uint64_t h) const;
+  // The first empty or deleted position on the probe sequence
+  inline int64_t vacancy(const Table& table, uint64_t h) const;
+  void clear(Table& table);
+};
+
+}
+
+#endif
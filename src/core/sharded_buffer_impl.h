@@ -0,0 +1,331 @@
+#ifndef SHARDED_BUFFER_PARA_IMPL_H
+#define SHARDED_BUFFER_PARA_IMPL_H
+
+#include "core/sharded_buffer.h"
+
+namespace aflipara {
+
+template<typename KT, typename VT>
+ShardedBuffer<KT, VT>::ShardedBuffer(uint32_t max_size, uint32_t ns, 
+                                     uint32_t queue_depth) {
+  num_shards = 1;
+  while (num_shards < ns) {
+    num_shards <<= 1;
+  }
+  shard_size = std::max((max_size + num_shards - 1) / num_shards,
+                        kMinShardSize);
+  // Tables are at most half full, so probes end at empty slots soon
+  num_groups = 1;
+  while (num_groups * kGroupSize < shard_size * 2) {
+    num_groups <<= 1;
+  }
+  num_tables = std::max(queue_depth, 1U) + 1;
+  uint32_t num_slots = num_groups * kGroupSize;
+  shards = new Shard[num_shards];
+  for (uint32_t s = 0; s < num_shards; ++ s) {
+    Shard& shard = shards[s];
+    shard.version = 0;
+    shard.shard_lock = 0;
+    shard.draining = false;
+    shard.active = 0;
+    shard.num_sealed = 0;
+    shard.tables = new Table[num_tables];
+    for (uint32_t t = 0; t < num_tables; ++ t) {
+      Table& table = shard.tables[t];
+      table.tags = (uint8_t*)aligned_alloc(kGroupSize, num_slots);
+      table.slots = new KVT[num_slots];
+      memset(table.tags, kEmpty, num_slots);
+      table.num_used = 0;
+    }
+  }
+}
+
+template<typename KT, typename VT>
+ShardedBuffer<KT, VT>::~ShardedBuffer() {
+  for (uint32_t s = 0; s < num_shards; ++ s) {
+    for (uint32_t t = 0; t < num_tables; ++ t) {
+      free(shards[s].tables[t].tags);
+      delete[] shards[s].tables[t].slots;
+    }
+    delete[] shards[s].tables;
+  }
+  delete[] shards;
+}
+
+template<typename KT, typename VT>
+inline uint32_t ShardedBuffer<KT, VT>::shard_of(const KT& key) const {
+  return (hash_key(key) >> 32) & (num_shards - 1);
+}
+
+template<typename KT, typename VT>
+bool ShardedBuffer<KT, VT>::find(const KT& key, VT& value) {
+  uint64_t h = hash_key(key);
+  Shard& shard = shards[(h >> 32) & (num_shards - 1)];
+  while (true) {
+    uint32_t version = shard.version;
+    if (version & 1) {
+      continue;
+    }
+    fence();
+    // Newer tables hold newer pairs
+    KVT kv;
+    bool found = false;
+    for (uint32_t k = 0; k <= shard.num_sealed && !found; ++ k) {
+      const Table& table = table_at(shard, k);
+      int64_t pos = probe(table, key, h);
+      found = pos >= 0;
+      if (found) {
+        kv = table.slots[pos];
+      }
+    }
+    fence();
+    if (shard.version == version) {
+      if (found) {
+        value = kv.second;
+      }
+      return found;
+    }
+  }
+}
+
+template<typename KT, typename VT>
+template<typename Pred>
+void ShardedBuffer<KT, VT>::collect(Pred pred, std::vector<KVT>& res) {
+  uint32_t num_slots = num_groups * kGroupSize;
+  for (uint32_t s = 0; s < num_shards; ++ s) {
+    Shard& shard = shards[s];
+    uint32_t num = res.size();
+    while (true) {
+      uint32_t version = shard.version;
+      if (version & 1) {
+        continue;
+      }
+      fence();
+      res.resize(num);
+      uint32_t n = shard.num_sealed + 1;
+      for (uint32_t k = 0; k < n; ++ k) {
+        const Table& table = table_at(shard, k);
+        for (uint32_t i = 0; i < num_slots; ++ i) {
+          if (table.tags[i] <= kDeleted) {
+            continue;
+          }
+          KVT kv = table.slots[i];
+          bool newer = false;
+          for (uint32_t j = 0; j < k && !newer; ++ j) {
+            newer = probe(table_at(shard, j), kv.first, 
+                          hash_key(kv.first)) >= 0;
+          }
+          if (!newer && pred(kv)) {
+            res.push_back(kv);
+          }
+        }
+      }
+      fence();
+      if (shard.version == version) {
+        break;
+      }
+    }
+  }
+}
+
+template<typename KT, typename VT>
+void ShardedBuffer<KT, VT>::lock(uint32_t s) {
+  uint8_t unlocked = 0, locked = 1;
+  while (unlikely(cmpxchgb((uint8_t *)&shards[s].shard_lock, unlocked, locked)
+                  != unlocked)) { }
+}
+
+template<typename KT, typename VT>
+void ShardedBuffer<KT, VT>::unlock(uint32_t s) {
+  shards[s].shard_lock = 0;
+}
+
+template<typename KT, typename VT>
+inline bool ShardedBuffer<KT, VT>::full(uint32_t s) const {
+  const Shard& shard = shards[s];
+  return shard.tables[shard.active].num_used >= shard_size;
+}
+
+template<typename KT, typename VT>
+bool ShardedBuffer<KT, VT>::in_sealed(uint32_t s, const KT& key) const {
+  const Shard& shard = shards[s];
+  uint64_t h = hash_key(key);
+  for (uint32_t k = 1; k <= shard.num_sealed; ++ k) {
+    if (probe(table_at(shard, k), key, h) >= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template<typename KT, typename VT>
+void ShardedBuffer<KT, VT>::put(uint32_t s, const KVT& kv) {
+  Shard& shard = shards[s];
+  Table& table = shard.tables[shard.active];
+  uint64_t h = hash_key(kv.first);
+  int64_t pos = probe(table, kv.first, h);
+  begin_write(shard);
+  if (pos >= 0) {
+    table.slots[pos].second = kv.second;
+  } else {
+    pos = vacancy(table, h);
+    table.num_used += table.tags[pos] == kEmpty;
+    table.slots[pos] = kv;
+    table.tags[pos] = tag_of(h);
+  }
+  end_write(shard);
+}
+
+template<typename KT, typename VT>
+template<typename Fn>
+bool ShardedBuffer<KT, VT>::modify(uint32_t s, const KT& key, Fn& fn) {
+  Shard& shard = shards[s];
+  Table& table = shard.tables[shard.active];
+  int64_t pos = probe(table, key, hash_key(key));
+  if (pos < 0) {
+    return false;
+  }
+  VT value = table.slots[pos].second;
+  if (fn(value)) {
+    begin_write(shard);
+    table.slots[pos].second = value;
+    end_write(shard);
+  }
+  return true;
+}
+
+template<typename KT, typename VT>
+bool ShardedBuffer<KT, VT>::erase(uint32_t s, const KT& key) {
+  Shard& shard = shards[s];
+  Table& table = shard.tables[shard.active];
+  int64_t pos = probe(table, key, hash_key(key));
+  if (pos < 0) {
+    return false;
+  }
+  begin_write(shard);
+  table.tags[pos] = kDeleted;
+  end_write(shard);
+  return true;
+}
+
+template<typename KT, typename VT>
+bool ShardedBuffer<KT, VT>::seal(uint32_t s, bool& drain) {
+  Shard& shard = shards[s];
+  if (queue_full(s)) {
+    return false;
+  }
+  begin_write(shard);
+  shard.active = (shard.active + 1) % num_tables;
+  shard.num_sealed = shard.num_sealed + 1;
+  end_write(shard);
+  drain = !shard.draining;
+  shard.draining = true;
+  return true;
+}
+
+template<typename KT, typename VT>
+void ShardedBuffer<KT, VT>::sealed_pairs(uint32_t s,
+                                         std::vector<KVT>& res) const {
+  const Shard& shard = shards[s];
+  const Table& table = table_at(shard, shard.num_sealed);
+  uint32_t num_slots = num_groups * kGroupSize;
+  for (uint32_t i = 0; i < num_slots; ++ i) {
+    if (table.tags[i] > kDeleted) {
+      res.push_back(table.slots[i]);
+    }
+  }
+}
+
+template<typename KT, typename VT>
+bool ShardedBuffer<KT, VT>::release(uint32_t s) {
+  Shard& shard = shards[s];
+  lock(s);
+  begin_write(shard);
+  clear(const_cast<Table&>(table_at(shard, shard.num_sealed)));
+  shard.num_sealed = shard.num_sealed - 1;
+  end_write(shard);
+  bool more = shard.num_sealed > 0;
+  shard.draining = more;
+  unlock(s);
+  return more;
+}
+
+template<typename KT, typename VT>
+uint64_t ShardedBuffer<KT, VT>::size() const {
+  uint64_t num_slots = num_groups * kGroupSize;
+  return sizeof(ShardedBuffer<KT, VT>)
+         + num_shards * (sizeof(Shard) 
+                         + num_tables * (sizeof(Table) 
+                                         + num_slots * (1 + sizeof(KVT))));
+}
+
+template<typename KT, typename VT>
+inline void ShardedBuffer<KT, VT>::begin_write(Shard& shard) {
+  shard.version = shard.version + 1;
+  fence();
+}
+
+template<typename KT, typename VT>
+inline void ShardedBuffer<KT, VT>::end_write(Shard& shard) {
+  fence();
+  shard.version = shard.version + 1;
+}
+
+template<typename KT, typename VT>
+inline uint8_t ShardedBuffer<KT, VT>::tag_of(uint64_t h) {
+  return std::max<uint8_t>(h >> 56, kDeleted + 1);
+}
+
+template<typename KT, typename VT>
+inline int64_t ShardedBuffer<KT, VT>::probe(const Table& table, const KT& key,
+                                            uint64_t h) const {
+  __m128i tag = _mm_set1_epi8(static_cast<char>(tag_of(h)));
+  __m128i empty = _mm_setzero_si128();
+  uint32_t g = h & (num_groups - 1);
+  for (uint32_t i = 0; i < num_groups; ++ i) {
+    const uint8_t* tags = table.tags + g * kGroupSize;
+    __m128i group = _mm_load_si128(reinterpret_cast<const __m128i*>(tags));
+    uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(group, tag));
+    while (mask != 0) {
+      uint32_t pos = g * kGroupSize + __builtin_ctz(mask);
+      if (equal(table.slots[pos].first, key)) {
+        return pos;
+      }
+      mask &= mask - 1;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(group, empty)) != 0) {
+      return -1;
+    }
+    g = (g + 1) & (num_groups - 1);
+  }
+  return -1;
+}
+
+template<typename KT, typename VT>
+inline int64_t ShardedBuffer<KT, VT>::vacancy(const Table& table,
+                                              uint64_t h) const {
+  // Tags of empty and deleted slots are not larger than 'kDeleted'
+  __m128i bound = _mm_set1_epi8(kDeleted);
+  uint32_t g = h & (num_groups - 1);
+  for (uint32_t i = 0; i < num_groups; ++ i) {
+    const uint8_t* tags = table.tags + g * kGroupSize;
+    __m128i group = _mm_load_si128(reinterpret_cast<const __m128i*>(tags));
+    uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+                      _mm_min_epu8(group, bound), group));
+    if (mask != 0) {
+      return g * kGroupSize + __builtin_ctz(mask);
+    }
+    g = (g + 1) & (num_groups - 1);
+  }
+  return -1;
+}
+
+template<typename KT, typename VT>
+void ShardedBuffer<KT, VT>::clear(Table& table) {
+  memset(table.tags, kEmpty, num_groups * kGroupSize);
+  table.num_used = 0;
+}
+
+}
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef VALUE_LOG_PARA_H
+#define VALUE_LOG_PARA_H
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "core/common.h"
+
+namespace aflipara {
+
+// The segment id in the high 32 bits and the offset of the record in the low
+// 32 bits
+typedef uint64_t ValueHandle;
+
+// Records are aligned to 8 bytes, and the value bytes follow the header
+template<typename KT>
+struct ValueRecord {
+  KT                          key;
+  uint32_t                    len;
+
+  inline const char* value() const {
+    return reinterpret_cast<const char*>(this + 1);
+  }
+};
+
+// An append-only arena of values. Writers reserve space in the active segment
+// by an atomic tail, so appends only lock to open a new segment. Records keep
+// their keys, so a segment with enough garbage is collected by relocating the
+// records still referred by the index and retiring the segment. Retired
+// segments are unmapped once no reader is active. Segments are anonymous
+// mappings, or files in 'dir' if it is given.
+template<typename KT>
+class ValueLog {
+typedef ValueRecord<KT> Record;
+public:
+  static const uint32_t kMaxSegments = 1 << 16;
+  static const uint32_t kAlign = 8;
+  static const uint32_t kUnsealed = 0xffffffff;
+
+  struct Segment {
+    uint32_t                  id;
+    char*                     data;
+    uint32_t                  capacity;
+    int                       fd;         // '-1' for anonymous mappings
+    std::atomic<uint64_t>     tail;       // The reserved bytes
+    std::atomic<uint32_t>     end;        // The bytes of records once sealed
+    std::atomic<uint32_t>     committed;  // The bytes of written records
+    std::atomic<uint32_t>     garbage;    // The bytes of discarded records
+    volatile bool             retired;
+  };
+
+  std::string                 dir;
+  uint32_t                    segment_size;
+  Segment* volatile           segments[kMaxSegments];
+  uint32_t                    free_ids[kMaxSegments];
+  uint32_t                    num_free;
+  Segment* volatile           active;
+  volatile uint8_t            log_lock;       // Protect opening and closing segments
+  volatile uint8_t            gc_lock;
+  std::atomic<uint32_t>       num_inside;     // Threads that may access records
+  std::vector<uint32_t>       retired;
+  std::atomic<uint64_t>       num_bytes;      // The bytes of all records
+  std::atomic<uint64_t>       num_garbage;    // The bytes of discarded records
+
+public:
+  ValueLog(std::string dir="", uint32_t segment_size=(4 << 20));
+  ~ValueLog();
+
+  ValueHandle append(KT key, const char* value, uint32_t len);
+  // The record of a handle stays valid between 'enter' and 'exit'
+  void enter();
+  void exit();
+  inline const Record* read(ValueHandle handle);
+  // Mark the record as garbage after it is overwritten or removed
+  void discard(ValueHandle handle);
+  // Collect sealed segments whose garbage ratio is not less than 'ratio'.
+  // 'relocate(handle, record)' is called on every record of the segments
+  // to move the records still referred. Returns the number of collected 
+  // segments.
+  template<typename Fn>
+  uint32_t collect(double ratio, Fn relocate);
+
+  uint64_t live_size();
+  uint64_t arena_size();
+  uint32_t num_segments();
+
+private:
+  static inline uint32_t record_size(uint32_t len);
+  Segment* open_segment();
+  void close_segment(uint32_t id);
+  void release_retired();
+  void lock(volatile uint8_t& l);
+  void unlock(volatile uint8_t& l);
+};
+
+}
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef VALUE_LOG_PARA_IMPL_H
+#define VALUE_LOG_PARA_IMPL_H
+
+#include "core/value_log.h"
+
+namespace aflipara {
+
+template<typename KT>
+ValueLog<KT>::ValueLog(std::string dir, uint32_t segment_size)
+  : dir(dir), segment_size(segment_size) {
+  for (uint32_t i = 0; i < kMaxSegments; ++ i) {
+    segments[i] = nullptr;
+    free_ids[i] = kMaxSegments - 1 - i;
+  }
+  num_free = kMaxSegments;
+  log_lock = 0;
+  gc_lock = 0;
+  num_inside = 0;
+  num_bytes = 0;
+  num_garbage = 0;
+  active = open_segment();
+}
+
+template<typename KT>
+ValueLog<KT>::~ValueLog() {
+  for (uint32_t i = 0; i < kMaxSegments; ++ i) {
+    if (segments[i] != nullptr) {
+      close_segment(i);
+    }
+  }
+}
+
+template<typename KT>
+ValueHandle ValueLog<KT>::append(KT key, const char* value, uint32_t len) {
+  uint32_t size = record_size(len);
+  ASSERT_WITH_MSG(size <= segment_size, "The value of " << len
+                  << " bytes is larger than a segment")
+  enter();
+  while (true) {
+    Segment* seg = active;
+    uint64_t offset = seg->tail.fetch_add(size);
+    if (offset + size <= seg->capacity) {
+      Record* record = reinterpret_cast<Record*>(seg->data + offset);
+      record->key = key;
+      record->len = len;
+      memcpy(const_cast<char*>(record->value()), value, len);
+      num_bytes += size;
+      seg->committed += size;
+      exit();
+      return (static_cast<ValueHandle>(seg->id) << 32) | offset;
+    } else if (offset <= seg->capacity) {
+      // The first writer exceeding the capacity seals the segment, later
+      // writers wait for the next segment
+      seg->end = offset;
+      lock(log_lock);
+      active = open_segment();
+      unlock(log_lock);
+    } else {
+      while (active == seg) { }
+    }
+  }
+}
+
+template<typename KT>
+void ValueLog<KT>::enter() {
+  num_inside ++;
+}
+
+template<typename KT>
+void ValueLog<KT>::exit() {
+  num_inside --;
+}
+
+template<typename KT>
+inline const ValueRecord<KT>* ValueLog<KT>::read(ValueHandle handle) {
+  Segment* seg = segments[handle >> 32];
+  return reinterpret_cast<const Record*>(seg->data + (handle & 0xffffffff));
+}
+
+template<typename KT>
+void ValueLog<KT>::discard(ValueHandle handle) {
+  enter();
+  Segment* seg = segments[handle >> 32];
+  uint32_t size = record_size(read(handle)->len);
+  seg->garbage += size;
+  num_garbage += size;
+  exit();
+}
+
+template<typename KT>
+template<typename Fn>
+uint32_t ValueLog<KT>::collect(double ratio, Fn relocate) {
+  lock(gc_lock);
+  uint32_t num_collected = 0;
+  for (uint32_t i = 0; i < kMaxSegments; ++ i) {
+    Segment* seg = segments[i];
+    if (seg == nullptr || seg == active || seg->retired) {
+      continue;
+    }
+    // Only sealed segments with all records written are collected
+    uint32_t end = seg->end;
+    if (end == kUnsealed || seg->committed != end
+        || seg->garbage < ratio * end) {
+      continue;
+    }
+    for (uint32_t offset = 0; offset < end; ) {
+      ValueHandle handle = (static_cast<ValueHandle>(i) << 32) | offset;
+      const Record* record = read(handle);
+      relocate(handle, record);
+      offset += record_size(record->len);
+    }
+    seg->retired = true;
+    retired.push_back(i);
+    num_collected ++;
+  }
+  release_retired();
+  unlock(gc_lock);
+  return num_collected;
+}
+
+template<typename KT>
+uint64_t ValueLog<KT>::live_size() {
+  return num_bytes - num_garbage;
+}
+
+template<typename KT>
+uint64_t ValueLog<KT>::arena_size() {
+  return static_cast<uint64_t>(num_segments()) * segment_size;
+}
+
+template<typename KT>
+uint32_t ValueLog<KT>::num_segments() {
+  lock(log_lock);
+  uint32_t res = kMaxSegments - num_free;
+  unlock(log_lock);
+  return res;
+}
+
+template<typename KT>
+inline uint32_t ValueLog<KT>::record_size(uint32_t len) {
+  return (sizeof(Record) + len + kAlign - 1) / kAlign * kAlign;
+}
+
+template<typename KT>
+typename ValueLog<KT>::Segment* ValueLog<KT>::open_segment() {
+  ASSERT_WITH_MSG(num_free > 0, "Too many segments in the value log, at most "
+                  << kMaxSegments)
+  Segment* seg = new Segment();
+  seg->id = free_ids[-- num_free];
+  seg->capacity = segment_size;
+  seg->fd = -1;
+  if (dir == "") {
+    seg->data = (char*)mmap(nullptr, segment_size, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  } else {
+    std::string path = dir + "/vlog_" + std::to_string(seg->id) + ".seg";
+    seg->fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_WITH_MSG(seg->fd >= 0 && ftruncate(seg->fd, segment_size) == 0,
+                    "Cannot create the segment file [" << path << "]")
+    seg->data = (char*)mmap(nullptr, segment_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, seg->fd, 0);
+  }
+  ASSERT_WITH_MSG(seg->data != MAP_FAILED, "Cannot map a segment of "
+                  << segment_size << " bytes")
+  seg->tail = 0;
+  seg->end = kUnsealed;
+  seg->committed = 0;
+  seg->garbage = 0;
+  seg->retired = false;
+  segments[seg->id] = seg;
+  return seg;
+}
+
+template<typename KT>
+void ValueLog<KT>::close_segment(uint32_t id) {
+  Segment* seg = segments[id];
+  munmap(seg->data, seg->capacity);
+  if (seg->fd >= 0) {
+    close(seg->fd);
+    std::string path = dir + "/vlog_" + std::to_string(id) + ".seg";
+    unlink(path.c_str());
+  }
+  segments[id] = nullptr;
+  free_ids[num_free ++] = id;
+  delete seg;
+}
+
+template<typename KT>
+void ValueLog<KT>::release_retired() {
+  // Threads entering after the retirement only see the relocated records
+  if (retired.empty() || num_inside != 0) {
+    return;
+  }
+  lock(log_lock);
+  for (uint32_t id : retired) {
+    Segment* seg = segments[id];
+    num_bytes -= seg->end;
+    num_garbage -= seg->garbage;
+    close_segment(id);
+  }
+  unlock(log_lock);
+  retired.clear();
+}
+
+template<typename KT>
+void ValueLog<KT>::lock(volatile uint8_t& l) {
+  uint8_t unlocked = 0, locked = 1;
+  while (unlikely(cmpxchgb((uint8_t *)&l, unlocked, locked) != unlocked)) { }
+}
+
+template<typename KT>
+void ValueLog<KT>::unlock(volatile uint8_t& l) {
+  l = 0;
+}
+
+}
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef VERSION_LOG_PARA_H
+#define VERSION_LOG_PARA_H
+
+#include "core/bloom_filter.h"
+#include "core/common.h"
+
+namespace aflipara {
+
+// The state of a key before a write, stamped with the version of the write
+template<typename VT>
+struct Version {
+  uint64_t                    version;
+  bool                        exist;
+  VT                          value;
+};
+
+struct Snapshot {
+  uint64_t                    version;
+  uint32_t                    slot;
+};
+
+// The undo log of writes for snapshot reads. A write takes the shard lock of
+// its key, modifies the index, then stamps a new version and logs the prior
+// state of the key if any snapshot is active. A read of a snapshot reads the
+// index first, then replaces the state by the prior state of the oldest
+// write newer than the snapshot. Readers only hold shard locks to look up
+// the log, so writers never wait for scans. Versions that no active snapshot
+// can see are collected when snapshots are released or shards grow large.
+template<typename KT, typename VT>
+class VersionLog {
+typedef std::map<KT, std::vector<Version<VT>>> Chains;
+public:
+  static const uint32_t kNumShards = 64;
+  static const uint32_t kMaxSnapshots = 64;
+  static const uint32_t kGCThreshold = 4096;   // The number of versions per shard to trigger GC
+
+  struct Shard {
+    volatile uint8_t          lock;
+    uint32_t                  num_versions;
+    uint32_t                  gc_threshold;
+    Chains                    chains;
+  };
+
+  Shard                       shards[kNumShards];
+  std::atomic<uint64_t>       clock;
+  std::atomic<uint32_t>       num_active;
+  uint64_t                    active[kMaxSnapshots];  // '0' means a free slot
+  uint32_t                    free_slots[kMaxSnapshots];
+  uint32_t                    num_free;
+  volatile uint8_t            snapshot_lock;
+
+public:
+  VersionLog();
+
+  Snapshot acquire();
+  void release(const Snapshot& snapshot);
+
+  // Writers hold the lock of the key while modifying the index
+  void lock_key(KT key);
+  void unlock_key(KT key);
+  void record(KT key, bool exist, const VT& value);
+
+  bool lookup(KT key, uint64_t version, bool& exist, VT& value);
+  void collect(KT begin, KT end, uint64_t version,
+               std::vector<std::pair<KT, Version<VT>>>& res);
+  uint64_t num_versions();
+  uint64_t size();
+
+private:
+  inline uint32_t shard_of(KT key);
+  void lock_shard(uint32_t s);
+  void unlock_shard(uint32_t s);
+  void lock_snapshots();
+  void unlock_snapshots();
+
+  uint64_t min_visible_version();
+  void prune(uint32_t s, uint64_t version);
+  static const Version<VT>* visible(const std::vector<Version<VT>>& chain,
+                                    uint64_t version);
+};
+
+}
+
+#endif
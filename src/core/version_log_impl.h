@@ -0,0 +1,219 @@
+#ifndef VERSION_LOG_PARA_IMPL_H
+#define VERSION_LOG_PARA_IMPL_H
+
+#include "core/version_log.h"
+
+namespace aflipara {
+
+template<typename KT, typename VT>
+VersionLog<KT, VT>::VersionLog() {
+  for (uint32_t i = 0; i < kNumShards; ++ i) {
+    shards[i].lock = 0;
+    shards[i].num_versions = 0;
+    shards[i].gc_threshold = kGCThreshold;
+  }
+  // Versions start from '1', so '0' marks free snapshot slots
+  clock = 1;
+  num_active = 0;
+  for (uint32_t i = 0; i < kMaxSnapshots; ++ i) {
+    active[i] = 0;
+    free_slots[i] = kMaxSnapshots - 1 - i;
+  }
+  num_free = kMaxSnapshots;
+  snapshot_lock = 0;
+}
+
+template<typename KT, typename VT>
+Snapshot VersionLog<KT, VT>::acquire() {
+  lock_snapshots();
+  ASSERT_WITH_MSG(num_free > 0, "Too many active snapshots, at most "
+                  << kMaxSnapshots)
+  uint32_t slot = free_slots[-- num_free];
+  // Writers that miss the new snapshot must have modified the index before
+  // the clock is read
+  num_active ++;
+  uint64_t version = clock.load();
+  active[slot] = version;
+  unlock_snapshots();
+  return {version, slot};
+}
+
+template<typename KT, typename VT>
+void VersionLog<KT, VT>::release(const Snapshot& snapshot) {
+  lock_snapshots();
+  ASSERT_WITH_MSG(active[snapshot.slot] == snapshot.version,
+                  "Release an inactive snapshot")
+  active[snapshot.slot] = 0;
+  free_slots[num_free ++] = snapshot.slot;
+  num_active --;
+  uint64_t version = min_visible_version();
+  unlock_snapshots();
+  for (uint32_t i = 0; i < kNumShards; ++ i) {
+    lock_shard(i);
+    prune(i, version);
+    unlock_shard(i);
+  }
+}
+
+template<typename KT, typename VT>
+void VersionLog<KT, VT>::lock_key(KT key) {
+  lock_shard(shard_of(key));
+}
+
+template<typename KT, typename VT>
+void VersionLog<KT, VT>::unlock_key(KT key) {
+  unlock_shard(shard_of(key));
+}
+
+template<typename KT, typename VT>
+void VersionLog<KT, VT>::record(KT key, bool exist, const VT& value) {
+  // The index is modified before checking the snapshots
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (num_active.load() == 0) {
+    return;
+  }
+  uint32_t s = shard_of(key);
+  Shard& shard = shards[s];
+  shard.chains[key].push_back({++ clock, exist, value});
+  if (++ shard.num_versions >= shard.gc_threshold) {
+    lock_snapshots();
+    uint64_t version = min_visible_version();
+    unlock_snapshots();
+    prune(s, version);
+    // Back off if old snapshots keep the versions alive
+    shard.gc_threshold = std::max(kGCThreshold, shard.num_versions * 2);
+  }
+}
+
+template<typename KT, typename VT>
+bool VersionLog<KT, VT>::lookup(KT key, uint64_t version, bool& exist,
+                                VT& value) {
+  uint32_t s = shard_of(key);
+  bool res = false;
+  lock_shard(s);
+  auto it = shards[s].chains.find(key);
+  if (it != shards[s].chains.end()) {
+    const Version<VT>* v = visible(it->second, version);
+    if (v != nullptr) {
+      exist = v->exist;
+      value = v->value;
+      res = true;
+    }
+  }
+  unlock_shard(s);
+  return res;
+}
+
+template<typename KT, typename VT>
+void VersionLog<KT, VT>::collect(KT begin, KT end, uint64_t version,
+                                 std::vector<std::pair<KT, Version<VT>>>& res) {
+  for (uint32_t s = 0; s < kNumShards; ++ s) {
+    lock_shard(s);
+    Chains& chains = shards[s].chains;
+    for (auto it = chains.lower_bound(begin);
+         it != chains.end() && !(end < it->first); ++ it) {
+      const Version<VT>* v = visible(it->second, version);
+      if (v != nullptr) {
+        res.push_back({it->first, *v});
+      }
+    }
+    unlock_shard(s);
+  }
+  std::sort(res.begin(), res.end(),
+    [](auto const& a, auto const& b) {
+      return a.first < b.first;
+  });
+}
+
+template<typename KT, typename VT>
+uint64_t VersionLog<KT, VT>::num_versions() {
+  uint64_t res = 0;
+  for (uint32_t i = 0; i < kNumShards; ++ i) {
+    lock_shard(i);
+    res += shards[i].num_versions;
+    unlock_shard(i);
+  }
+  return res;
+}
+
+template<typename KT, typename VT>
+uint64_t VersionLog<KT, VT>::size() {
+  return sizeof(VersionLog<KT, VT>)
+         + (sizeof(KT) + sizeof(Version<VT>)) * num_versions();
+}
+
+template<typename KT, typename VT>
+inline uint32_t VersionLog<KT, VT>::shard_of(KT key) {
+  return hash_key(key) % kNumShards;
+}
+
+template<typename KT, typename VT>
+void VersionLog<KT, VT>::lock_shard(uint32_t s) {
+  uint8_t unlocked = 0, locked = 1;
+  while (unlikely(cmpxchgb((uint8_t *)&shards[s].lock, unlocked, locked)
+                  != unlocked)) { }
+}
+
+template<typename KT, typename VT>
+void VersionLog<KT, VT>::unlock_shard(uint32_t s) {
+  shards[s].lock = 0;
+}
+
+template<typename KT, typename VT>
+void VersionLog<KT, VT>::lock_snapshots() {
+  uint8_t unlocked = 0, locked = 1;
+  while (unlikely(cmpxchgb((uint8_t *)&snapshot_lock, unlocked, locked)
+                  != unlocked)) { }
+}
+
+template<typename KT, typename VT>
+void VersionLog<KT, VT>::unlock_snapshots() {
+  snapshot_lock = 0;
+}
+
+template<typename KT, typename VT>
+uint64_t VersionLog<KT, VT>::min_visible_version() {
+  // Versions not newer than all active snapshots are invisible to them
+  uint64_t res = clock.load();
+  for (uint32_t i = 0; i < kMaxSnapshots; ++ i) {
+    if (active[i] != 0) {
+      res = std::min(res, active[i]);
+    }
+  }
+  return res;
+}
+
+template<typename KT, typename VT>
+void VersionLog<KT, VT>::prune(uint32_t s, uint64_t version) {
+  Shard& shard = shards[s];
+  for (auto it = shard.chains.begin(); it != shard.chains.end(); ) {
+    std::vector<Version<VT>>& chain = it->second;
+    uint32_t n = 0;
+    while (n < chain.size() && chain[n].version <= version) {
+      n ++;
+    }
+    shard.num_versions -= n;
+    if (n == chain.size()) {
+      it = shard.chains.erase(it);
+    } else {
+      chain.erase(chain.begin(), chain.begin() + n);
+      ++ it;
+    }
+  }
+}
+
+template<typename KT, typename VT>
+const Version<VT>* VersionLog<KT, VT>::visible(
+                      const std::vector<Version<VT>>& chain, uint64_t version) {
+  // The prior state of the oldest write after the snapshot
+  for (uint32_t i = 0; i < chain.size(); ++ i) {
+    if (chain[i].version > version) {
+      return &chain[i];
+    }
+  }
+  return nullptr;
+}
+
+}
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef VLOG_PARA_H
+#define VLOG_PARA_H
+
+#include "core/afli_para_impl.h"
+#include "core/value_log_impl.h"
+
+namespace aflipara {
+
+// The key-value separated index for large values. The index maps keys to 
+// handles of the value log, so nodes and buckets keep 16-byte pairs whatever
+// the value size is. Overwritten and removed values are garbage of the log 
+// until their segments are collected, then the live values are relocated and 
+// their handles are swapped by compare-and-exchange, so writes racing with 
+// the collection win.
+template<typename KT>
+class VLogPara {
+typedef std::pair<KT, std::string> KVT;
+public:
+  // Marks a key being removed
+  static const ValueHandle kTombstone = ~0ULL;
+
+  AFLIPara<KT, ValueHandle>* index;
+  ValueLog<KT>* log;
+public:
+  VLogPara(uint32_t num_bg=1, std::string dir="", 
+           uint32_t segment_size=(4 << 20));
+  ~VLogPara();
+
+  void bulk_load(const KVT* kvs, uint32_t size);
+  bool find(KT key, std::string& value);
+  bool remove(KT key);
+  bool update(KT key, const char* value, uint32_t len);
+  void insert(KT key, const char* value, uint32_t len);
+  uint32_t scan(KT begin, KT end, std::vector<KVT>& res);
+  // Collect segments whose garbage ratio is not less than 'ratio', returns
+  // the number of collected segments
+  uint32_t collect(double ratio=0.5);
+
+  uint64_t index_size();
+  uint64_t value_size();    // The bytes of live values
+  uint64_t arena_size();    // The bytes of mapped segments
+};
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef VLOG_PARA_IMPL_H
+#define VLOG_PARA_IMPL_H
+
+#include "core/vlog_para.h"
+
+namespace aflipara {
+
+template<typename KT>
+VLogPara<KT>::VLogPara(uint32_t num_bg, std::string dir, 
+                       uint32_t segment_size) {
+  index = new AFLIPara<KT, ValueHandle>(num_bg);
+  log = new ValueLog<KT>(dir, segment_size);
+}
+
+template<typename KT>
+VLogPara<KT>::~VLogPara() {
+  delete index;
+  delete log;
+}
+
+template<typename KT>
+void VLogPara<KT>::bulk_load(const KVT* kvs, uint32_t size) {
+  std::vector<std::pair<KT, ValueHandle>> handles;
+  handles.reserve(size);
+  for (uint32_t i = 0; i < size; ++ i) {
+    handles.push_back({kvs[i].first, log->append(kvs[i].first, 
+                       kvs[i].second.data(), kvs[i].second.size())});
+  }
+  index->bulk_load(handles.data(), size);
+}
+
+template<typename KT>
+bool VLogPara<KT>::find(KT key, std::string& value) {
+  log->enter();
+  ValueHandle handle;
+  bool res = index->find(key, handle) && handle != kTombstone;
+  if (res) {
+    const ValueRecord<KT>* record = log->read(handle);
+    value.assign(record->value(), record->len);
+  }
+  log->exit();
+  return res;
+}
+
+template<typename KT>
+bool VLogPara<KT>::remove(KT key) {
+  // The handle is replaced by the tombstone first, so the removed value is 
+  // discarded exactly once even if it is being relocated
+  log->enter();
+  bool res = false;
+  while (true) {
+    ValueHandle handle;
+    if (!index->find(key, handle) || handle == kTombstone) {
+      break;
+    }
+    ValueHandle expected = handle;
+    if (index->compare_exchange(key, expected, kTombstone)) {
+      index->remove(key);
+      log->discard(handle);
+      res = true;
+      break;
+    }
+  }
+  log->exit();
+  return res;
+}
+
+template<typename KT>
+bool VLogPara<KT>::update(KT key, const char* value, uint32_t len) {
+  log->enter();
+  ValueHandle handle = log->append(key, value, len);
+  ValueHandle old = kTombstone;
+  index->modify(key, [&](ValueHandle& v) {
+    old = v;
+    if (v == kTombstone) {
+      return false;
+    }
+    v = handle;
+    return true;
+  });
+  bool res = old != kTombstone;
+  log->discard(res ? old : handle);
+  log->exit();
+  return res;
+}
+
+template<typename KT>
+void VLogPara<KT>::insert(KT key, const char* value, uint32_t len) {
+  index->insert({key, log->append(key, value, len)});
+}
+
+template<typename KT>
+uint32_t VLogPara<KT>::scan(KT begin, KT end, std::vector<KVT>& res) {
+  std::vector<std::pair<KT, ValueHandle>> handles;
+  log->enter();
+  index->scan(begin, end, handles);
+  uint32_t num = 0;
+  for (uint32_t i = 0; i < handles.size(); ++ i) {
+    if (handles[i].second != kTombstone) {
+      const ValueRecord<KT>* record = log->read(handles[i].second);
+      res.push_back({handles[i].first, 
+                     std::string(record->value(), record->len)});
+      num ++;
+    }
+  }
+  log->exit();
+  return num;
+}
+
+template<typename KT>
+uint32_t VLogPara<KT>::collect(double ratio) {
+  return log->collect(ratio, 
+    [&](ValueHandle handle, const ValueRecord<KT>* record) {
+      ValueHandle current;
+      if (!index->find(record->key, current) || current != handle) {
+        return;
+      }
+      ValueHandle moved = log->append(record->key, record->value(), 
+                                      record->len);
+      if (!index->compare_exchange(record->key, handle, moved)) {
+        // Overwritten or removed during the relocation
+        log->discard(moved);
+      }
+  });
+}
+
+template<typename KT>
+uint64_t VLogPara<KT>::index_size() {
+  return sizeof(VLogPara<KT>) + index->index_size();
+}
+
+template<typename KT>
+uint64_t VLogPara<KT>::value_size() {
+  return log->live_size();
+}
+
+template<typename KT>
+uint64_t VLogPara<KT>::arena_size() {
+  return log->arena_size();
+}
+
+}
+
+#endif
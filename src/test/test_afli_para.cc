@@ -1,4 +1,5 @@
 #include "core/afli_para_impl.h"
+#include "core/vlog_para_impl.h"
 #include "core/common.h"
 #include "util/workload.h"
 
@@ -12,22 +13,81 @@ std::atomic<size_t> ready_threads(0);
 
 uint32_t num_workers = 1;
 uint32_t num_bg = 1;
+bool append_mode = true;
+uint32_t filter_bits_per_key = 0;
+uint32_t rank_stride = 32;
+uint32_t value_size = 64;
+std::string vlog_dir = "";
 
+// Indexes with inline values or with values in the value log
 template<typename KT, typename VT>
+AFLIPara<KT, VT>& afli_of(AFLIPara<KT, VT>& index) {
+  return index;
+}
+
+template<typename KT>
+AFLIPara<KT, ValueHandle>& afli_of(VLogPara<KT>& index) {
+  return *index.index;
+}
+
+template<typename KT, typename VT>
+void load_index(AFLIPara<KT, VT>& index, const std::vector<KT>& keys) {
+  std::vector<std::pair<KT, VT>> init_kvs;
+  init_kvs.reserve(keys.size());
+  for (uint32_t i = 0; i < keys.size(); ++ i) {
+    init_kvs.push_back({keys[i], i});
+  }
+  index.bulk_load(init_kvs.data(), init_kvs.size());
+}
+
+template<typename KT>
+void load_index(VLogPara<KT>& index, const std::vector<KT>& keys) {
+  std::vector<std::pair<KT, std::string>> init_kvs;
+  init_kvs.reserve(keys.size());
+  for (uint32_t i = 0; i < keys.size(); ++ i) {
+    init_kvs.push_back({keys[i], std::string()});
+    generate_value(keys[i], 0, value_size, init_kvs.back().second);
+  }
+  index.bulk_load(init_kvs.data(), init_kvs.size());
+}
+
+template<typename KT, typename VT>
+inline bool query(AFLIPara<KT, VT>* index, KT key, std::string&) {
+  VT value;
+  return index->find(key, value);
+}
+
+template<typename KT>
+inline bool query(VLogPara<KT>* index, KT key, std::string& buf) {
+  return index->find(key, buf);
+}
+
+template<typename KT, typename VT>
+inline void insert(AFLIPara<KT, VT>* index, KT key, const std::string&) {
+  VT dummy_value = 2022;
+  index->insert({key, dummy_value});
+}
+
+template<typename KT>
+inline void insert(VLogPara<KT>* index, KT key, const std::string& buf) {
+  index->insert(key, buf.data(), buf.size());
+}
+
+template<typename KT, typename Index>
 struct ThreadParam {
   uint32_t id;
-  AFLIPara<KT, VT>* index;
+  Index* index;
   std::vector<Request<KT>>* reqs;
   uint32_t num_done_reqs;
   TT start_time;
   TT end_time;
 };
 
-template<typename KT, typename VT>
+template<typename KT, typename Index>
 void* run_requests(void* param) {
-  ThreadParam<KT, VT>& thread_param = *((ThreadParam<KT, VT>*)param);
+  ThreadParam<KT, Index>& thread_param = *((ThreadParam<KT, Index>*)param);
   uint32_t thread_id = thread_param.id;
-  AFLIPara<KT, VT>* afli = thread_param.index;
+  Index* afli = thread_param.index;
   std::vector<Request<KT>>& reqs = *(thread_param.reqs);
 
   uint32_t reqs_per_thread = std::ceil(reqs.size() / num_workers);
@@ -37,17 +97,16 @@ void* run_requests(void* param) {
   ready_threads ++;
   while (!running) ;
 
-  VT dummy_value = 2022;
+  std::string buf(value_size, 'v');
   thread_param.start_time = TIME_LOG;
   for (uint32_t i = start_idx; i < end_idx && i < reqs.size(); ++ i) {
     Request<KT>& req = reqs[i];
     if (req.op == kQuery) {
-      VT value;
       // COUT_INFO_W_LOCK("Thread " << thread_id << " query " << req.key);
-      bool found = afli->find(req.key, value);
+      bool found = query(afli, req.key, buf);
     } else if (req.op == kInsert) {
       // COUT_INFO_W_LOCK("Thread " << thread_id << " insert " << req.key);
-      afli->insert({req.key, dummy_value});
+      insert(afli, req.key, buf);
     }
     thread_param.num_done_reqs ++;
   }
@@ -56,23 +115,18 @@ void* run_requests(void* param) {
   pthread_exit(nullptr);
 }
 
-template<typename KT, typename VT>
+template<typename KT, typename Index>
 void test_workload(std::string workload_path) {
   std::vector<KT> init_keys;
-  std::vector<std::pair<KT, VT>> init_kvs;
   std::vector<Request<KT>> reqs;
   load_workload(workload_path, init_keys, reqs);
-  init_kvs.reserve(init_keys.size());
-  for (uint32_t i = 0; i < init_keys.size(); ++ i) {
-    init_kvs.push_back({init_keys[i], i});
-  }
-  COUT_INFO("# loading data [" << init_kvs.size() << "]")
+  COUT_INFO("# loading data [" << init_keys.size() << "]")
   COUT_INFO("# requests [" << reqs.size() << "]")
 
   auto bulk_load_start = TIME_LOG;
-  AFLIPara<KT, VT> afli(num_bg);
+  Index afli(num_bg);
   auto bulk_load_mid = TIME_LOG;
-  afli.bulk_load(init_kvs.data(), init_kvs.size());
+  load_index(afli, init_keys);
   // afli.print_statistics();
   auto bulk_load_end = TIME_LOG;
   double construct_index_time = TIME_IN_SECOND(bulk_load_start, bulk_load_mid);
@@ -80,10 +134,10 @@ void test_workload(std::string workload_path) {
 
   COUT_INFO("Bulk loading\t" << construct_index_time << " sec\t"
             << bulk_load_index_time << " sec")
-  COUT_INFO("# Nodes\t" << afli.hyper_para.num_nodes)
+  COUT_INFO("# Nodes\t" << afli_of(afli).hyper_para.num_nodes)
 
   pthread_t threads[num_workers];
-  ThreadParam<KT, VT> thread_params[num_workers];
+  ThreadParam<KT, Index> thread_params[num_workers];
 
   running = false;
   for (uint32_t i = 0; i < num_workers; ++ i) {
@@ -91,7 +145,7 @@ void test_workload(std::string workload_path) {
     thread_params[i].index = &afli;
     thread_params[i].reqs = &reqs;
     thread_params[i].num_done_reqs = 0;
-    int ret = pthread_create(&threads[i], nullptr, run_requests<KT, VT>, 
+    int ret = pthread_create(&threads[i], nullptr, run_requests<KT, Index>, 
                              (void *)&thread_params[i]);
     ASSERT_WITH_MSG(!ret, "Error Code\t" << ret << " of Thread-" << i)
   }
@@ -250,89 +304,1534 @@ void test_synthetic(uint32_t num_data) {
   COUT_INFO("Success")
 }
 
-int main(int argc, char* argv[]) {
-  po::options_description desc("Allowed options");
-  desc.add_options()
-    ("help", (tostr("example: ./test_afli_para ") 
-     + "--data_path books-200M-20R-zipf.bin " 
-     + "--test_type workload --num_workers 1 --num_bg 2").data())
-    ("data_path", po::value<std::string>(), 
-     "the path of data")
-    ("weight_path", po::value<std::string>(), 
-     "the path of the weights of NF models")
-    ("test_type", po::value<std::string>(), 
-     "the test type")
-    ("key_type", po::value<std::string>(), 
-     "the key type of workload, e.g., double, int32, int64")
-    ("value_type", po::value<std::string>(), 
-     "the value type of workload, e.g., double, int32, int64")
-    ("num_workers", po::value<uint32_t>(), 
-     "the number of user threads")
-    ("num_bg", po::value<uint32_t>(), 
-     "the number of background threads")
-    ("num_data", po::value<uint32_t>(), 
-     "the number of synthetic data")
-  ;
+template<typename KT, typename VT>
+void test_append(uint32_t num_data) {
+  // Timestamp-like keys, the first 10% are bulk loaded and the others are 
+  // inserted in increasing order
+  std::vector<std::pair<KT, VT>> data;
+  data.reserve(num_data);
+  std::mt19937_64 gen(kSeed);
+  KT key = 1;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    key += gen() % 1000 + 1;
+    data.push_back({key, i});
+  }
+  uint32_t num_init_data = num_data / 10;
 
-  po::variables_map vm;
-  try {
-    po::store(po::parse_command_line(argc, argv, desc), vm);
-  } catch (...) {
-    COUT_ERR("Unrecognized parameters, please use --help");
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  afli.bulk_load(data.data(), num_init_data);
+  auto start = TIME_LOG;
+  for (uint32_t i = num_init_data; i < num_data; ++ i) {
+    afli.insert(data[i]);
   }
-  po::notify(vm);
+  double insert_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
 
-  if (vm.count("help")) {
-    COUT_INFO(desc)
-    return 0;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    VT val = 0;
+    bool found = afli.find(data[i].first, val);
+    ASSERT_WITH_MSG(found && val == data[i].second, "Find {" << data[i].first 
+                    << ", " << data[i].second << "}, but got {" << val 
+                    << "}")
   }
+  COUT_INFO("Append mode [" << append_mode << "], average insert latency " 
+            << insert_time / (num_data - num_init_data) << " ns, # nodes " 
+            << afli.hyper_para.num_nodes)
 
-  check_options(vm, {"test_type"});
-  std::string test_type = vm["test_type"].as<std::string>();
-  if (test_type == "raw" || test_type == "workload") {
-    check_options(vm, {"data_path", "key_type", "value_type", "num_workers", 
-                  "num_bg"});
-  } else if (test_type == "synthetic") {
-    check_options(vm, {"num_data", "key_type", "value_type", "num_workers", 
-                  "num_bg"});
+  // Finds racing with appends must see every appended key
+  AFLIPara<KT, VT> racing(num_bg);
+  racing.hyper_para.append_mode = append_mode;
+  racing.bulk_load(data.data(), num_init_data);
+  std::atomic<uint32_t> num_appended(num_init_data);
+  std::thread appender([&]() {
+    for (uint32_t i = num_init_data; i < num_data; ++ i) {
+      racing.insert(data[i]);
+      num_appended = i + 1;
+    }
+  });
+  std::mt19937_64 reader_gen(kSeed);
+  while (num_appended < num_data) {
+    uint32_t i = reader_gen() % num_appended;
+    VT val = 0;
+    bool found = racing.find(data[i].first, val);
+    ASSERT_WITH_MSG(found && val == data[i].second, "Find {" << data[i].first 
+                    << ", " << data[i].second << "} racing with appends, but "
+                    << "got {" << val << "}")
   }
-  std::string key_type = vm["key_type"].as<std::string>();
-  std::string value_type = vm["value_type"].as<std::string>();
-  num_workers = vm["num_workers"].as<uint32_t>();
-  num_bg = vm["num_bg"].as<uint32_t>();
-  COUT_INFO("# user threads: " << num_workers << "\t# bg threads: " << num_bg)
-  if (test_type == "raw") {
-    std::string data_path = vm["data_path"].as<std::string>();
-    if (key_type == "double" && value_type == "uint64") {
-      test_raw_dataset<double, uint64_t>(data_path);
-    } else if (key_type == "int64" && value_type == "uint64") {
-      test_raw_dataset<int64_t, uint64_t>(data_path);
-    } else if (key_type == "uint64" && value_type == "uint64") {
-      test_raw_dataset<uint64_t, uint64_t>(data_path);
+  appender.join();
+  COUT_INFO("Success")
+}
+
+template<typename KT, typename VT>
+void test_negative(uint32_t num_data) {
+  // Keys with even ranks are bulk loaded, the others are absent
+  std::vector<std::pair<KT, VT>> init_data;
+  std::vector<KT> absent_keys;
+  init_data.reserve(num_data / 2 + 1);
+  absent_keys.reserve(num_data / 2 + 1);
+  std::mt19937_64 gen(kSeed);
+  KT key = 1;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    key += gen() % 1000 + 1;
+    if (i % 2 == 0) {
+      init_data.push_back({key, i});
     } else {
-      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
-               << value_type << "]")
+      absent_keys.push_back(key);
     }
-  } else if (test_type == "workload") {
-    std::string data_path = vm["data_path"].as<std::string>();
-    if (key_type == "double" && value_type == "uint64") {
-      test_workload<double, uint64_t>(data_path);
-    } else if (key_type == "int64" && value_type == "uint64") {
-      test_workload<int64_t, uint64_t>(data_path);
-    } else if (key_type == "uint64" && value_type == "uint64") {
-      test_workload<uint64_t, uint64_t>(data_path);
-    } else {
-      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
-               << value_type << "]")
+  }
+  shuffle(absent_keys, 0, absent_keys.size());
+
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.filter_bits_per_key = filter_bits_per_key;
+  afli.bulk_load(init_data.data(), init_data.size());
+  for (uint32_t i = 0; i < init_data.size(); ++ i) {
+    VT val = 0;
+    bool found = afli.find(init_data[i].first, val);
+    ASSERT_WITH_MSG(found && val == init_data[i].second, "Cannot find " << i 
+                    << "th loading key (" << init_data[i].first << ")")
+  }
+  auto start = TIME_LOG;
+  for (uint32_t i = 0; i < absent_keys.size(); ++ i) {
+    VT val = 0;
+    bool found = afli.find(absent_keys[i], val);
+    ASSERT_WITH_MSG(!found, "Find the absent key (" << absent_keys[i] << ")")
+  }
+  double miss_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+  COUT_INFO("Filter bits per key [" << filter_bits_per_key 
+            << "], average miss latency " << miss_time / absent_keys.size() 
+            << " ns, index size " << afli.index_size() << " bytes")
+  COUT_INFO("Success")
+}
+
+template<typename KT, typename VT>
+void test_scan(uint32_t num_data) {
+  // Half of the keys are bulk loaded, and the others are inserted by another 
+  // thread while scanning
+  std::vector<std::pair<KT, VT>> data;
+  data.reserve(num_data);
+  std::mt19937_64 gen(kSeed);
+  KT key = 1;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    key += gen() % 1000 + 1;
+    data.push_back({key, i});
+  }
+  std::vector<uint32_t> idx;
+  idx.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    idx.push_back(i);
+  }
+  shuffle(idx, 0, idx.size());
+  uint32_t num_init_data = num_data / 2;
+  std::vector<std::pair<KT, VT>> init_data;
+  init_data.reserve(num_init_data);
+  for (uint32_t i = 0; i < num_init_data; ++ i) {
+    init_data.push_back(data[idx[i]]);
+  }
+  std::sort(init_data.begin(), init_data.end(), 
+    [](const auto& a, const auto& b) {
+      return a.first < b.first;
+  });
+
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  afli.bulk_load(init_data.data(), init_data.size());
+
+  // Scans racing with inserts must be ordered and contain all loaded keys
+  std::thread inserter([&]() {
+    for (uint32_t i = num_init_data; i < num_data; ++ i) {
+      afli.insert(data[idx[i]]);
     }
-  } else if (test_type == "synthetic") {
-    uint32_t num_data = vm["num_data"].as<uint32_t>();
-    if (key_type == "double" && value_type == "uint64") {
-      test_synthetic<double, uint64_t>(num_data);
-    } else if (key_type == "int64" && value_type == "uint64") {
-      test_synthetic<int64_t, uint64_t>(num_data);
-    } else if (key_type == "uint64" && value_type == "uint64") {
-      test_synthetic<uint64_t, uint64_t>(num_data);
+  });
+  std::vector<std::pair<KT, VT>> res;
+  for (uint32_t i = 0; i < 100; ++ i) {
+    uint32_t l = gen() % num_init_data;
+    uint32_t r = std::min(l + 1000, num_init_data - 1);
+    res.clear();
+    afli.scan(init_data[l].first, init_data[r].first, res);
+    for (uint32_t j = 1; j < res.size(); ++ j) {
+      ASSERT_WITH_MSG(res[j - 1].first < res[j].first, "Unordered keys (" 
+                      << res[j - 1].first << ", " << res[j].first << ")")
+    }
+    for (uint32_t j = l, k = 0; j <= r; ++ j) {
+      while (k < res.size() && res[k].first < init_data[j].first) {
+        k ++;
+      }
+      ASSERT_WITH_MSG(k < res.size() && res[k] == init_data[j], "Miss the " 
+                      << j << "th loading key (" << init_data[j].first << ")")
+    }
+  }
+  inserter.join();
+
+  // Full scans in both directions
+  AFLICursor<KT, VT> it = afli.cursor();
+  uint32_t cnt = 0;
+  for (it.seek_to_first(); it.valid(); it.next(), ++ cnt) {
+    ASSERT_WITH_MSG(cnt < num_data && it.key() == data[cnt].first 
+                    && it.value() == data[cnt].second, "Scan {" << it.key() 
+                    << ", " << it.value() << "} at " << cnt)
+  }
+  ASSERT_WITH_MSG(cnt == num_data, "Scan " << cnt << " keys")
+  for (it.seek_to_last(); it.valid(); it.prev()) {
+    cnt --;
+    ASSERT_WITH_MSG(it.key() == data[cnt].first, "Reversely scan {" 
+                    << it.key() << ", " << it.value() << "} at " << cnt)
+  }
+  ASSERT_WITH_MSG(cnt == 0, "Reversely miss " << cnt << " keys")
+  for (uint32_t i = 0; i < 1000; ++ i) {
+    uint32_t j = gen() % num_data;
+    it.seek(j == 0 ? data[j].first : data[j - 1].first + 1);
+    ASSERT_WITH_MSG(it.valid() && it.key() == data[j].first, "Seek the " 
+                    << j << "th key (" << data[j].first << ")")
+    it.seek_for_prev(data[j].first - 1);
+    ASSERT_WITH_MSG(j == 0 ? !it.valid() : it.valid() 
+                    && it.key() == data[j - 1].first, "Seek the previous key of" 
+                    << " the " << j << "th key (" << data[j].first << ")")
+  }
+
+  // Benchmark scans by range length
+  for (uint32_t len = 1; len <= 10000 && len <= num_data; len *= 10) {
+    uint32_t num_scans = std::max(1000000 / len, 100U);
+    std::vector<uint32_t> starts;
+    starts.reserve(num_scans);
+    for (uint32_t i = 0; i < num_scans; ++ i) {
+      starts.push_back(gen() % (num_data - len + 1));
+    }
+    uint64_t num_keys = 0;
+    auto start = TIME_LOG;
+    for (uint32_t i = 0; i < num_scans; ++ i) {
+      res.clear();
+      num_keys += afli.scan(data[starts[i]].first, 
+                            data[starts[i] + len - 1].first, res);
+    }
+    double scan_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+    ASSERT_WITH_MSG(num_keys == static_cast<uint64_t>(num_scans) * len, 
+                    "Scan " << num_keys << " keys in " << num_scans 
+                    << " ranges of length " << len)
+    COUT_INFO("Range length [" << len << "], average scan latency " 
+              << scan_time / num_scans << " ns, " << scan_time / num_keys 
+              << " ns per key")
+  }
+  COUT_INFO("Success")
+}
+
+template<typename KT, typename VT>
+void test_neighbor(uint32_t num_data) {
+  // Half of the keys are bulk loaded and the others are inserted, then the 
+  // ordered point queries are compared with binary searches
+  std::vector<std::pair<KT, VT>> data;
+  data.reserve(num_data);
+  std::mt19937_64 gen(kSeed);
+  KT key = 1;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    key += gen() % 1000 + 2;
+    data.push_back({key, i});
+  }
+  std::vector<uint32_t> idx;
+  idx.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    idx.push_back(i);
+  }
+  shuffle(idx, 0, idx.size());
+  uint32_t num_init_data = num_data / 2;
+  std::vector<std::pair<KT, VT>> init_data;
+  init_data.reserve(num_init_data);
+  for (uint32_t i = 0; i < num_init_data; ++ i) {
+    init_data.push_back(data[idx[i]]);
+  }
+  std::sort(init_data.begin(), init_data.end(), 
+    [](const auto& a, const auto& b) {
+      return a.first < b.first;
+  });
+
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  afli.bulk_load(init_data.data(), init_data.size());
+  for (uint32_t i = num_init_data; i < num_data; ++ i) {
+    afli.insert(data[idx[i]]);
+  }
+
+  // Query keys are either stored keys or the keys just before them
+  std::vector<KT> queries;
+  queries.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    queries.push_back(data[gen() % num_data].first - (gen() % 2));
+  }
+  auto rank = [&](KT k) {
+    return std::lower_bound(data.begin(), data.end(), std::make_pair(k, VT()), 
+      [](const auto& a, const auto& b) {
+        return a.first < b.first;
+    }) - data.begin();
+  };
+  for (uint32_t i = 0; i < queries.size(); ++ i) {
+    KT q = queries[i];
+    uint32_t r = rank(q);
+    bool exist = r < num_data && data[r].first == q;
+    std::pair<KT, VT> res;
+    bool found = afli.lower_bound(q, res);
+    ASSERT_WITH_MSG(found && res == data[r], "Wrong lower bound of key (" << q 
+                    << ")")
+    found = afli.successor(q, res);
+    uint32_t succ = exist ? r + 1 : r;
+    ASSERT_WITH_MSG(succ == num_data ? !found : found && res == data[succ], 
+                    "Wrong successor of key (" << q << ")")
+    found = afli.predecessor(q, res);
+    int64_t pred = exist ? r : static_cast<int64_t>(r) - 1;
+    ASSERT_WITH_MSG(pred < 0 ? !found : found && res == data[pred], 
+                    "Wrong predecessor of key (" << q << ")")
+  }
+  std::pair<KT, VT> res;
+  ASSERT_WITH_MSG(!afli.successor(data[num_data - 1].first, res) 
+                  && !afli.predecessor(data[0].first - 1, res), 
+                  "Find keys out of the range")
+
+  auto start = TIME_LOG;
+  for (uint32_t i = 0; i < queries.size(); ++ i) {
+    VT val;
+    afli.find(queries[i], val);
+  }
+  double find_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+  start = TIME_LOG;
+  for (uint32_t i = 0; i < queries.size(); ++ i) {
+    afli.lower_bound(queries[i], res);
+  }
+  double lower_bound_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+  start = TIME_LOG;
+  for (uint32_t i = 0; i < queries.size(); ++ i) {
+    afli.predecessor(queries[i], res);
+  }
+  double predecessor_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+  COUT_INFO("Average latency of find " << find_time / queries.size() 
+            << " ns, lower_bound " << lower_bound_time / queries.size() 
+            << " ns, predecessor " << predecessor_time / queries.size() 
+            << " ns")
+  COUT_INFO("Success")
+}
+
+template<typename KT, typename VT>
+void test_rank(uint32_t num_data) {
+  // Half of the keys are bulk loaded and the others are inserted, then some 
+  // keys are removed. Estimations are compared with the exact ranks.
+  std::vector<std::pair<KT, VT>> data;
+  data.reserve(num_data);
+  std::mt19937_64 gen(kSeed);
+  KT key = 1;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    key += gen() % 1000 + 2;
+    data.push_back({key, i});
+  }
+  std::vector<uint32_t> idx;
+  idx.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    idx.push_back(i);
+  }
+  shuffle(idx, 0, idx.size());
+  uint32_t num_init_data = num_data / 2;
+  std::vector<std::pair<KT, VT>> init_data;
+  init_data.reserve(num_init_data);
+  for (uint32_t i = 0; i < num_init_data; ++ i) {
+    init_data.push_back(data[idx[i]]);
+  }
+  std::sort(init_data.begin(), init_data.end(), 
+    [](const auto& a, const auto& b) {
+      return a.first < b.first;
+  });
+
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  afli.hyper_para.rank_stride = rank_stride;
+  afli.bulk_load(init_data.data(), init_data.size());
+  auto start = TIME_LOG;
+  for (uint32_t i = num_init_data; i < num_data; ++ i) {
+    afli.insert(data[idx[i]]);
+  }
+  double insert_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+  // Remove 10% of the keys
+  std::vector<KT> keys;
+  keys.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    if (idx[i] % 10 == 0) {
+      bool removed = afli.remove(data[idx[i]].first);
+      ASSERT_WITH_MSG(removed, "Cannot remove key (" << data[idx[i]].first 
+                      << ")")
+    }
+  }
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    if (i % 10 != 0) {
+      keys.push_back(data[i].first);
+    }
+  }
+  COUT_INFO("Rank stride [" << rank_stride << "], average insert latency " 
+            << insert_time / (num_data - num_init_data) << " ns, index size " 
+            << afli.index_size() << " bytes")
+
+  std::vector<KT> queries;
+  queries.reserve(100000);
+  for (uint32_t i = 0; i < 100000; ++ i) {
+    queries.push_back(data[gen() % num_data].first - (gen() % 2));
+  }
+  auto rank = [&](KT k) {
+    return std::lower_bound(keys.begin(), keys.end(), k) - keys.begin();
+  };
+  std::vector<double> max_errors = {0, 100, 10000};
+  for (double max_error : max_errors) {
+    double sum_error = 0;
+    for (uint32_t i = 0; i < queries.size(); ++ i) {
+      double r = afli.approx_rank(queries[i], max_error);
+      double error = std::fabs(r - rank(queries[i]));
+      ASSERT_WITH_MSG(error <= max_error + 1e-6, "The error of the rank of key (" 
+                      << queries[i] << ") is " << error)
+      KT end = queries[(i + 1) % queries.size()];
+      if (end < queries[i]) {
+        continue;
+      }
+      double c = afli.estimate_count(queries[i], end, max_error);
+      uint64_t exact = std::upper_bound(keys.begin(), keys.end(), end) 
+                       - keys.begin() - rank(queries[i]);
+      error = std::fabs(c - exact);
+      ASSERT_WITH_MSG(error <= max_error + 1e-6, "The error of the count of " 
+                      << "range [" << queries[i] << ", " << end << "] is " 
+                      << error)
+      sum_error += error;
+    }
+    start = TIME_LOG;
+    double sum = 0;
+    for (uint32_t i = 0; i < queries.size(); ++ i) {
+      sum += afli.approx_rank(queries[i], max_error);
+    }
+    double rank_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+    COUT_INFO("Max error [" << max_error << "], average count error " 
+              << sum_error / queries.size() << ", average rank latency " 
+              << rank_time / queries.size() << " ns")
+    UNUSED(sum);
+  }
+  COUT_INFO("Success")
+}
+
+template<typename KT, typename VT>
+void test_snapshot(uint32_t num_data) {
+  // Half of the keys are bulk loaded, then another thread inserts the others, 
+  // updates and removes some loaded keys, while snapshot reads must return 
+  // the loaded pairs exactly
+  std::vector<std::pair<KT, VT>> data;
+  data.reserve(num_data);
+  std::mt19937_64 gen(kSeed);
+  KT key = 1;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    key += gen() % 1000 + 1;
+    data.push_back({key, i});
+  }
+  std::vector<uint32_t> idx;
+  idx.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    idx.push_back(i);
+  }
+  shuffle(idx, 0, idx.size());
+  uint32_t num_init_data = num_data / 2;
+  std::vector<std::pair<KT, VT>> init_data;
+  init_data.reserve(num_init_data);
+  for (uint32_t i = 0; i < num_init_data; ++ i) {
+    init_data.push_back(data[idx[i]]);
+  }
+  std::sort(init_data.begin(), init_data.end(), 
+    [](const auto& a, const auto& b) {
+      return a.first < b.first;
+  });
+
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  afli.bulk_load(init_data.data(), init_data.size());
+  afli.enable_snapshots();
+  Snapshot loaded = afli.get_snapshot();
+
+  auto check_range = [&](const Snapshot& snapshot, 
+                         const std::vector<std::pair<KT, VT>>& expected, 
+                         uint32_t l, uint32_t r) {
+    std::vector<std::pair<KT, VT>> res;
+    afli.scan(expected[l].first, expected[r].first, res, snapshot);
+    ASSERT_WITH_MSG(res.size() == r - l + 1, "Scan " << res.size() 
+                    << " keys in snapshot " << snapshot.version 
+                    << ", expect " << r - l + 1)
+    for (uint32_t j = l; j <= r; ++ j) {
+      ASSERT_WITH_MSG(res[j - l] == expected[j], "Scan {" << res[j - l].first 
+                      << ", " << res[j - l].second << "} in snapshot " 
+                      << snapshot.version << ", expect {" 
+                      << expected[j].first << ", " << expected[j].second 
+                      << "}")
+    }
+  };
+
+  std::thread writer([&]() {
+    for (uint32_t i = num_init_data; i < num_data; ++ i) {
+      afli.insert(data[idx[i]]);
+      uint32_t j = idx[i - num_init_data];
+      if (j % 10 == 0) {
+        afli.update({data[j].first, data[j].second + num_data});
+      } else if (j % 10 == 1) {
+        afli.remove(data[j].first);
+      }
+    }
+  });
+  std::vector<KT> keys(1000);
+  std::vector<VT> values(keys.size());
+  bool* found = new bool[keys.size()];
+  for (uint32_t i = 0; i < 100; ++ i) {
+    uint32_t l = gen() % num_init_data;
+    uint32_t r = std::min(l + 1000, num_init_data - 1);
+    check_range(loaded, init_data, l, r);
+    for (uint32_t j = 0; j < keys.size(); ++ j) {
+      keys[j] = data[gen() % num_data].first;
+    }
+    afli.multi_get(keys.data(), keys.size(), values.data(), found, loaded);
+    for (uint32_t j = 0; j < keys.size(); ++ j) {
+      auto it = std::lower_bound(init_data.begin(), init_data.end(), 
+                                 std::make_pair(keys[j], VT()));
+      bool exist = it != init_data.end() && it->first == keys[j];
+      ASSERT_WITH_MSG(found[j] == exist && (!exist || values[j] == it->second), 
+                      "Get key (" << keys[j] << ") in snapshot " 
+                      << loaded.version)
+    }
+  }
+  writer.join();
+  delete[] found;
+
+  // A newer snapshot sees all writes, then both snapshots are checked after 
+  // removing the inserted keys
+  std::vector<bool> loaded_keys(num_data, false);
+  for (uint32_t i = 0; i < num_init_data; ++ i) {
+    loaded_keys[idx[i]] = true;
+  }
+  std::vector<std::pair<KT, VT>> written;
+  written.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    if (loaded_keys[i] && i % 10 == 0) {
+      written.push_back({data[i].first, data[i].second + num_data});
+    } else if (!loaded_keys[i] || i % 10 != 1) {
+      written.push_back(data[i]);
+    }
+  }
+  Snapshot latest = afli.get_snapshot();
+  for (uint32_t i = num_init_data; i < num_data; ++ i) {
+    afli.remove(data[idx[i]].first);
+  }
+  check_range(loaded, init_data, 0, num_init_data - 1);
+  check_range(latest, written, 0, written.size() - 1);
+  afli.release_snapshot(loaded);
+  check_range(latest, written, 0, written.size() - 1);
+  afli.release_snapshot(latest);
+
+  // Benchmark writes with active snapshots
+  std::vector<uint32_t> removed;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    if (loaded_keys[i] && i % 10 == 1) {
+      removed.push_back(i);
+    }
+  }
+  loaded = afli.get_snapshot();
+  auto start = TIME_LOG;
+  for (uint32_t i : removed) {
+    afli.insert(data[i]);
+  }
+  double insert_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+  start = TIME_LOG;
+  std::vector<std::pair<KT, VT>> res;
+  for (uint32_t i = 0; i < 1000; ++ i) {
+    uint32_t l = gen() % (num_data - 100);
+    res.clear();
+    afli.scan(data[l].first, data[l + 99].first, res, loaded);
+  }
+  double scan_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+  COUT_INFO("Average insert latency " << insert_time / removed.size() 
+            << " ns, average scan latency of 100 keys " << scan_time / 1000 
+            << " ns, index size " << afli.index_size() << " bytes")
+  afli.release_snapshot(loaded);
+  COUT_INFO("Success")
+}
+
+template<typename KT, typename VT>
+void test_rmw(uint32_t num_data) {
+  // Half of the keys are bulk loaded and incremented by all workers with 
+  // fetch_add and compare_exchange, while the first worker upserts the others
+  std::vector<std::pair<KT, VT>> data;
+  data.reserve(num_data);
+  std::mt19937_64 gen(kSeed);
+  KT key = 1;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    key += gen() % 1000 + 1;
+    data.push_back({key, i});
+  }
+  std::vector<uint32_t> idx;
+  idx.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    idx.push_back(i);
+  }
+  shuffle(idx, 0, idx.size());
+  uint32_t num_init_data = num_data / 2;
+  std::vector<std::pair<KT, VT>> init_data;
+  init_data.reserve(num_init_data);
+  for (uint32_t i = 0; i < num_init_data; ++ i) {
+    init_data.push_back(data[idx[i]]);
+  }
+  std::sort(init_data.begin(), init_data.end(), 
+    [](const auto& a, const auto& b) {
+      return a.first < b.first;
+  });
+
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  afli.bulk_load(init_data.data(), init_data.size());
+
+  uint32_t num_threads = std::max(num_workers, 2U);
+  std::vector<std::thread> workers;
+  for (uint32_t t = 0; t < num_threads; ++ t) {
+    workers.emplace_back([&, t]() {
+      std::mt19937_64 local_gen(kSeed + t);
+      for (uint32_t i = 0; i < num_init_data; ++ i) {
+        if (t == 0 && num_init_data + i < num_data) {
+          bool inserted = afli.upsert(data[idx[num_init_data + i]]);
+          ASSERT_WITH_MSG(inserted, "Upsert an existing key (" 
+                          << data[idx[num_init_data + i]].first << ")")
+        }
+        KT k = init_data[local_gen() % num_init_data].first;
+        VT old;
+        bool found = afli.fetch_add(k, 1, old);
+        ASSERT_WITH_MSG(found, "Cannot fetch_add key (" << k << ")")
+        VT expected = old + 1;
+        while (!afli.compare_exchange(k, expected, expected + 1)) { }
+      }
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  VT sum = 0;
+  for (uint32_t i = 0; i < num_init_data; ++ i) {
+    VT value;
+    bool found = afli.find(init_data[i].first, value);
+    ASSERT_WITH_MSG(found && value >= init_data[i].second, "Cannot find key (" 
+                    << init_data[i].first << ")")
+    sum += value - init_data[i].second;
+  }
+  ASSERT_WITH_MSG(sum == 2ULL * num_threads * num_init_data, "Lose " 
+                  << 2ULL * num_threads * num_init_data - sum << " increments")
+  for (uint32_t i = num_init_data; i < num_data; ++ i) {
+    bool inserted = afli.upsert({data[idx[i]].first, data[idx[i]].second + 1});
+    VT value;
+    bool found = afli.find(data[idx[i]].first, value);
+    ASSERT_WITH_MSG(!inserted && found && value == data[idx[i]].second + 1, 
+                    "Upsert key (" << data[idx[i]].first << ")")
+  }
+
+  // Compare fetch_add with a find plus an update
+  std::vector<KT> keys;
+  keys.reserve(1000000);
+  for (uint32_t i = 0; i < 1000000; ++ i) {
+    keys.push_back(data[gen() % num_data].first);
+  }
+  auto start = TIME_LOG;
+  for (KT k : keys) {
+    VT old;
+    afli.fetch_add(k, 1, old);
+  }
+  double rmw_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+  start = TIME_LOG;
+  for (KT k : keys) {
+    VT value;
+    afli.find(k, value);
+    afli.update({k, value + 1});
+  }
+  double find_update_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+  COUT_INFO("Average fetch_add latency " << rmw_time / keys.size() 
+            << " ns, find plus update latency " 
+            << find_update_time / keys.size() << " ns")
+  COUT_INFO("Success")
+}
+
+template<typename KT>
+KT make_key(std::mt19937_64& gen) {
+  if constexpr (std::is_same<KT, CompositeKey>::value) {
+    // Timestamps of a few tenants
+    return CompositeKey(gen() % 16, gen() % 1000000000000ULL);
+  } else if constexpr (std::is_arithmetic<KT>::value) {
+    return gen() % 1000000000000ULL;
+  } else {
+    // Paths with shared prefixes and variable lengths
+    static const char* prefixes[] = {"com.ex/", "com.ex/items/", 
+                                     "org.ex/users/"};
+    std::string s = prefixes[gen() % 3] + std::to_string(gen() % 100000000);
+    return KT(s);
+  }
+}
+
+template<typename KT, typename VT>
+double measure_find(const std::vector<std::pair<KT, VT>>& data) {
+  // Bulk load half of the pairs, insert the others, and time the lookups
+  std::vector<std::pair<KT, VT>> init_data;
+  for (uint32_t i = 0; i < data.size(); i += 2) {
+    init_data.push_back(data[i]);
+  }
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  afli.bulk_load(init_data.data(), init_data.size());
+  for (uint32_t i = 1; i < data.size(); i += 2) {
+    afli.insert(data[i]);
+  }
+  std::vector<uint32_t> idx(data.size());
+  for (uint32_t i = 0; i < data.size(); ++ i) {
+    idx[i] = i;
+  }
+  shuffle(idx, 0, idx.size());
+  auto start = TIME_LOG;
+  for (uint32_t i : idx) {
+    VT value;
+    bool found = afli.find(data[i].first, value);
+    ASSERT_WITH_MSG(found && value == data[i].second, "Cannot find key (" 
+                    << data[i].first << ")")
+  }
+  return TIME_IN_NANO_SECOND(start, TIME_LOG) / data.size();
+}
+
+template<typename KT, typename VT>
+void test_byte_keys(uint32_t num_data) {
+  // Half of the keys are bulk loaded and the others are inserted, then point, 
+  // ordered and range queries are checked against the sorted keys
+  std::mt19937_64 gen(kSeed);
+  std::vector<KT> keys;
+  keys.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    keys.push_back(make_key<KT>(gen));
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  num_data = keys.size();
+  std::vector<std::pair<KT, VT>> data;
+  data.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    data.push_back({keys[i], i});
+  }
+  std::vector<uint32_t> idx;
+  idx.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    idx.push_back(i);
+  }
+  shuffle(idx, 0, idx.size());
+  uint32_t num_init_data = num_data / 2;
+  std::vector<std::pair<KT, VT>> init_data;
+  init_data.reserve(num_init_data);
+  for (uint32_t i = 0; i < num_init_data; ++ i) {
+    init_data.push_back(data[idx[i]]);
+  }
+  std::sort(init_data.begin(), init_data.end(), 
+    [](const auto& a, const auto& b) {
+      return a.first < b.first;
+  });
+
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  afli.hyper_para.filter_bits_per_key = filter_bits_per_key;
+  afli.bulk_load(init_data.data(), init_data.size());
+  for (uint32_t i = num_init_data; i < num_data; ++ i) {
+    afli.insert(data[idx[i]]);
+  }
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    VT value;
+    bool found = afli.find(data[i].first, value);
+    ASSERT_WITH_MSG(found && value == data[i].second, "Cannot find the " << i 
+                    << "th key (" << data[i].first << ")")
+  }
+  std::vector<std::pair<KT, VT>> res;
+  for (uint32_t i = 0; i < 100; ++ i) {
+    uint32_t l = gen() % num_data;
+    uint32_t r = std::min(l + 100, num_data - 1);
+    res.clear();
+    afli.scan(data[l].first, data[r].first, res);
+    ASSERT_WITH_MSG(res.size() == r - l + 1 
+                    && std::equal(res.begin(), res.end(), data.begin() + l), 
+                    "Scan the [" << l << ", " << r << "]th keys")
+  }
+  for (uint32_t i = 0; i + 1 < num_data; i += 97) {
+    std::pair<KT, VT> kv;
+    bool found = afli.successor(data[i].first, kv);
+    ASSERT_WITH_MSG(found && kv == data[i + 1], "Wrong successor of the " << i 
+                    << "th key (" << data[i].first << ")")
+  }
+  for (uint32_t i = 0; i < num_data; i += 10) {
+    bool removed = afli.remove(data[i].first);
+    VT value;
+    ASSERT_WITH_MSG(removed && !afli.find(data[i].first, value), 
+                    "Cannot remove the " << i << "th key (" << data[i].first 
+                    << ")")
+  }
+
+  // Compare with integer keys of the same size
+  std::vector<std::pair<uint64_t, VT>> int_data;
+  int_data.reserve(num_data);
+  uint64_t key = 1;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    key += gen() % 1000 + 1;
+    int_data.push_back({key, i});
+  }
+  double find_time = measure_find(data);
+  double int_find_time = measure_find(int_data);
+  COUT_INFO("Key size [" << sizeof(KT) << "], average find latency " 
+            << find_time << " ns, uint64 keys " << int_find_time << " ns")
+  COUT_INFO("Success")
+}
+
+template<typename KT>
+void test_vlog(uint32_t num_data) {
+  // Half of the keys are bulk loaded and the others are inserted. Workers 
+  // overwrite their keys for a few rounds and remove some of them, while 
+  // the main thread collects the value log.
+  std::mt19937_64 gen(kSeed);
+  std::vector<KT> keys;
+  keys.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    keys.push_back(make_key<KT>(gen));
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  num_data = keys.size();
+  std::vector<std::pair<KT, std::string>> init_data;
+  for (uint32_t i = 0; i < num_data; i += 2) {
+    init_data.push_back({keys[i], std::string()});
+    generate_value(keys[i], 0, value_size, init_data.back().second);
+  }
+
+  VLogPara<KT> vlog(num_bg, vlog_dir, 1 << 20);
+  vlog.index->hyper_para.append_mode = append_mode;
+  vlog.bulk_load(init_data.data(), init_data.size());
+  std::string value, expected;
+  auto start = TIME_LOG;
+  for (uint32_t i = 1; i < num_data; i += 2) {
+    generate_value(keys[i], 0, value_size, value);
+    vlog.insert(keys[i], value.data(), value.size());
+  }
+  double insert_time = TIME_IN_NANO_SECOND(start, TIME_LOG) 
+                       / (num_data / 2);
+  start = TIME_LOG;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    bool found = vlog.find(keys[i], value);
+    generate_value(keys[i], 0, value_size, expected);
+    ASSERT_WITH_MSG(found && value == expected, "Cannot find the " << i 
+                    << "th key (" << keys[i] << ")")
+  }
+  double find_time = TIME_IN_NANO_SECOND(start, TIME_LOG) / num_data;
+
+  const uint32_t kNumRounds = 3;
+  uint32_t num_threads = std::max(num_workers, 2U);
+  std::atomic<uint32_t> num_running(num_threads);
+  std::vector<std::thread> workers;
+  start = TIME_LOG;
+  for (uint32_t t = 0; t < num_threads; ++ t) {
+    workers.emplace_back([&, t]() {
+      std::string v;
+      for (uint32_t r = 1; r <= kNumRounds; ++ r) {
+        for (uint32_t i = t; i < num_data; i += num_threads) {
+          if (r == kNumRounds && i % 10 == 9) {
+            bool removed = vlog.remove(keys[i]);
+            ASSERT_WITH_MSG(removed, "Cannot remove key (" << keys[i] << ")")
+          } else {
+            generate_value(keys[i], r, value_size, v);
+            bool updated = vlog.update(keys[i], v.data(), v.size());
+            ASSERT_WITH_MSG(updated, "Cannot update key (" << keys[i] << ")")
+          }
+        }
+      }
+      num_running --;
+    });
+  }
+  uint32_t num_collected = 0;
+  while (num_running > 0) {
+    num_collected += vlog.collect();
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  double write_time = TIME_IN_NANO_SECOND(start, TIME_LOG) 
+                      / (num_data * kNumRounds);
+  uint64_t arena_size = vlog.arena_size();
+  num_collected += vlog.collect();
+
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    bool found = vlog.find(keys[i], value);
+    if (i % 10 == 9) {
+      ASSERT_WITH_MSG(!found, "Find the removed key (" << keys[i] << ")")
+    } else {
+      generate_value(keys[i], kNumRounds, value_size, expected);
+      ASSERT_WITH_MSG(found && value == expected, "Wrong value of the " << i 
+                      << "th key (" << keys[i] << ")")
+    }
+  }
+  std::vector<std::pair<KT, std::string>> res;
+  uint32_t l = num_data / 3, r = std::min(l + 1000, num_data - 1);
+  vlog.scan(keys[l], keys[r], res);
+  ASSERT_WITH_MSG(res.size() == (r - l + 1) - ((r + 1) / 10 - l / 10), 
+                  "Scan " << res.size() << " pairs in the [" << l << ", " 
+                  << r << "]th keys")
+  for (auto& kv : res) {
+    generate_value(kv.first, kNumRounds, value_size, expected);
+    ASSERT_WITH_MSG(kv.second == expected, "Wrong value of key (" << kv.first 
+                    << ") in the scan")
+  }
+  uint64_t live_size = vlog.value_size();
+  ASSERT_WITH_MSG(vlog.arena_size() <= 2 * live_size + (8 << 20), 
+                  "The arena of " << vlog.arena_size() << " bytes is not "
+                  << "collected, " << live_size << " bytes are live")
+  COUT_INFO("Value size [" << value_size << "], index size " 
+            << vlog.index_size() / 1e6 << " MB, live values " 
+            << live_size / 1e6 << " MB, arena " << arena_size / 1e6 
+            << " MB before collection, " << vlog.arena_size() / 1e6 
+            << " MB after collection, " << num_collected 
+            << " segments collected")
+  COUT_INFO("Average latency: insert " << insert_time << " ns, find " 
+            << find_time << " ns, update " << write_time << " ns")
+  COUT_INFO("Success")
+}
+
+template<typename KT, typename VT>
+void test_compact(uint32_t num_data) {
+  // Keys are stored in the compact index and in an index of 64-bit keys and 
+  // values, then point queries, removes and scans are checked before the 
+  // index sizes are compared
+  std::mt19937_64 gen(kSeed);
+  std::vector<KT> keys;
+  keys.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    keys.push_back(static_cast<KT>(gen()));
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  num_data = keys.size();
+  // Sets take keys only
+  typedef typename std::conditional<std::is_void<VT>::value, Nil, VT>::type 
+          ValueT;
+  std::vector<KT> init_keys;
+  std::vector<std::pair<KT, ValueT>> init_data;
+  std::vector<std::pair<uint64_t, uint64_t>> wide_data;
+  for (uint32_t i = 0; i < num_data; i += 2) {
+    init_keys.push_back(keys[i]);
+    wide_data.push_back({keys[i], i});
+    if constexpr (!std::is_void<VT>::value) {
+      init_data.push_back({keys[i], static_cast<VT>(i)});
+    }
+  }
+
+  AFLIPara<KT, VT> afli(num_bg);
+  AFLIPara<uint64_t, uint64_t> wide_afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  wide_afli.hyper_para.append_mode = append_mode;
+  if constexpr (std::is_void<VT>::value) {
+    afli.bulk_load(init_keys.data(), init_keys.size());
+  } else {
+    afli.bulk_load(init_data.data(), init_data.size());
+  }
+  wide_afli.bulk_load(wide_data.data(), wide_data.size());
+  auto start = TIME_LOG;
+  for (uint32_t i = 1; i < num_data; i += 2) {
+    if constexpr (std::is_void<VT>::value) {
+      afli.insert(keys[i]);
+    } else {
+      afli.insert({keys[i], static_cast<VT>(i)});
+    }
+  }
+  double insert_time = TIME_IN_NANO_SECOND(start, TIME_LOG) 
+                       / (num_data / 2);
+  for (uint32_t i = 1; i < num_data; i += 2) {
+    wide_afli.insert({keys[i], i});
+  }
+  start = TIME_LOG;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    bool found = false;
+    if constexpr (std::is_void<VT>::value) {
+      found = afli.find(keys[i]);
+    } else {
+      VT value;
+      found = afli.find(keys[i], value) && value == static_cast<VT>(i);
+    }
+    ASSERT_WITH_MSG(found, "Cannot find the " << i << "th key (" << keys[i] 
+                    << ")")
+  }
+  double find_time = TIME_IN_NANO_SECOND(start, TIME_LOG) / num_data;
+  uint64_t index_size = afli.index_size();
+  uint64_t wide_index_size = wide_afli.index_size();
+
+  for (uint32_t i = 0; i < num_data; i += 10) {
+    bool removed = afli.remove(keys[i]);
+    ASSERT_WITH_MSG(removed, "Cannot remove the " << i << "th key (" 
+                    << keys[i] << ")")
+  }
+  uint32_t l = num_data / 3, r = std::min(l + 1000, num_data - 1);
+  uint32_t num_res = 0;
+  if constexpr (std::is_void<VT>::value) {
+    std::vector<KT> res;
+    num_res = afli.scan(keys[l], keys[r], res);
+    for (uint32_t i = 0, j = l; i < res.size(); ++ i, ++ j) {
+      j += (j % 10 == 0);
+      ASSERT_WITH_MSG(res[i] == keys[j], "Wrong " << i << "th key (" 
+                      << res[i] << ") of the scan")
+    }
+  } else {
+    std::vector<std::pair<KT, ValueT>> res;
+    num_res = afli.scan(keys[l], keys[r], res);
+    for (uint32_t i = 0, j = l; i < res.size(); ++ i, ++ j) {
+      j += (j % 10 == 0);
+      ASSERT_WITH_MSG(res[i].first == keys[j], "Wrong " << i << "th key (" 
+                      << res[i].first << ") of the scan")
+    }
+  }
+  uint32_t num_removed = (r + 9) / 10 - (l + 9) / 10;
+  ASSERT_WITH_MSG(num_res == r - l + 1 - num_removed, "Scan " << num_res 
+                  << " keys in the [" << l << ", " << r << "]th keys")
+  COUT_INFO("Key size [" << sizeof(KT) << "], index size " << index_size / 1e6 
+            << " MB, uint64 pairs " << wide_index_size / 1e6 << " MB (" 
+            << wide_index_size * 1. / index_size << "x)")
+  COUT_INFO("Average latency: insert " << insert_time << " ns, find " 
+            << find_time << " ns")
+  COUT_INFO("Success")
+}
+
+template<typename KT, typename VT>
+void test_frozen(uint32_t num_data) {
+  // The first 80% of keys are half bulk loaded and half inserted, and the 
+  // others are inserted beyond the loaded keys. The frozen indexes with and 
+  // without delta encoding are checked against all keys and absent keys, 
+  // then compared with the mutable one.
+  std::mt19937_64 gen(kSeed);
+  std::vector<KT> keys;
+  keys.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    keys.push_back(make_key<KT>(gen));
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  num_data = keys.size();
+  uint32_t num_loaded = num_data / 10 * 8;
+  std::vector<std::pair<KT, VT>> init_data;
+  for (uint32_t i = 0; i < num_loaded; i += 2) {
+    init_data.push_back({keys[i], i});
+  }
+  std::vector<KT> absent_keys;
+  for (uint32_t i = 0; i < num_data / 10; ++ i) {
+    KT key = make_key<KT>(gen);
+    if (!std::binary_search(keys.begin(), keys.end(), key)) {
+      absent_keys.push_back(key);
+    }
+  }
+
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  afli.bulk_load(init_data.data(), init_data.size());
+  for (uint32_t i = 1; i < num_data; ++ i) {
+    if (i >= num_loaded || i % 2 == 1) {
+      afli.insert({keys[i], i});
+    }
+  }
+  std::vector<uint32_t> idx(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    idx[i] = i;
+  }
+  shuffle(idx, 0, idx.size());
+  auto start = TIME_LOG;
+  for (uint32_t i : idx) {
+    VT value;
+    bool found = afli.find(keys[i], value);
+    ASSERT_WITH_MSG(found && value == i, "Cannot find the " << i 
+                    << "th key (" << keys[i] << ")")
+  }
+  double find_time = TIME_IN_NANO_SECOND(start, TIME_LOG) / num_data;
+  uint64_t index_size = afli.index_size();
+  COUT_INFO("Index size " << index_size / 1e6 << " MB, average find latency " 
+            << find_time << " ns")
+
+  // Freeze without and with the delta encoding
+  for (bool compress : {false, true}) {
+    start = TIME_LOG;
+    FrozenAFLIPara<KT, VT>* frozen = afli.freeze(compress);
+    double freeze_time = TIME_IN_SECOND(start, TIME_LOG);
+    ASSERT_WITH_MSG(frozen->size() == num_data, "The frozen index has " 
+                    << frozen->size() << " keys, expected " << num_data)
+    start = TIME_LOG;
+    for (uint32_t i : idx) {
+      VT value;
+      bool found = frozen->find(keys[i], value);
+      ASSERT_WITH_MSG(found && value == i, "Cannot find the " << i 
+                      << "th key (" << keys[i] << ") in the frozen index")
+    }
+    double frozen_find_time = TIME_IN_NANO_SECOND(start, TIME_LOG) 
+                              / num_data;
+    for (const KT& key : absent_keys) {
+      VT value;
+      ASSERT_WITH_MSG(!frozen->find(key, value), "Find the absent key (" 
+                      << key << ") in the frozen index")
+    }
+    uint64_t frozen_size = frozen->index_size();
+    COUT_INFO("Compress [" << compress << "], freeze in " << freeze_time 
+              << " s, frozen size " << frozen_size / 1e6 << " MB (" 
+              << index_size * 1. / frozen_size << "x), average find latency " 
+              << frozen_find_time << " ns")
+    delete frozen;
+  }
+  COUT_INFO("Success")
+}
+
+template<typename KT, typename VT>
+void test_layout(uint32_t num_data) {
+  // The first 80% of keys are half bulk loaded and half inserted, and the 
+  // others are appended to seal segments. Every node layout is checked 
+  // against all keys and absent keys.
+  std::mt19937_64 gen(kSeed);
+  std::vector<KT> keys;
+  keys.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    keys.push_back(make_key<KT>(gen));
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  num_data = keys.size();
+  uint32_t num_loaded = num_data / 10 * 8;
+  std::vector<std::pair<KT, VT>> init_data;
+  for (uint32_t i = 0; i < num_loaded; i += 2) {
+    init_data.push_back({keys[i], i});
+  }
+  std::vector<KT> absent_keys;
+  for (uint32_t i = 0; i < num_data / 10; ++ i) {
+    KT key = make_key<KT>(gen);
+    if (!std::binary_search(keys.begin(), keys.end(), key)) {
+      absent_keys.push_back(key);
+    }
+  }
+  std::vector<uint32_t> idx(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    idx[i] = i;
+  }
+  shuffle(idx, 0, idx.size());
+
+  for (uint32_t layout : {kHeapLayout, kBreadthFirst, kBlocked}) {
+    AFLIPara<KT, VT> afli(num_bg);
+    afli.hyper_para.append_mode = append_mode;
+    afli.hyper_para.node_layout = layout;
+    auto start = TIME_LOG;
+    afli.bulk_load(init_data.data(), init_data.size());
+    double load_time = TIME_IN_SECOND(start, TIME_LOG);
+    for (uint32_t i = 1; i < num_data; ++ i) {
+      if (i >= num_loaded || i % 2 == 1) {
+        afli.insert({keys[i], i});
+      }
+    }
+    start = TIME_LOG;
+    for (uint32_t i : idx) {
+      VT value;
+      bool found = afli.find(keys[i], value);
+      ASSERT_WITH_MSG(found && value == i, "Cannot find the " << i 
+                      << "th key (" << keys[i] << ") in layout " << layout)
+    }
+    double find_time = TIME_IN_NANO_SECOND(start, TIME_LOG) / num_data;
+    for (const KT& key : absent_keys) {
+      VT value;
+      ASSERT_WITH_MSG(!afli.find(key, value), "Find the absent key (" << key 
+                      << ") in layout " << layout)
+    }
+    COUT_INFO("Layout [" << layout << "], bulk load in " << load_time 
+              << " s, index size " << afli.index_size() / 1e6 
+              << " MB, average find latency " << find_time << " ns")
+  }
+  COUT_INFO("Success")
+}
+
+template<typename KT, typename VT>
+void test_batch(uint32_t num_data) {
+  // The first 80% of keys are half bulk loaded, the others are inserted in 
+  // batches by all workers, each taking disjoint batches, and the batches 
+  // are upserted again with new values. Batches are timed against inserts 
+  // one by one of the same batches by as many workers.
+  std::mt19937_64 gen(kSeed);
+  std::vector<KT> keys;
+  keys.reserve(num_data);
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    keys.push_back(make_key<KT>(gen));
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  num_data = keys.size();
+  uint32_t num_loaded = num_data / 10 * 8;
+  std::vector<std::pair<KT, VT>> init_data;
+  std::vector<std::pair<KT, VT>> new_data;
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    if (i < num_loaded && i % 2 == 0) {
+      init_data.push_back({keys[i], i});
+    } else {
+      new_data.push_back({keys[i], i});
+    }
+  }
+  shuffle(new_data, 0, new_data.size());
+  const uint32_t kBatchSize = 4096;
+  uint32_t num_batches = (new_data.size() + kBatchSize - 1) / kBatchSize;
+
+  // Each worker takes every 'num_workers'-th batch
+  auto run_workers = [&](auto fn) {
+    std::vector<std::thread> workers;
+    for (uint32_t t = 0; t < num_workers; ++ t) {
+      workers.emplace_back([&, t]() {
+        for (uint32_t b = t; b < num_batches; b += num_workers) {
+          uint32_t size = std::min<uint32_t>(kBatchSize, 
+                                             new_data.size() - b * kBatchSize);
+          fn(new_data.data() + b * kBatchSize, size);
+        }
+      });
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  };
+
+  AFLIPara<KT, VT> single(num_bg);
+  single.hyper_para.append_mode = append_mode;
+  single.bulk_load(init_data.data(), init_data.size());
+  auto start = TIME_LOG;
+  run_workers([&](const std::pair<KT, VT>* kvs, uint32_t size) {
+    for (uint32_t i = 0; i < size; ++ i) {
+      single.insert(kvs[i]);
+    }
+  });
+  double single_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+
+  AFLIPara<KT, VT> afli(num_bg);
+  afli.hyper_para.append_mode = append_mode;
+  afli.hyper_para.rank_stride = rank_stride;
+  afli.bulk_load(init_data.data(), init_data.size());
+  auto run_batches = [&](bool overwrite) {
+    std::atomic<uint32_t> num_inserted(0);
+    run_workers([&](const std::pair<KT, VT>* kvs, uint32_t size) {
+      num_inserted += overwrite ? afli.upsert_batch(kvs, size) 
+                                : afli.insert_batch(kvs, size);
+    });
+    return num_inserted.load();
+  };
+  start = TIME_LOG;
+  uint32_t num_inserted = run_batches(false);
+  double batch_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+  ASSERT_WITH_MSG(num_inserted == new_data.size(), "Insert " << num_inserted 
+                  << " of " << new_data.size() << " keys in batches")
+  for (auto& kv : new_data) {
+    kv.second += num_data;
+  }
+  num_inserted = run_batches(true);
+  ASSERT_WITH_MSG(num_inserted == 0, "Upsert " << num_inserted 
+                  << " existing keys as new ones")
+
+  for (uint32_t i = 0; i < num_data; ++ i) {
+    VT value;
+    bool found = afli.find(keys[i], value);
+    VT expected = i < num_loaded && i % 2 == 0 ? i : i + num_data;
+    ASSERT_WITH_MSG(found && value == expected, "Cannot find the " << i 
+                    << "th key (" << keys[i] << ")")
+  }
+  if (rank_stride > 0) {
+    for (uint32_t i = 0; i < num_data; i += num_data / 100 + 1) {
+      double r = afli.approx_rank(keys[i]);
+      ASSERT_WITH_MSG(std::fabs(r - i) < 1e-6, "The rank of the " << i 
+                      << "th key is " << r)
+    }
+  }
+  COUT_INFO("Batch size [" << kBatchSize << "], average insert latency of " 
+            << num_workers << " workers " << single_time / new_data.size() 
+            << " ns one by one, " << batch_time / new_data.size() 
+            << " ns in batches")
+  if constexpr (std::is_same<KT, uint64_t>::value) {
+    // Dense runs of sequential keys past large loaded keys fill one slot, 
+    // whose child is modeled at the magnitude of the keys
+    const uint64_t kMaxKey = 4600000000000000ULL;
+    std::vector<KT> large_keys;
+    for (uint32_t i = 0; i < 200000; ++ i) {
+      large_keys.push_back(gen() % kMaxKey);
+    }
+    std::sort(large_keys.begin(), large_keys.end());
+    large_keys.erase(std::unique(large_keys.begin(), large_keys.end()), 
+                     large_keys.end());
+    std::vector<std::pair<KT, VT>> large_data;
+    for (uint32_t i = 0; i < large_keys.size(); ++ i) {
+      large_data.push_back({large_keys[i], i});
+    }
+    AFLIPara<KT, VT> large(num_bg);
+    large.bulk_load(large_data.data(), large_data.size());
+    std::vector<std::pair<KT, VT>> run;
+    for (uint32_t i = 0; i < 1000; ++ i) {
+      run.push_back({large_keys.back() + i + 1, i});
+    }
+    for (uint32_t i = 0; i < run.size(); i += 128) {
+      large.upsert_batch(run.data() + i, 
+                         std::min<uint32_t>(128, run.size() - i));
+    }
+    for (uint32_t i = 0; i < run.size(); ++ i) {
+      VT value;
+      bool found = large.find(run[i].first, value);
+      ASSERT_WITH_MSG(found && value == run[i].second, "Cannot find the " 
+                      << i << "th sequential key (" << run[i].first << ")")
+    }
+  }
+  COUT_INFO("Success")
+}
+
+int main(int argc, char* argv[]) {
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", (tostr("example: ./test_afli_para ") 
+     + "--data_path books-200M-20R-zipf.bin " 
+     + "--test_type workload --num_workers 1 --num_bg 2").data())
+    ("data_path", po::value<std::string>(), 
+     "the path of data")
+    ("weight_path", po::value<std::string>(), 
+     "the path of the weights of NF models")
+    ("test_type", po::value<std::string>(), 
+     "the test type")
+    ("key_type", po::value<std::string>(), 
+     "the key type of workload, e.g., double, int32, int64, string, composite")
+    ("value_type", po::value<std::string>(), 
+     "the value type of workload, e.g., double, int32, int64, bytes, void")
+    ("value_size", po::value<uint32_t>(), 
+     "the bytes of values in the value log")
+    ("vlog_dir", po::value<std::string>(), 
+     "the directory of value log segments, memory by default")
+    ("num_workers", po::value<uint32_t>(), 
+     "the number of user threads")
+    ("num_bg", po::value<uint32_t>(), 
+     "the number of background threads")
+    ("num_data", po::value<uint32_t>(), 
+     "the number of synthetic data")
+    ("append_mode", po::value<uint32_t>(), 
+     "whether out-of-bound keys are appended to the right edge, e.g., 0, 1")
+    ("filter_bits", po::value<uint32_t>(), 
+     "the bits per key of subtree filters, 0 means no filters")
+    ("rank_stride", po::value<uint32_t>(), 
+     "the number of slots per rank counter")
+  ;
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+  } catch (...) {
+    COUT_ERR("Unrecognized parameters, please use --help");
+  }
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    COUT_INFO(desc)
+    return 0;
+  }
+
+  check_options(vm, {"test_type"});
+  std::string test_type = vm["test_type"].as<std::string>();
+  if (test_type == "raw" || test_type == "workload") {
+    check_options(vm, {"data_path", "key_type", "value_type", "num_workers", 
+                  "num_bg"});
+  } else if (test_type == "synthetic" || test_type == "append" 
+             || test_type == "negative" || test_type == "scan" 
+             || test_type == "neighbor" || test_type == "rank" 
+             || test_type == "snapshot" || test_type == "rmw" 
+             || test_type == "bytes" || test_type == "vlog" 
+             || test_type == "compact" || test_type == "frozen" 
+             || test_type == "layout" || test_type == "batch") {
+    check_options(vm, {"num_data", "key_type", "value_type", "num_workers", 
+                  "num_bg"});
+  }
+  std::string key_type = vm["key_type"].as<std::string>();
+  std::string value_type = vm["value_type"].as<std::string>();
+  num_workers = vm["num_workers"].as<uint32_t>();
+  num_bg = vm["num_bg"].as<uint32_t>();
+  if (vm.count("append_mode")) {
+    append_mode = vm["append_mode"].as<uint32_t>();
+  }
+  if (vm.count("filter_bits")) {
+    filter_bits_per_key = vm["filter_bits"].as<uint32_t>();
+  }
+  if (vm.count("rank_stride")) {
+    rank_stride = vm["rank_stride"].as<uint32_t>();
+  }
+  if (vm.count("value_size")) {
+    value_size = vm["value_size"].as<uint32_t>();
+  }
+  if (vm.count("vlog_dir")) {
+    vlog_dir = vm["vlog_dir"].as<std::string>();
+  }
+  COUT_INFO("# user threads: " << num_workers << "\t# bg threads: " << num_bg)
+  if (test_type == "raw") {
+    std::string data_path = vm["data_path"].as<std::string>();
+    if (key_type == "double" && value_type == "uint64") {
+      test_raw_dataset<double, uint64_t>(data_path);
+    } else if (key_type == "int64" && value_type == "uint64") {
+      test_raw_dataset<int64_t, uint64_t>(data_path);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_raw_dataset<uint64_t, uint64_t>(data_path);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "workload") {
+    std::string data_path = vm["data_path"].as<std::string>();
+    if (key_type == "double" && value_type == "uint64") {
+      test_workload<double, AFLIPara<double, uint64_t>>(data_path);
+    } else if (key_type == "int64" && value_type == "uint64") {
+      test_workload<int64_t, AFLIPara<int64_t, uint64_t>>(data_path);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_workload<uint64_t, AFLIPara<uint64_t, uint64_t>>(data_path);
+    } else if (key_type == "double" && value_type == "bytes") {
+      test_workload<double, VLogPara<double>>(data_path);
+    } else if (key_type == "int64" && value_type == "bytes") {
+      test_workload<int64_t, VLogPara<int64_t>>(data_path);
+    } else if (key_type == "uint64" && value_type == "bytes") {
+      test_workload<uint64_t, VLogPara<uint64_t>>(data_path);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "synthetic") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "double" && value_type == "uint64") {
+      test_synthetic<double, uint64_t>(num_data);
+    } else if (key_type == "int64" && value_type == "uint64") {
+      test_synthetic<int64_t, uint64_t>(num_data);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_synthetic<uint64_t, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "append") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "int64" && value_type == "uint64") {
+      test_append<int64_t, uint64_t>(num_data);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_append<uint64_t, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "negative") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "int64" && value_type == "uint64") {
+      test_negative<int64_t, uint64_t>(num_data);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_negative<uint64_t, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "scan") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "int64" && value_type == "uint64") {
+      test_scan<int64_t, uint64_t>(num_data);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_scan<uint64_t, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "neighbor") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "int64" && value_type == "uint64") {
+      test_neighbor<int64_t, uint64_t>(num_data);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_neighbor<uint64_t, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "rank") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "int64" && value_type == "uint64") {
+      test_rank<int64_t, uint64_t>(num_data);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_rank<uint64_t, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "snapshot") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "int64" && value_type == "uint64") {
+      test_snapshot<int64_t, uint64_t>(num_data);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_snapshot<uint64_t, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "rmw") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "double" && value_type == "uint64") {
+      test_rmw<double, uint64_t>(num_data);
+    } else if (key_type == "int64" && value_type == "uint64") {
+      test_rmw<int64_t, uint64_t>(num_data);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_rmw<uint64_t, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "compact") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "uint32" && value_type == "uint32") {
+      test_compact<uint32_t, uint32_t>(num_data);
+    } else if (key_type == "uint32" && value_type == "void") {
+      test_compact<uint32_t, void>(num_data);
+    } else if (key_type == "uint64" && value_type == "void") {
+      test_compact<uint64_t, void>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "frozen") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "uint64" && value_type == "uint64") {
+      test_frozen<uint64_t, uint64_t>(num_data);
+    } else if (key_type == "uint32" && value_type == "uint32") {
+      test_frozen<uint32_t, uint32_t>(num_data);
+    } else if (key_type == "string" && value_type == "uint64") {
+      test_frozen<StrKey<>, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "layout") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "uint64" && value_type == "uint64") {
+      test_layout<uint64_t, uint64_t>(num_data);
+    } else if (key_type == "uint32" && value_type == "uint32") {
+      test_layout<uint32_t, uint32_t>(num_data);
+    } else if (key_type == "string" && value_type == "uint64") {
+      test_layout<StrKey<>, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "batch") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "uint64" && value_type == "uint64") {
+      test_batch<uint64_t, uint64_t>(num_data);
+    } else if (key_type == "uint32" && value_type == "uint32") {
+      test_batch<uint32_t, uint32_t>(num_data);
+    } else if (key_type == "string" && value_type == "uint64") {
+      test_batch<StrKey<>, uint64_t>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "vlog") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "uint64" && value_type == "bytes") {
+      test_vlog<uint64_t>(num_data);
+    } else if (key_type == "string" && value_type == "bytes") {
+      test_vlog<StrKey<>>(num_data);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "bytes") {
+    uint32_t num_data = vm["num_data"].as<uint32_t>();
+    if (key_type == "string" && value_type == "uint64") {
+      test_byte_keys<StrKey<>, uint64_t>(num_data);
+    } else if (key_type == "composite" && value_type == "uint64") {
+      test_byte_keys<CompositeKey, uint64_t>(num_data);
     } else {
       COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
                << value_type << "]")
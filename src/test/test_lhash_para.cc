@@ -0,0 +1,288 @@
+#include "core/afli_para_impl.h"
+#include "core/lhash_para_impl.h"
+#include "core/common.h"
+#include "util/workload.h"
+
+typedef std::chrono::time_point<std::chrono::high_resolution_clock> TT;
+
+namespace po = boost::program_options;
+using namespace aflipara;
+
+volatile bool running = false;
+std::atomic<size_t> ready_threads(0);
+
+uint32_t num_workers = 1;
+uint32_t num_bg = 1;
+
+template<typename KT, typename VT>
+void create_index(AFLIPara<KT, VT>*& index) {
+  index = new AFLIPara<KT, VT>(num_bg);
+}
+
+template<typename KT, typename VT>
+void create_index(LHashPara<KT, VT>*& index) {
+  index = new LHashPara<KT, VT>();
+}
+
+template<typename Index, typename KT>
+struct ThreadParam {
+  uint32_t id;
+  Index* index;
+  std::vector<Request<KT>>* reqs;
+  uint32_t num_done_reqs;
+  TT start_time;
+  TT end_time;
+};
+
+template<typename Index, typename KT, typename VT>
+void* run_requests(void* param) {
+  ThreadParam<Index, KT>& thread_param = *((ThreadParam<Index, KT>*)param);
+  uint32_t thread_id = thread_param.id;
+  Index* index = thread_param.index;
+  std::vector<Request<KT>>& reqs = *(thread_param.reqs);
+
+  uint32_t reqs_per_thread = std::ceil(reqs.size() / num_workers);
+  uint32_t start_idx = thread_id * reqs_per_thread;
+  uint32_t end_idx = (thread_id + 1) * reqs_per_thread;
+
+  ready_threads ++;
+  while (!running) ;
+
+  VT dummy_value = 2022;
+  thread_param.start_time = TIME_LOG;
+  for (uint32_t i = start_idx; i < end_idx && i < reqs.size(); ++ i) {
+    Request<KT>& req = reqs[i];
+    if (req.op == kQuery) {
+      VT value;
+      index->find(req.key, value);
+    } else if (req.op == kUpdate) {
+      index->update({req.key, dummy_value});
+    } else if (req.op == kRemove) {
+      index->remove(req.key);
+    } else if (req.op == kInsert) {
+      index->insert({req.key, dummy_value});
+    }
+    thread_param.num_done_reqs ++;
+  }
+  thread_param.end_time = TIME_LOG;
+  ready_threads --;
+  pthread_exit(nullptr);
+}
+
+template<typename Index, typename KT, typename VT>
+void test_workload(std::string workload_path) {
+  std::vector<KT> init_keys;
+  std::vector<std::pair<KT, VT>> init_kvs;
+  std::vector<Request<KT>> reqs;
+  load_workload(workload_path, init_keys, reqs);
+  init_kvs.reserve(init_keys.size());
+  for (uint32_t i = 0; i < init_keys.size(); ++ i) {
+    init_kvs.push_back({init_keys[i], i});
+  }
+  COUT_INFO("# loading data [" << init_kvs.size() << "]")
+  COUT_INFO("# requests [" << reqs.size() << "]")
+
+  Index* index = nullptr;
+  create_index(index);
+  auto bulk_load_start = TIME_LOG;
+  index->bulk_load(init_kvs.data(), init_kvs.size());
+  auto bulk_load_end = TIME_LOG;
+  COUT_INFO("Bulk loading\t" << TIME_IN_SECOND(bulk_load_start, bulk_load_end)
+            << " sec")
+
+  pthread_t threads[num_workers];
+  ThreadParam<Index, KT> thread_params[num_workers];
+
+  running = false;
+  for (uint32_t i = 0; i < num_workers; ++ i) {
+    thread_params[i].id = i;
+    thread_params[i].index = index;
+    thread_params[i].reqs = &reqs;
+    thread_params[i].num_done_reqs = 0;
+    int ret = pthread_create(&threads[i], nullptr, run_requests<Index, KT, VT>,
+                             (void *)&thread_params[i]);
+    ASSERT_WITH_MSG(!ret, "Error Code\t" << ret << " of Thread-" << i)
+  }
+
+  while (ready_threads < num_workers) {
+    sleep(1);
+  }
+
+  running = true;
+  while (ready_threads > 0) {
+    sleep(1);
+  }
+  running = false;
+
+  for (uint32_t i = 0; i < num_workers; ++ i) {
+    int rc = pthread_join(threads[i], nullptr);
+    ASSERT_WITH_MSG(!rc, "Return Code\t" << rc << " of Thread-" << i)
+  }
+  double sum_latency = 0;
+  for (uint32_t i = 0; i < num_workers; ++ i) {
+    double latency = TIME_IN_NANO_SECOND(thread_params[i].start_time,
+                                         thread_params[i].end_time);
+    sum_latency = std::max(sum_latency, latency);
+  }
+  COUT_INFO("Overall Throughput: " << reqs.size() * 1e3 / sum_latency
+            << " million ops/sec, average latency: "
+            << sum_latency / reqs.size() << " ns")
+  COUT_INFO("Index Size\t" << index->index_size() << " bytes")
+  delete index;
+}
+
+template<typename Index, typename KT, typename VT>
+void test_keyset(std::string data_path) {
+  std::vector<KT> keys;
+  load_keyset(data_path, keys);
+  uint32_t num_keys = keys.size();
+  std::vector<uint32_t> idx;
+  for (uint32_t i = 0; i < num_keys; ++ i) {
+    idx.push_back(i);
+  }
+  shuffle(idx, 0, num_keys);
+  std::vector<std::pair<KT, VT>> init_data;
+  std::vector<std::pair<KT, VT>> insert_data;
+  init_data.reserve(num_keys / 2);
+  insert_data.reserve(num_keys - num_keys / 2);
+  for (uint32_t i = 0; i < num_keys; ++ i) {
+    if (i < num_keys / 2) {
+      init_data.push_back({keys[idx[i]], i});
+    } else {
+      insert_data.push_back({keys[idx[i]], i});
+    }
+  }
+  std::sort(init_data.begin(), init_data.end(),
+    [](auto const& a, auto const& b) {
+      return a.first < b.first;
+  });
+
+  Index* index = nullptr;
+  create_index(index);
+  auto start = TIME_LOG;
+  index->bulk_load(init_data.data(), init_data.size());
+  double bulk_load_time = TIME_IN_SECOND(start, TIME_LOG);
+  uint64_t bulk_load_size = index->index_size();
+
+  start = TIME_LOG;
+  for (uint32_t i = 0; i < init_data.size(); ++ i) {
+    VT value = 0;
+    bool found = index->find(init_data[i].first, value);
+    ASSERT_WITH_MSG(found && value == init_data[i].second, "Cannot find "
+                    << i << "th loading key (" << init_data[i].first << ")")
+  }
+  double query_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+
+  start = TIME_LOG;
+  for (uint32_t i = 0; i < insert_data.size(); ++ i) {
+    index->insert(insert_data[i]);
+  }
+  double insert_time = TIME_IN_NANO_SECOND(start, TIME_LOG);
+
+  for (uint32_t i = 0; i < insert_data.size(); ++ i) {
+    VT value = 0;
+    bool found = index->find(insert_data[i].first, value);
+    ASSERT_WITH_MSG(found && value == insert_data[i].second, "Cannot find "
+                    << i << "th inserted key (" << insert_data[i].first << ")")
+  }
+  if constexpr (std::is_same<Index, LHashPara<KT, VT>>::value) {
+    // Inserts of existing keys overwrite their values
+    uint64_t num_keys = index->num_keys;
+    for (uint32_t i = 0; i < insert_data.size(); ++ i) {
+      index->insert({insert_data[i].first, insert_data[i].second + 1});
+    }
+    for (uint32_t i = 0; i < insert_data.size(); ++ i) {
+      VT value = 0;
+      bool found = index->find(insert_data[i].first, value);
+      ASSERT_WITH_MSG(found && value == insert_data[i].second + 1, "Wrong "
+                      << "reinsert of the " << i << "th inserted key (" 
+                      << insert_data[i].first << ")")
+    }
+    ASSERT_WITH_MSG(index->num_keys == num_keys, "Reinserts add " 
+                    << index->num_keys - num_keys << " keys")
+  }
+  COUT_INFO("Bulk loading\t" << bulk_load_time << " sec\n"
+            << "Index Size (Bulk Loading)\t" << bulk_load_size << " bytes\n"
+            << "Index Size (Insertion)\t" << index->index_size() << " bytes\n"
+            << "Average Query Latency\t" << query_time / init_data.size()
+            << " ns\n"
+            << "Average Insert Latency\t" << insert_time / insert_data.size()
+            << " ns")
+  COUT_INFO("Test Success")
+  delete index;
+}
+
+template<typename KT, typename VT>
+void run_test(std::string test_type, std::string index_type,
+              std::string data_path) {
+  if (test_type == "keyset" && index_type == "afli") {
+    test_keyset<AFLIPara<KT, VT>, KT, VT>(data_path);
+  } else if (test_type == "keyset" && index_type == "lhash") {
+    test_keyset<LHashPara<KT, VT>, KT, VT>(data_path);
+  } else if (test_type == "workload" && index_type == "afli") {
+    test_workload<AFLIPara<KT, VT>, KT, VT>(data_path);
+  } else if (test_type == "workload" && index_type == "lhash") {
+    test_workload<LHashPara<KT, VT>, KT, VT>(data_path);
+  } else {
+    COUT_ERR("Unsupported test type [" << test_type << "] index type ["
+             << index_type << "]")
+  }
+}
+
+int main(int argc, char* argv[]) {
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", (tostr("example: ./test_lhash_para ")
+     + "--data_path books-200M-20R-zipf.bin --index_type lhash "
+     + "--test_type workload --num_workers 1 --num_bg 2").data())
+    ("data_path", po::value<std::string>(),
+     "the path of data")
+    ("index_type", po::value<std::string>(),
+     "the index type, e.g., afli, lhash")
+    ("test_type", po::value<std::string>(),
+     "the test type, e.g., keyset, workload")
+    ("key_type", po::value<std::string>(),
+     "the key type of workload, e.g., double, int32, int64")
+    ("value_type", po::value<std::string>(),
+     "the value type of workload, e.g., double, int32, int64")
+    ("num_workers", po::value<uint32_t>(),
+     "the number of user threads")
+    ("num_bg", po::value<uint32_t>(),
+     "the number of background threads")
+  ;
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+  } catch (...) {
+    COUT_ERR("Unrecognized parameters, please use --help");
+  }
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    COUT_INFO(desc)
+    return 0;
+  }
+
+  check_options(vm, {"test_type", "index_type", "data_path", "key_type",
+                     "value_type", "num_workers", "num_bg"});
+  std::string test_type = vm["test_type"].as<std::string>();
+  std::string index_type = vm["index_type"].as<std::string>();
+  std::string data_path = vm["data_path"].as<std::string>();
+  std::string key_type = vm["key_type"].as<std::string>();
+  std::string value_type = vm["value_type"].as<std::string>();
+  num_workers = vm["num_workers"].as<uint32_t>();
+  num_bg = vm["num_bg"].as<uint32_t>();
+  COUT_INFO("# user threads: " << num_workers << "\t# bg threads: " << num_bg)
+  if (key_type == "double" && value_type == "uint64") {
+    run_test<double, uint64_t>(test_type, index_type, data_path);
+  } else if (key_type == "int64" && value_type == "uint64") {
+    run_test<int64_t, uint64_t>(test_type, index_type, data_path);
+  } else if (key_type == "uint64" && value_type == "uint64") {
+    run_test<uint64_t, uint64_t>(test_type, index_type, data_path);
+  } else {
+    COUT_ERR("Unsupported key type [" << key_type << "] value type ["
+             << value_type << "]")
+  }
+  return 0;
+}
@@ -12,6 +12,14 @@ std::atomic<size_t> ready_threads(0);
 
 uint32_t num_workers = 1;
 uint32_t num_bg = 1;
+uint32_t filter_bits_per_key = 0;
+uint32_t rank_stride = 0;
+uint32_t num_shards = 0;
+uint32_t queue_depth = 4;
+uint32_t engine = kTreeEngine;
+uint32_t max_runs = 8;
+uint32_t precision = kDoublePrecision;
+uint32_t load_threads = 0;
 
 template<typename KT, typename VT>
 struct ThreadParam {
@@ -71,7 +79,16 @@ void test_workload(std::string workload_path, std::string weight_path,
   COUT_INFO("# requests [" << reqs.size() << "]")
 
   auto bulk_load_start = TIME_LOG;
-  NFLPara<KT, VT> nfl(weight_path, buffer_size, num_bg);
+  NFLPara<KT, VT> nfl(weight_path, buffer_size, num_bg, num_shards, 
+                      queue_depth);
+  nfl.filter_bits_per_key = filter_bits_per_key;
+  nfl.rank_stride = rank_stride;
+  nfl.engine = static_cast<IngestEngine>(engine);
+  nfl.max_runs = max_runs;
+  nfl.flow_precision = static_cast<FlowPrecision>(precision);
+  if (load_threads > 0) {
+    nfl.num_load_threads = load_threads;
+  }
   auto bulk_load_mid = TIME_LOG;
   nfl.bulk_load(init_kvs.data(), init_kvs.size());
   auto bulk_load_end = TIME_LOG;
@@ -134,7 +151,16 @@ void test_keyset(std::string data_path, std::string weight_path,
   std::vector<KT> keys;
   load_keyset(data_path, keys);
   uint32_t num_keys = keys.size();
-  NFLPara<KT, VT> nfl(weight_path, buffer_size, num_bg);
+  NFLPara<KT, VT> nfl(weight_path, buffer_size, num_bg, num_shards, 
+                      queue_depth);
+  nfl.filter_bits_per_key = filter_bits_per_key;
+  nfl.rank_stride = rank_stride;
+  nfl.engine = static_cast<IngestEngine>(engine);
+  nfl.max_runs = max_runs;
+  nfl.flow_precision = static_cast<FlowPrecision>(precision);
+  if (load_threads > 0) {
+    nfl.num_load_threads = load_threads;
+  }
   std::vector<uint32_t> idx;
   for (uint32_t i = 0; i < num_keys; ++ i) {
     idx.push_back(i);
@@ -171,11 +197,70 @@ void test_keyset(std::string data_path, std::string weight_path,
                     << value << "] which should be [" << init_data[i].second 
                     << "], the query key is [" << init_data[i].first << "]");
   }
-  // Test insert
+  if (nfl.enable_flow) {
+    // Workers transform keys at once, each in its own workspace
+    COUT_INFO("Test Concurrent Transforms")
+    std::vector<double> expected(init_data.size());
+    TT start = TIME_LOG;
+    for (uint32_t i = 0; i < init_data.size(); ++ i) {
+      expected[i] = nfl.flow->transform(init_data[i]).first;
+    }
+    COUT_INFO("Transform a single key in " << TIME_IN_NANO_SECOND(start, 
+              TIME_LOG) * 1. / init_data.size() << " ns")
+    // Batches and single keys are transformed alike
+    std::vector<std::pair<double, std::pair<KT, VT>>> tran_kvs(
+      init_data.size());
+    nfl.flow->transform(init_data.data(), init_data.size(), tran_kvs.data());
+    for (uint32_t i = 0; i < init_data.size(); ++ i) {
+      ASSERT_WITH_MSG(tran_kvs[i].first == expected[i], "Transform the " << i 
+                      << "th key (" << init_data[i].first << ") to " 
+                      << tran_kvs[i].first << " in a batch instead of " 
+                      << expected[i])
+    }
+    uint32_t num_threads = std::max(num_workers, 2U);
+    std::vector<std::thread> workers;
+    for (uint32_t w = 0; w < num_threads; ++ w) {
+      workers.emplace_back([&, w]() {
+        for (uint32_t i = w; i < init_data.size(); i += num_threads) {
+          double tran_key = nfl.flow->transform(init_data[i]).first;
+          ASSERT_WITH_MSG(tran_key == expected[i], "Transform the " << i 
+                          << "th key (" << init_data[i].first << ") to " 
+                          << tran_key << " instead of " << expected[i])
+        }
+      });
+    }
+    for (std::thread& worker : workers) {
+      worker.join();
+    }
+  }
+  // Test insert, while other workers query the loaded keys without locks
   COUT_INFO("Test Insertion")
+  volatile bool inserting = true;
+  std::vector<std::thread> readers;
+  for (uint32_t w = 1; w < num_workers; ++ w) {
+    readers.emplace_back([&, w]() {
+      for (uint32_t i = w; inserting; i = (i + num_workers) 
+                                           % init_data.size()) {
+        VT value = 0;
+        bool found = nfl.find(init_data[i].first, value);
+        ASSERT_WITH_MSG(found && value == init_data[i].second, "Cannot find " 
+                        << i << "th key (" << init_data[i].first 
+                        << ") during insertion")
+      }
+    });
+  }
   for (uint32_t i = 0; i < insert_data.size(); ++ i) {
     nfl.insert(insert_data[i]);
   }
+  inserting = false;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  IngestStats stats = nfl.ingest_stats();
+  COUT_INFO("Flushed batches " << stats.num_batches << ", in flight " 
+            << stats.num_in_flight << ", stalled writes " << stats.num_stalls 
+            << " for " << stats.stall_time / 1e6 << " ms, sorted runs " 
+            << stats.num_runs << ", compactions " << stats.num_compactions)
   // Test query
   COUT_INFO("Test Querying After Insertion")
   for (uint32_t i = 0; i < init_data.size(); ++ i) {
@@ -196,6 +281,313 @@ void test_keyset(std::string data_path, std::string weight_path,
                     << value << "] which should be [" << insert_data[i].second 
                     << "], the query key is [" << insert_data[i].first << "]");
   }
+  // Test ordered point queries
+  COUT_INFO("Test Ordered Queries")
+  std::vector<std::pair<KT, VT>> all_data(init_data);
+  all_data.insert(all_data.end(), insert_data.begin(), insert_data.end());
+  std::sort(all_data.begin(), all_data.end(), 
+    [](auto const& a, auto const& b) {
+      return a.first < b.first;
+  });
+  for (uint32_t i = 0; i < all_data.size(); i += 97) {
+    std::pair<KT, VT> res;
+    bool found = nfl.lower_bound(all_data[i].first, res);
+    ASSERT_WITH_MSG(found && res == all_data[i], "Wrong lower bound of the " 
+                    << i << "th key (" << all_data[i].first << ")")
+    found = nfl.successor(all_data[i].first, res);
+    ASSERT_WITH_MSG(i + 1 == all_data.size() ? !found 
+                    : found && res == all_data[i + 1], "Wrong successor of the " 
+                    << i << "th key (" << all_data[i].first << ")")
+    found = nfl.predecessor(all_data[i].first, res);
+    ASSERT_WITH_MSG(found && res == all_data[i], "Wrong predecessor of the " 
+                    << i << "th key (" << all_data[i].first << ")")
+  }
+  // Test range queries
+  COUT_INFO("Test Range Queries")
+  std::vector<std::pair<KT, VT>> res;
+  for (uint32_t i = 0; i < all_data.size(); i += 997) {
+    uint32_t j = std::min(i + 100, static_cast<uint32_t>(all_data.size()) - 1);
+    res.clear();
+    uint32_t num = nfl.scan(all_data[i].first, all_data[j].first, res);
+    ASSERT_WITH_MSG(num == j - i + 1, "Scan " << num << " keys in the range " 
+                    << "of the [" << i << ", " << j << "]th keys")
+    for (uint32_t k = 0; k < num; ++ k) {
+      ASSERT_WITH_MSG(res[k] == all_data[i + k], "Scan the wrong key (" 
+                      << res[k].first << ") at the " << i + k << "th key")
+    }
+    if (rank_stride > 0) {
+      double c = nfl.estimate_count(all_data[i].first, all_data[j].first);
+      ASSERT_WITH_MSG(std::fabs(c - num) < 1e-6, "Estimate " << c 
+                      << " keys in the range of the [" << i << ", " << j 
+                      << "]th keys")
+    }
+  }
+  // Test read-modify-write operations
+  COUT_INFO("Test Read-Modify-Write")
+  for (uint32_t i = 0; i < all_data.size(); i += 13) {
+    KT key = all_data[i].first;
+    VT old = 0;
+    bool found = nfl.fetch_add(key, 1, old);
+    ASSERT_WITH_MSG(found && old == all_data[i].second, "Wrong fetch_add of " 
+                    << "the " << i << "th key (" << key << ")")
+    VT expected = all_data[i].second;
+    bool swapped = nfl.compare_exchange(key, expected, 0);
+    ASSERT_WITH_MSG(!swapped && expected == all_data[i].second + 1, 
+                    "Wrong failed compare_exchange of the " << i 
+                    << "th key (" << key << ")")
+    swapped = nfl.compare_exchange(key, expected, all_data[i].second + 2);
+    bool inserted = nfl.upsert({key, all_data[i].second + 3});
+    VT value = 0;
+    found = nfl.find(key, value);
+    ASSERT_WITH_MSG(swapped && !inserted && found 
+                    && value == all_data[i].second + 3, "Wrong upsert of the " 
+                    << i << "th key (" << key << ")")
+  }
+  for (uint32_t i = 0; i < 1000; ++ i) {
+    KT key = all_data.back().first + i + 1;
+    bool inserted = nfl.upsert({key, i});
+    VT old = 0;
+    bool found = nfl.fetch_add(key, 1, old);
+    ASSERT_WITH_MSG(inserted && found && old == i, "Wrong upsert of a new key (" 
+                    << key << ")")
+  }
+  // Test removals, removed keys are skipped by ordered queries
+  COUT_INFO("Test Removal")
+  std::vector<std::pair<KT, VT>> kept;
+  kept.reserve(all_data.size());
+  for (uint32_t i = 0; i < all_data.size(); ++ i) {
+    if ((i % 101 != 50 && i % 101 != 75) || i + 1 == all_data.size()) {
+      kept.push_back(all_data[i]);
+      continue;
+    }
+    KT key = all_data[i].first;
+    // A reinserted key is buffered while its older pair is still indexed
+    if (i % 101 == 75) {
+      nfl.insert(all_data[i]);
+    }
+    bool removed = nfl.remove(key);
+    VT value = 0;
+    bool found = nfl.find(key, value);
+    ASSERT_WITH_MSG(removed && !found && !nfl.remove(key), "Wrong removal of " 
+                    << "the " << i << "th key (" << key << ")")
+    std::pair<KT, VT> next;
+    found = nfl.lower_bound(key, next);
+    ASSERT_WITH_MSG(found && next.first == all_data[i + 1].first, 
+                    "Wrong lower bound of the removed " << i << "th key (" 
+                    << key << ")")
+  }
+  all_data.swap(kept);
+  nfl.compact();
+  for (uint32_t i = 0; i + 100 < all_data.size(); i += 997) {
+    res.clear();
+    uint32_t num = nfl.scan(all_data[i].first, all_data[i + 100].first, res);
+    ASSERT_WITH_MSG(num == 101 && res.back().first == all_data[i + 100].first, 
+                    "Scan " << num << " keys in the range of the [" << i 
+                    << ", " << i + 100 << "]th keys after removals")
+  }
+  // Test the frozen index, the values are the latest ones before freezing
+  COUT_INFO("Test Freezing")
+  for (uint32_t i = 0; i < all_data.size(); ++ i) {
+    bool found = nfl.find(all_data[i].first, all_data[i].second);
+    ASSERT_WITH_MSG(found, "Cannot find the " << i << "th key (" 
+                    << all_data[i].first << ") before freezing")
+  }
+  uint64_t index_size = nfl.index_size();
+  nfl.freeze(true);
+  for (uint32_t i = 0; i < all_data.size(); ++ i) {
+    VT value = 0;
+    bool found = nfl.find(all_data[i].first, value);
+    ASSERT_WITH_MSG(found && value == all_data[i].second, "Cannot find the " 
+                    << i << "th key (" << all_data[i].first 
+                    << ") after freezing")
+  }
+  for (uint32_t i = 0; i < 1000; ++ i) {
+    VT value = 0;
+    bool found = nfl.find(all_data.back().first + i + 1, value);
+    ASSERT_WITH_MSG(found && value == i + 1, "Cannot find the " << i 
+                    << "th upserted key after freezing")
+  }
+  COUT_INFO("Index size " << index_size / 1e6 << " MB, frozen " 
+            << nfl.index_size() / 1e6 << " MB")
+  COUT_INFO("Test Success")
+}
+
+// Time the backends over batches of normalized keys, and check that they
+// infer alike
+template<typename KT, typename VT>
+void test_backends(std::string weight_path) {
+  typedef std::pair<double, std::pair<KT, VT>> KKVT;
+  const uint32_t num_keys = 1 << 20;
+  std::mt19937_64 gen(2022);
+  std::normal_distribution<double> dist(0, 1);
+  std::vector<KKVT> keys(num_keys);
+  for (uint32_t i = 0; i < num_keys; ++ i) {
+    keys[i].first = dist(gen);
+  }
+  std::vector<double> expected;
+  for (const InferBackend* backend : InferBackend::all()) {
+    auto model = BNAF_Infer<KT, VT>::load(weight_path, backend, false);
+    typename BNAF_Infer<KT, VT>::Workspace ws;
+    for (uint32_t batch_size : {1, 16, 256, 4096, 65536}) {
+      std::vector<KKVT> tran_kvs = keys;
+      TT start = TIME_LOG;
+      for (uint32_t l = 0; l < num_keys; l += batch_size) {
+        model->transform(tran_kvs.data() + l, 
+                         std::min(batch_size, num_keys - l), ws);
+      }
+      COUT_INFO(backend->name() << "\tbatch size " << batch_size << "\t" 
+                << TIME_IN_NANO_SECOND(start, TIME_LOG) * 1. / num_keys 
+                << " ns per key")
+      for (uint32_t i = 0; i < num_keys; ++ i) {
+        if (expected.size() < num_keys) {
+          expected.push_back(tran_kvs[i].first);
+          continue;
+        }
+        ASSERT_WITH_MSG(std::fabs(tran_kvs[i].first - expected[i]) 
+                        <= 1e-9 * std::max(1., std::fabs(expected[i])), 
+                        backend->name() << " transforms the " << i 
+                        << "th key to " << tran_kvs[i].first << " instead of " 
+                        << expected[i])
+      }
+    }
+  }
+  // Reduced precision, and how far the transformed keys move. Batches and 
+  // single keys are transformed alike.
+  for (FlowPrecision p : {kFloatPrecision, kInt8Precision}) {
+    auto model = BNAF_Infer<KT, VT>::load(weight_path)->reduce(p);
+    typename BNAF_Infer<KT, VT>::Workspace ws;
+    std::vector<double> reduced;
+    for (uint32_t batch_size : {1, 4096}) {
+      std::vector<KKVT> tran_kvs = keys;
+      TT start = TIME_LOG;
+      for (uint32_t l = 0; l < num_keys; l += batch_size) {
+        model->transform(tran_kvs.data() + l, 
+                         std::min(batch_size, num_keys - l), ws);
+      }
+      double elapsed = TIME_IN_NANO_SECOND(start, TIME_LOG);
+      double max_error = 0;
+      for (uint32_t i = 0; i < num_keys; ++ i) {
+        max_error = std::max(max_error, std::fabs(tran_kvs[i].first 
+                                                  - expected[i]) 
+                                        / std::max(1., std::fabs(expected[i])));
+      }
+      COUT_INFO(precision_name(p) << "\tbatch size " << batch_size << "\t" 
+                << elapsed / num_keys << " ns per key, max relative error " 
+                << std::scientific << max_error)
+      for (uint32_t i = 0; i < num_keys; ++ i) {
+        if (reduced.size() < num_keys) {
+          reduced.push_back(tran_kvs[i].first);
+          continue;
+        }
+        ASSERT_WITH_MSG(tran_kvs[i].first == reduced[i], precision_name(p) 
+                        << " transforms the " << i << "th key to " 
+                        << tran_kvs[i].first << " in batches of " 
+                        << batch_size << " instead of " << reduced[i])
+      }
+    }
+  }
+  auto model = BNAF_Infer<KT, VT>::load(weight_path);
+  if (model->kernel != nullptr) {
+    std::vector<KKVT> tran_kvs = keys;
+    typename BNAF_Infer<KT, VT>::Workspace ws;
+    TT start = TIME_LOG;
+    for (uint32_t i = 0; i < num_keys; ++ i) {
+      model->transform(tran_kvs.data() + i, 1, ws);
+    }
+    COUT_INFO("fused\tbatch size 1\t" << TIME_IN_NANO_SECOND(start, 
+              TIME_LOG) * 1. / num_keys << " ns per key")
+  }
+  COUT_INFO("Test Success")
+}
+
+// Time the transforms of bulk loads by more and more threads, which have to 
+// output the same keys
+template<typename KT, typename VT>
+void test_transform(std::string data_path, std::string weight_path) {
+  typedef std::pair<double, std::pair<KT, VT>> KKVT;
+  std::vector<KT> keys;
+  load_keyset(data_path, keys);
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  std::vector<std::pair<KT, VT>> kvs;
+  for (uint32_t i = 0; i < keys.size(); ++ i) {
+    kvs.push_back({keys[i], i});
+  }
+  uint32_t num_keys = kvs.size();
+  NumericalFlow<KT, VT> flow(weight_path, NFLPara<KT, VT>::kMaxBatchSize);
+  uint32_t max_threads = std::max({load_threads, 4U, 
+                                   std::thread::hardware_concurrency()});
+  std::vector<KKVT> expected(num_keys);
+  for (uint32_t t = 1; t <= max_threads; t *= 2) {
+    std::vector<KKVT> tran_kvs(num_keys);
+    TT start = TIME_LOG;
+    flow.transform(kvs.data(), num_keys, tran_kvs.data(), t);
+    COUT_INFO(t << " threads\t" << TIME_IN_SECOND(start, TIME_LOG) 
+              << " s for " << num_keys << " keys")
+    if (t == 1) {
+      expected = tran_kvs;
+      continue;
+    }
+    for (uint32_t i = 0; i < num_keys; ++ i) {
+      ASSERT_WITH_MSG(tran_kvs[i].first == expected[i].first 
+                      && tran_kvs[i].second == expected[i].second, 
+                      t << " threads transform the " << i << "th key to " 
+                      << tran_kvs[i].first << " instead of " 
+                      << expected[i].first)
+    }
+  }
+  COUT_INFO("Test Success")
+}
+
+// Convert the text weights to the binary format, and check that both load 
+// to the same flow and how long loading takes
+template<typename KT, typename VT>
+void test_weights(std::string weight_path) {
+  typedef std::pair<double, std::pair<KT, VT>> KKVT;
+  const uint32_t num_loads = 100;
+  const uint32_t num_keys = 1 << 16;
+  std::string binary_path = (std::filesystem::temp_directory_path() 
+                             / "nfl_test_weights.bin").string();
+  BNAF_Infer<KT, VT>::load(weight_path)->save(binary_path);
+  std::shared_ptr<const BNAF_Infer<KT, VT>> models[2];
+  for (uint32_t k = 0; k < 2; ++ k) {
+    std::string path = k == 0 ? weight_path : binary_path;
+    TT start = TIME_LOG;
+    for (uint32_t i = 0; i < num_loads; ++ i) {
+      models[k] = BNAF_Infer<KT, VT>::load(path);
+    }
+    COUT_INFO((k == 0 ? "text" : "binary") << "\t" 
+              << TIME_IN_NANO_SECOND(start, TIME_LOG) / 1e3 / num_loads 
+              << " us per load")
+  }
+  ASSERT_WITH_MSG(models[1]->mapping != nullptr, "The binary weights are "
+                  << "not mapped")
+  ASSERT_WITH_MSG(models[0]->in_dim == models[1]->in_dim 
+                  && models[0]->hidden_dim == models[1]->hidden_dim
+                  && models[0]->num_layers == models[1]->num_layers
+                  && models[0]->mean == models[1]->mean 
+                  && models[0]->var == models[1]->var
+                  && models[0]->kernel == models[1]->kernel, 
+                  "The binary weights are of another shape")
+  std::mt19937_64 gen(2022);
+  std::normal_distribution<double> dist(0, 1);
+  std::vector<KKVT> keys[2];
+  keys[0].resize(num_keys);
+  for (uint32_t i = 0; i < num_keys; ++ i) {
+    keys[0][i].first = dist(gen);
+  }
+  keys[1] = keys[0];
+  for (uint32_t k = 0; k < 2; ++ k) {
+    models[k]->transform(keys[k].data(), num_keys, 
+                         BNAF_Infer<KT, VT>::local_workspace());
+  }
+  for (uint32_t i = 0; i < num_keys; ++ i) {
+    ASSERT_WITH_MSG(keys[0][i].first == keys[1][i].first, "The binary "
+                    << "weights transform the " << i << "th key to " 
+                    << keys[1][i].first << " instead of " << keys[0][i].first)
+  }
+  models[1].reset();
+  std::filesystem::remove(binary_path);
   COUT_INFO("Test Success")
 }
 
@@ -211,6 +603,24 @@ int main(int argc, char* argv[]) {
      "the path of flow weights")
     ("buffer_size", po::value<uint32_t>(), 
      "the max size of buffer")
+    ("filter_bits", po::value<uint32_t>(), 
+     "the bits per key of the global filter, 0 means no filter")
+    ("rank_stride", po::value<uint32_t>(), 
+     "the number of slots per rank counter, 0 means no counters")
+    ("num_shards", po::value<uint32_t>(), 
+     "the number of buffer shards, 0 means one per hardware thread")
+    ("queue_depth", po::value<uint32_t>(), 
+     "the number of sealed buffer tables of a shard waiting to flush")
+    ("engine", po::value<uint32_t>(), 
+     "the ingestion engine, 0 upserts flushes into the index, 1 keeps sorted runs")
+    ("max_runs", po::value<uint32_t>(), 
+     "the number of sorted runs triggering a compaction")
+    ("backend", po::value<std::string>(), 
+     "the backend of flow inference, i.e., mkl, openblas or native")
+    ("precision", po::value<uint32_t>(), 
+     "the precision of flows, 0 double, 1 float32 and 2 int8, refused if the order of keys suffers")
+    ("load_threads", po::value<uint32_t>(), 
+     "the number of threads transforming keys at bulk loads")
     ("test_type", po::value<std::string>(), 
      "the test type")
     ("key_type", po::value<std::string>(), 
@@ -238,20 +648,67 @@ int main(int argc, char* argv[]) {
 
   check_options(vm, {"test_type"});
   std::string test_type = vm["test_type"].as<std::string>();
-  if (test_type == "raw" || test_type == "workload") {
+  if (test_type == "raw" || test_type == "keyset" 
+      || test_type == "workload") {
     check_options(vm, {"data_path", "weight_path", "key_type", "value_type", 
                        "num_workers", "num_bg"});
+  } else if (test_type == "transform") {
+    check_options(vm, {"data_path", "weight_path", "key_type", 
+                       "value_type"});
+  } else {
+    check_options(vm, {"weight_path"});
   }
+  // The flows of backends and weights take only the weights
   std::string weight_path = vm["weight_path"].as<std::string>();
-  std::string key_type = vm["key_type"].as<std::string>();
-  std::string value_type = vm["value_type"].as<std::string>();
-  num_workers = vm["num_workers"].as<uint32_t>();
-  num_bg = vm["num_bg"].as<uint32_t>();
+  std::string key_type, value_type;
+  if (vm.count("key_type")) {
+    key_type = vm["key_type"].as<std::string>();
+  }
+  if (vm.count("value_type")) {
+    value_type = vm["value_type"].as<std::string>();
+  }
+  if (vm.count("num_workers")) {
+    num_workers = vm["num_workers"].as<uint32_t>();
+  }
+  if (vm.count("num_bg")) {
+    num_bg = vm["num_bg"].as<uint32_t>();
+  }
   uint32_t buffer_size = 128;
   if (vm.count("buffer_size")) {
     buffer_size = vm["buffer_size"].as<uint32_t>();
   }
-  COUT_INFO("# user threads: " << num_workers << "\t# bg threads: " << num_bg)
+  if (vm.count("filter_bits")) {
+    filter_bits_per_key = vm["filter_bits"].as<uint32_t>();
+  }
+  if (vm.count("rank_stride")) {
+    rank_stride = vm["rank_stride"].as<uint32_t>();
+  }
+  if (vm.count("num_shards")) {
+    num_shards = vm["num_shards"].as<uint32_t>();
+  }
+  if (vm.count("queue_depth")) {
+    queue_depth = vm["queue_depth"].as<uint32_t>();
+  }
+  if (vm.count("engine")) {
+    engine = vm["engine"].as<uint32_t>();
+  }
+  if (vm.count("max_runs")) {
+    max_runs = vm["max_runs"].as<uint32_t>();
+  }
+  if (vm.count("precision")) {
+    precision = vm["precision"].as<uint32_t>();
+  }
+  if (vm.count("load_threads")) {
+    load_threads = vm["load_threads"].as<uint32_t>();
+  }
+  if (vm.count("backend")) {
+    std::string backend = vm["backend"].as<std::string>();
+    ASSERT_WITH_MSG(InferBackend::find(backend) != nullptr, "Backend [" 
+                    << backend << "] is not built in")
+    InferBackend::set_default(InferBackend::find(backend));
+  }
+  COUT_INFO("# user threads: " << num_workers << "\t# bg threads: " << num_bg 
+            << "\t# flow backend: " << InferBackend::get_default()->name())
   if (test_type == "keyset") {
     std::string data_path = vm["data_path"].as<std::string>();
     if (key_type == "double" && value_type == "uint64") {
@@ -276,6 +733,22 @@ int main(int argc, char* argv[]) {
       COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
                << value_type << "]")
     }
+  } else if (test_type == "backend") {
+    test_backends<uint64_t, uint64_t>(weight_path);
+  } else if (test_type == "transform") {
+    std::string data_path = vm["data_path"].as<std::string>();
+    if (key_type == "double" && value_type == "uint64") {
+      test_transform<double, uint64_t>(data_path, weight_path);
+    } else if (key_type == "int64" && value_type == "uint64") {
+      test_transform<int64_t, uint64_t>(data_path, weight_path);
+    } else if (key_type == "uint64" && value_type == "uint64") {
+      test_transform<uint64_t, uint64_t>(data_path, weight_path);
+    } else {
+      COUT_ERR("Unsupported key type [" << key_type << "] value type [" 
+               << value_type << "]")
+    }
+  } else if (test_type == "weights") {
+    test_weights<uint64_t, uint64_t>(weight_path);
   } else {
     COUT_ERR("Unsupported test type\t" << test_type)
   }
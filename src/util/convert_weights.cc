@@ -0,0 +1,63 @@
+#include "core/bnaf.h"
+#include "core/common.h"
+
+namespace po = boost::program_options;
+using namespace aflipara;
+
+// Convert the text weights of a flow to the binary format, which is mapped 
+// at load time
+void convert_weights(std::string input_path, std::string output_path) {
+  auto model = BNAF_Infer<double, uint64_t>::load(input_path, 
+                                                  InferBackend::get_default(),
+                                                  false);
+  model->save(output_path);
+  COUT_INFO("Convert [" << input_path << "] to [" << output_path << "]")
+}
+
+int main(int argc, char* argv[]) {
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help", (tostr("example: ./convert_weights ") 
+     + "--weight_path weights/books-200M-5P_2D1H2L_weights.txt " 
+     + "--output_dir weights").data())
+    ("weight_path", po::value<std::string>(), 
+     "the path of text weights, or a directory of them")
+    ("output_dir", po::value<std::string>(), 
+     "the output directory, where the '.txt' suffix becomes '.bin'")
+  ;
+
+  po::variables_map vm;
+  try {
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+  } catch (...) {
+    COUT_ERR("Unrecognized parameters, please use --help");
+  }
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    COUT_INFO(desc)
+    return 0;
+  }
+
+  check_options(vm, {"weight_path", "output_dir"});
+  std::filesystem::path weight_path = vm["weight_path"].as<std::string>();
+  std::filesystem::path output_dir = vm["output_dir"].as<std::string>();
+  std::filesystem::create_directories(output_dir);
+  std::vector<std::filesystem::path> inputs;
+  if (std::filesystem::is_directory(weight_path)) {
+    for (const auto& entry : std::filesystem::directory_iterator(weight_path)) {
+      if (entry.path().extension() == ".txt") {
+        inputs.push_back(entry.path());
+      }
+    }
+    std::sort(inputs.begin(), inputs.end());
+  } else {
+    inputs.push_back(weight_path);
+  }
+  for (const std::filesystem::path& input : inputs) {
+    std::filesystem::path output = output_dir / input.filename();
+    output.replace_extension(".bin");
+    convert_weights(input.string(), output.string());
+  }
+  return 0;
+}
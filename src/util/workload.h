@@ -39,6 +39,26 @@ std::string get_operation(OperationType op) {
   }
 }
 
+// Deterministic bytes of the value of a key, 'version' tells overwrites apart
+template<typename KT>
+void generate_value(const KT& key, uint64_t version, uint32_t size, 
+                    std::string& value) {
+  uint64_t seed = version;
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&key);
+  for (uint32_t i = 0; i < sizeof(KT); ++ i) {
+    seed = seed * 131 + bytes[i];
+  }
+  value.resize(size);
+  for (uint32_t i = 0; i < size; i += 8) {
+    // SplitMix64
+    uint64_t z = (seed += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    memcpy(&value[i], &z, std::min(size - i, 8U));
+  }
+}
+
 template<typename KT>
 void load_keyset(std::string path, std::vector<KT>& keys) {
   std::ifstream in(path, std::ios::binary | std::ios::in);